@@ -25,6 +25,7 @@
 #include <KWaylandServer/surface_interface.h>
 
 #include <QPainter>
+#include <QScopeGuard>
 
 #include <netwm.h>
 #include <xcb/xcb_icccm.h>
@@ -44,6 +45,9 @@ private Q_SLOTS:
     void testWindowScaled();
     void testCompositorRestart();
     void testX11Window();
+    void testShmBandwidth_data();
+    void testShmBandwidth();
+    void testTranslucentThroughput();
 };
 
 void SceneQPainterTest::cleanup()
@@ -380,5 +384,90 @@ void SceneQPainterTest::testX11Window()
     c.reset();
 }
 
+void SceneQPainterTest::testShmBandwidth_data()
+{
+    QTest::addColumn<bool>("zeroCopy");
+
+    QTest::newRow("copy") << false;
+    QTest::newRow("zero-copy") << true;
+}
+
+void SceneQPainterTest::testShmBandwidth()
+{
+    // this test measures how long it takes to present fully damaged frames of a big shm window
+    QFETCH(bool, zeroCopy);
+    qputenv("KWIN_QPAINTER_SHM_ZERO_COPY", zeroCopy ? QByteArrayLiteral("1") : QByteArrayLiteral("0"));
+    auto unsetZeroCopy = qScopeGuard([] {
+        qunsetenv("KWIN_QPAINTER_SHM_ZERO_COPY");
+    });
+    KWin::Cursors::self()->mouse()->setPos(1200, 1000);
+
+    using namespace KWayland::Client;
+    QVERIFY(Test::setupWaylandConnection());
+    QScopedPointer<KWayland::Client::Surface> s(Test::createSurface());
+    QScopedPointer<Test::XdgToplevel> ss(Test::createXdgToplevelSurface(s.data()));
+    AbstractClient *client = Test::renderAndWaitForShown(s.data(), QSize(1024, 768), Qt::blue);
+    QVERIFY(client);
+    client->move(QPoint(0, 0));
+
+    auto scene = KWin::Compositor::self()->scene();
+    QSignalSpy frameRenderedSpy(scene, &Scene::frameRendered);
+    QVERIFY(frameRenderedSpy.isValid());
+
+    QImage image(QSize(1024, 768), QImage::Format_ARGB32_Premultiplied);
+    int frame = 0;
+    QBENCHMARK {
+        image.fill(frame++ % 2 ? Qt::red : Qt::green);
+        Test::render(s.data(), image);
+        QVERIFY(frameRenderedSpy.wait());
+    }
+
+    // the last frame must have been presented, whichever way the buffer was sampled
+    const QImage *renderBuffer = scene->qpainterRenderBuffer(kwinApp()->platform()->enabledOutputs().constFirst());
+    QCOMPARE(renderBuffer->pixelColor(10, 10), image.pixelColor(10, 10));
+}
+
+void SceneQPainterTest::testTranslucentThroughput()
+{
+    // this test measures how long it takes to composite a full screen of overlapping translucent windows
+    KWin::Cursors::self()->mouse()->setPos(1200, 1000);
+
+    using namespace KWayland::Client;
+    QVERIFY(Test::setupWaylandConnection());
+    QVector<Surface *> surfaces;
+    QVector<Test::XdgToplevel *> toplevels;
+    auto destroySurfaces = qScopeGuard([&surfaces, &toplevels] {
+        qDeleteAll(toplevels);
+        qDeleteAll(surfaces);
+    });
+    const QVector<QColor> colors{Qt::red, Qt::green, Qt::blue};
+    for (const QColor &color : colors) {
+        Surface *surface = Test::createSurface();
+        surfaces << surface;
+        Test::XdgToplevel *toplevel = Test::createXdgToplevelSurface(surface, surface);
+        toplevels << toplevel;
+        AbstractClient *client = Test::renderAndWaitForShown(surface, QSize(1280, 1024), color);
+        QVERIFY(client);
+        client->move(QPoint(0, 0));
+        client->setOpacity(0.5);
+    }
+
+    auto scene = KWin::Compositor::self()->scene();
+    QSignalSpy frameRenderedSpy(scene, &Scene::frameRendered);
+    QVERIFY(frameRenderedSpy.isValid());
+
+    QBENCHMARK {
+        scene->addRepaintFull();
+        QVERIFY(frameRenderedSpy.wait());
+    }
+
+    // the topmost window is blended over the other two, which are blended over black
+    const QImage *renderBuffer = scene->qpainterRenderBuffer(kwinApp()->platform()->enabledOutputs().constFirst());
+    const QColor color = renderBuffer->pixelColor(10, 10);
+    QVERIFY(qAbs(color.red() - 32) <= 2);
+    QVERIFY(qAbs(color.green() - 64) <= 2);
+    QVERIFY(qAbs(color.blue() - 128) <= 2);
+}
+
 WAYLANDTEST_MAIN(SceneQPainterTest)
 #include "scene_qpainter_test.moc"
@@ -11,6 +11,7 @@
 
 #include "abstract_client.h"
 #include "atoms.h"
+#include "composite.h"
 #include "x11client.h"
 #include "deleted.h"
 #include "main.h"
@@ -49,6 +50,8 @@ private Q_SLOTS:
     void testKeepAbove();
     void testKeepBelow();
 
+    void testWindowsToRender_data();
+    void testWindowsToRender();
 };
 
 void StackingOrderTest::initTestCase()
@@ -893,5 +896,52 @@ void StackingOrderTest::testKeepBelow()
     QCOMPARE(workspace()->stackingOrder(), (QList<Toplevel *>{clientB, clientA}));
 }
 
+void StackingOrderTest::testWindowsToRender_data()
+{
+    QTest::addColumn<bool>("restack");
+
+    QTest::newRow("unchanged") << false;
+    QTest::newRow("restacked") << true;
+}
+
+void StackingOrderTest::testWindowsToRender()
+{
+    // This test verifies that the list of windows to render follows the stacking order
+    // and benchmarks building it with lots of windows, with and without restacking.
+    QFETCH(bool, restack);
+
+    const int windowCount = 500;
+    QVector<KWayland::Client::Surface *> surfaces;
+    QList<Toplevel *> clients;
+    for (int i = 0; i < windowCount; ++i) {
+        KWayland::Client::Surface *surface = Test::createSurface();
+        QVERIFY(surface);
+        Test::XdgToplevel *shellSurface = Test::createXdgToplevelSurface(surface, surface);
+        QVERIFY(shellSurface);
+        AbstractClient *client = Test::renderAndWaitForShown(surface, QSize(32, 32), Qt::blue);
+        QVERIFY(client);
+        surfaces << surface;
+        clients << client;
+    }
+
+    Compositor *compositor = Compositor::self();
+    QCOMPARE(compositor->windowsToRender(), clients);
+
+    // Raising a window must be reflected in the list of windows to render.
+    AbstractClient *bottom = static_cast<AbstractClient *>(clients.takeFirst());
+    workspace()->raiseClient(bottom);
+    clients.append(bottom);
+    QCOMPARE(compositor->windowsToRender(), clients);
+
+    QBENCHMARK {
+        if (restack) {
+            workspace()->raiseClient(static_cast<AbstractClient *>(compositor->windowsToRender().first()));
+        }
+        compositor->windowsToRender();
+    }
+
+    qDeleteAll(surfaces);
+}
+
 WAYLANDTEST_MAIN(StackingOrderTest)
 #include "stacking_order_test.moc"
@@ -51,6 +51,8 @@ private Q_SLOTS:
     void testFullscreenWindowGroups();
     void testActivateFocusedWindow();
     void testReentrantMoveResize();
+    void testWindowIdIndex();
+    void benchmarkWorkspaceEvent();
 };
 
 void X11ClientTest::initTestCase()
@@ -1107,5 +1109,101 @@ void X11ClientTest::testReentrantMoveResize()
     QVERIFY(Test::waitForWindowDestroyed(client));
 }
 
+void X11ClientTest::testWindowIdIndex()
+{
+    // This test verifies that all windows owned by an X11Client can be looked up by id.
+    QScopedPointer<xcb_connection_t, XcbConnectionDeleter> c(xcb_connect(nullptr, nullptr));
+    QVERIFY(!xcb_connection_has_error(c.data()));
+    const QRect windowGeometry(0, 0, 100, 200);
+    xcb_window_t w = xcb_generate_id(c.data());
+    xcb_create_window(c.data(), XCB_COPY_FROM_PARENT, w, rootWindow(),
+                      windowGeometry.x(),
+                      windowGeometry.y(),
+                      windowGeometry.width(),
+                      windowGeometry.height(),
+                      0, XCB_WINDOW_CLASS_INPUT_OUTPUT, XCB_COPY_FROM_PARENT, 0, nullptr);
+    xcb_map_window(c.data(), w);
+    xcb_flush(c.data());
+
+    QSignalSpy windowCreatedSpy(workspace(), &Workspace::clientAdded);
+    QVERIFY(windowCreatedSpy.isValid());
+    QVERIFY(windowCreatedSpy.wait());
+    X11Client *client = windowCreatedSpy.last().first().value<X11Client *>();
+    QVERIFY(client);
+
+    QCOMPARE(workspace()->findClient(Predicate::WindowMatch, client->window()), client);
+    QCOMPARE(workspace()->findClient(Predicate::WrapperIdMatch, client->wrapperId()), client);
+    QCOMPARE(workspace()->findClient(Predicate::FrameIdMatch, client->frameId()), client);
+    if (client->inputId() != XCB_WINDOW_NONE) {
+        QCOMPARE(workspace()->findClient(Predicate::InputIdMatch, client->inputId()), client);
+    }
+    // the role has to match as well
+    QVERIFY(!workspace()->findClient(Predicate::FrameIdMatch, client->window()));
+    QVERIFY(!workspace()->findClient(Predicate::WindowMatch, client->frameId()));
+    QVERIFY(!workspace()->findUnmanaged(client->window()));
+
+    const xcb_window_t windowId = client->window();
+    const xcb_window_t frameId = client->frameId();
+
+    xcb_destroy_window(c.data(), w);
+    xcb_flush(c.data());
+    QVERIFY(Test::waitForWindowDestroyed(client));
+
+    QVERIFY(!workspace()->findClient(Predicate::WindowMatch, windowId));
+    QVERIFY(!workspace()->findClient(Predicate::FrameIdMatch, frameId));
+}
+
+void X11ClientTest::benchmarkWorkspaceEvent()
+{
+    // This benchmark floods the X11 event dispatcher with PropertyNotify events
+    // for managed frames as well as for windows which are unknown to KWin.
+    QScopedPointer<xcb_connection_t, XcbConnectionDeleter> c(xcb_connect(nullptr, nullptr));
+    QVERIFY(!xcb_connection_has_error(c.data()));
+
+    QSignalSpy windowCreatedSpy(workspace(), &Workspace::clientAdded);
+    QVERIFY(windowCreatedSpy.isValid());
+
+    const int windowCount = 50;
+    QVector<xcb_window_t> windows;
+    for (int i = 0; i < windowCount; ++i) {
+        xcb_window_t w = xcb_generate_id(c.data());
+        xcb_create_window(c.data(), XCB_COPY_FROM_PARENT, w, rootWindow(),
+                          i, i, 100, 100,
+                          0, XCB_WINDOW_CLASS_INPUT_OUTPUT, XCB_COPY_FROM_PARENT, 0, nullptr);
+        xcb_map_window(c.data(), w);
+        windows << w;
+    }
+    xcb_flush(c.data());
+    QTRY_COMPARE(windowCreatedSpy.count(), windowCount);
+
+    QVector<xcb_property_notify_event_t> events;
+    for (int i = 0; i < windowCreatedSpy.count(); ++i) {
+        X11Client *client = windowCreatedSpy.at(i).first().value<X11Client *>();
+        QVERIFY(client);
+        xcb_property_notify_event_t event;
+        memset(&event, 0, sizeof(event));
+        event.response_type = XCB_PROPERTY_NOTIFY;
+        event.atom = XCB_ATOM_CUT_BUFFER0;
+        event.state = XCB_PROPERTY_NEW_VALUE;
+        event.window = client->frameId();
+        events << event;
+        // a window that is not known to KWin has to go through all lookups
+        event.window = xcb_generate_id(c.data());
+        events << event;
+    }
+
+    QBENCHMARK {
+        for (xcb_property_notify_event_t &event : events) {
+            workspace()->workspaceEvent(reinterpret_cast<xcb_generic_event_t *>(&event));
+        }
+    }
+
+    for (xcb_window_t w : qAsConst(windows)) {
+        xcb_destroy_window(c.data(), w);
+    }
+    xcb_flush(c.data());
+    QTRY_VERIFY(workspace()->clientList().isEmpty());
+}
+
 WAYLANDTEST_MAIN(X11ClientTest)
 #include "x11_client_test.moc"
@@ -131,6 +131,8 @@ private Q_SLOTS:
     void testInactiveOpacityForceTemporarily();
 
     void testMatchAfterNameChange();
+
+    void benchmarkFind();
 };
 
 void TestXdgShellClientRules::initTestCase()
@@ -4289,5 +4291,56 @@ void TestXdgShellClientRules::testMatchAfterNameChange()
     QCOMPARE(c->keepAbove(), true);
 }
 
+void TestXdgShellClientRules::benchmarkFind()
+{
+    // Initialize RuleBook with a mix of exact, substring and regular expression rules.
+    const int ruleCount = 500;
+    KSharedConfig::Ptr config = KSharedConfig::openConfig(QString(), KConfig::SimpleConfig);
+    config->group("General").writeEntry("count", ruleCount);
+    for (int i = 0; i < ruleCount; ++i) {
+        KConfigGroup group = config->group(QString::number(i + 1));
+        group.writeEntry("above", true);
+        group.writeEntry("aboverule", int(Rules::Force));
+        group.writeEntry("wmclasscomplete", false);
+        switch (i % 3) {
+        case 0:
+            group.writeEntry("wmclass", QStringLiteral("org.kde.app%1").arg(i));
+            group.writeEntry("wmclassmatch", int(Rules::ExactMatch));
+            break;
+        case 1:
+            group.writeEntry("wmclass", QStringLiteral("app%1").arg(i));
+            group.writeEntry("wmclassmatch", int(Rules::SubstringMatch));
+            break;
+        case 2:
+            group.writeEntry("wmclass", QStringLiteral("^org\\.kde\\.(app|tool)%1$").arg(i));
+            group.writeEntry("wmclassmatch", int(Rules::RegExpMatch));
+            group.writeEntry("title", QStringLiteral("^Document %1 .*").arg(i));
+            group.writeEntry("titlematch", int(Rules::RegExpMatch));
+            break;
+        }
+    }
+    config->sync();
+
+    RuleBook::self()->setConfig(config);
+    workspace()->slotReconfigure();
+
+    // Create the test client.
+    AbstractClient *client;
+    KWayland::Client::Surface *surface;
+    Test::XdgToplevel *shellSurface;
+    std::tie(client, surface, shellSurface) = createWindow(QStringLiteral("org.kde.foo"));
+    QVERIFY(client);
+    QVERIFY(!client->keepAbove());
+
+    QBENCHMARK {
+        RuleBook::self()->find(client, false);
+    }
+
+    // Destroy the client.
+    delete shellSurface;
+    delete surface;
+    QVERIFY(Test::waitForWindowDestroyed(client));
+}
+
 WAYLANDTEST_MAIN(TestXdgShellClientRules)
 #include "xdgshellclient_rules_test.moc"
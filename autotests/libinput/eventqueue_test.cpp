@@ -0,0 +1,161 @@
+/*
+    KWin - the KDE window manager
+    This file is part of the KDE project.
+
+    SPDX-FileCopyrightText: 2014 Martin Gräßlin <mgraesslin@kde.org>
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+#include "mock_libinput.h"
+
+#include "backends/libinput/device.h"
+#include "backends/libinput/eventqueue.h"
+#include "backends/libinput/events.h"
+
+#include <QtTest>
+
+#include <thread>
+
+using namespace KWin::LibInput;
+
+class TestLibinputEventQueue : public QObject
+{
+    Q_OBJECT
+private Q_SLOTS:
+    void init();
+    void cleanup();
+
+    void testCapacity();
+    void testOrder();
+    void testFull();
+    void testPeek();
+    void benchmarkThroughput();
+
+private:
+    Event *createMotionEvent(quint32 time);
+
+    libinput_device *m_nativeDevice = nullptr;
+    Device *m_device = nullptr;
+};
+
+void TestLibinputEventQueue::init()
+{
+    m_nativeDevice = new libinput_device;
+    m_nativeDevice->pointer = true;
+    m_device = new Device(m_nativeDevice);
+}
+
+void TestLibinputEventQueue::cleanup()
+{
+    delete m_device;
+    m_device = nullptr;
+
+    delete m_nativeDevice;
+    m_nativeDevice = nullptr;
+}
+
+Event *TestLibinputEventQueue::createMotionEvent(quint32 time)
+{
+    libinput_event_pointer *pointerEvent = new libinput_event_pointer;
+    pointerEvent->device = m_nativeDevice;
+    pointerEvent->type = LIBINPUT_EVENT_POINTER_MOTION;
+    pointerEvent->delta = QSizeF(1, 1);
+    pointerEvent->time = time;
+    return Event::create(pointerEvent);
+}
+
+void TestLibinputEventQueue::testCapacity()
+{
+    QCOMPARE(EventQueue(1).capacity(), 1);
+    QCOMPARE(EventQueue(5).capacity(), 8);
+    QCOMPARE(EventQueue(4096).capacity(), 4096);
+}
+
+void TestLibinputEventQueue::testOrder()
+{
+    // this test verifies that events are taken in the order they were pushed
+    EventQueue queue(8);
+    QVERIFY(queue.isEmpty());
+    QVERIFY(!queue.take());
+
+    // wrap around the ring a few times
+    for (quint32 i = 0; i < 20; ++i) {
+        QVERIFY(queue.push(createMotionEvent(i)));
+        QVERIFY(queue.push(createMotionEvent(i + 100)));
+        QVERIFY(!queue.isEmpty());
+
+        QScopedPointer<Event> first(queue.take());
+        QVERIFY(first);
+        QCOMPARE(static_cast<PointerEvent *>(first.data())->time(), i);
+        QScopedPointer<Event> second(queue.take());
+        QVERIFY(second);
+        QCOMPARE(static_cast<PointerEvent *>(second.data())->time(), i + 100);
+        QVERIFY(queue.isEmpty());
+    }
+}
+
+void TestLibinputEventQueue::testFull()
+{
+    // this test verifies that pushing fails without taking ownership when the queue is full
+    EventQueue queue(4);
+    for (quint32 i = 0; i < 4; ++i) {
+        QVERIFY(queue.push(createMotionEvent(i)));
+    }
+    QScopedPointer<Event> rejected(createMotionEvent(4));
+    QVERIFY(!queue.push(rejected.data()));
+
+    QScopedPointer<Event> first(queue.take());
+    QCOMPARE(static_cast<PointerEvent *>(first.data())->time(), 0u);
+    QVERIFY(queue.push(rejected.take()));
+
+    // remaining events are deleted together with the queue
+}
+
+void TestLibinputEventQueue::testPeek()
+{
+    EventQueue queue(4);
+    QVERIFY(!queue.peek());
+    Event *first = createMotionEvent(1);
+    Event *second = createMotionEvent(2);
+    QVERIFY(queue.push(first));
+    QVERIFY(queue.push(second));
+    QCOMPARE(queue.peek(), first);
+    QCOMPARE(queue.peek(1), second);
+    QVERIFY(!queue.peek(2));
+
+    // peeking does not remove the event
+    QCOMPARE(queue.peek(), first);
+    delete queue.take();
+    QCOMPARE(queue.peek(), second);
+}
+
+void TestLibinputEventQueue::benchmarkThroughput()
+{
+    // this benchmark passes motion events from a producer thread to the consumer,
+    // just like the libinput thread feeds the main thread
+    const quint32 eventCount = 100000;
+    QBENCHMARK {
+        EventQueue queue;
+        std::thread producer([this, &queue, eventCount]() {
+            for (quint32 i = 0; i < eventCount; ++i) {
+                Event *event = createMotionEvent(i);
+                while (!queue.push(event)) {
+                    std::this_thread::yield();
+                }
+            }
+        });
+        quint32 received = 0;
+        while (received < eventCount) {
+            if (Event *event = queue.take()) {
+                delete event;
+                ++received;
+            } else {
+                std::this_thread::yield();
+            }
+        }
+        producer.join();
+    }
+}
+
+QTEST_GUILESS_MAIN(TestLibinputEventQueue)
+#include "eventqueue_test.moc"
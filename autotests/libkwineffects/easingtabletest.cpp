@@ -0,0 +1,116 @@
+/*
+    KWin - the KDE window manager
+    This file is part of the KDE project.
+
+    SPDX-FileCopyrightText: 2011 Thomas Lübking <thomas.luebking@web.de>
+    SPDX-FileCopyrightText: 2018 Vlad Zahorodnii <vlad.zahorodnii@kde.org>
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#include "anidata_p.h"
+
+#include <QtTest>
+
+using namespace KWin;
+
+Q_DECLARE_METATYPE(QEasingCurve::Type)
+
+class EasingTableTest : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void testValueForProgress_data();
+    void testValueForProgress();
+    void testShared();
+
+    void benchmarkValueForProgress_data();
+    void benchmarkValueForProgress();
+};
+
+void EasingTableTest::testValueForProgress_data()
+{
+    QTest::addColumn<QEasingCurve::Type>("type");
+
+    QTest::newRow("Linear") << QEasingCurve::Linear;
+    QTest::newRow("InOutSine") << QEasingCurve::InOutSine;
+    QTest::newRow("OutCubic") << QEasingCurve::OutCubic;
+    QTest::newRow("InQuad") << QEasingCurve::InQuad;
+    QTest::newRow("InOutBack") << QEasingCurve::InOutBack;
+    QTest::newRow("OutElastic") << QEasingCurve::OutElastic;
+    QTest::newRow("OutBounce") << QEasingCurve::OutBounce;
+}
+
+void EasingTableTest::testValueForProgress()
+{
+    QFETCH(QEasingCurve::Type, type);
+
+    const QEasingCurve curve(type);
+    const EasingTablePtr table = EasingTable::get(curve);
+
+    // The start and the end of an animation have to be exact.
+    QCOMPARE(table->valueForProgress(0.0), float(curve.valueForProgress(0.0)));
+    QCOMPARE(table->valueForProgress(1.0), float(curve.valueForProgress(1.0)));
+
+    for (int i = 0; i <= 1000; ++i) {
+        const qreal progress = i / 1000.0;
+        QVERIFY(qAbs(table->valueForProgress(progress) - curve.valueForProgress(progress)) < 1e-3);
+    }
+
+    // The progress is clamped.
+    QCOMPARE(table->valueForProgress(-0.5), table->valueForProgress(0.0));
+    QCOMPARE(table->valueForProgress(1.5), table->valueForProgress(1.0));
+}
+
+void EasingTableTest::testShared()
+{
+    const EasingTablePtr a = EasingTable::get(QEasingCurve::OutCubic);
+    const EasingTablePtr b = EasingTable::get(QEasingCurve::OutCubic);
+    const EasingTablePtr c = EasingTable::get(QEasingCurve::InCubic);
+
+    QCOMPARE(a, b);
+    QVERIFY(a != c);
+    QCOMPARE(c->curve().type(), QEasingCurve::InCubic);
+}
+
+void EasingTableTest::benchmarkValueForProgress_data()
+{
+    QTest::addColumn<QEasingCurve::Type>("type");
+    QTest::addColumn<bool>("table");
+
+    QTest::newRow("OutCubic/QEasingCurve") << QEasingCurve::OutCubic << false;
+    QTest::newRow("OutCubic/EasingTable") << QEasingCurve::OutCubic << true;
+    QTest::newRow("OutElastic/QEasingCurve") << QEasingCurve::OutElastic << false;
+    QTest::newRow("OutElastic/EasingTable") << QEasingCurve::OutElastic << true;
+}
+
+void EasingTableTest::benchmarkValueForProgress()
+{
+    // Evaluates the curve the way a frame with 40 animated windows does.
+    QFETCH(QEasingCurve::Type, type);
+    QFETCH(bool, table);
+
+    const QEasingCurve curve(type);
+    const EasingTablePtr easingTable = EasingTable::get(curve);
+
+    float sum = 0;
+    if (table) {
+        QBENCHMARK {
+            for (int i = 0; i < 40; ++i) {
+                sum += easingTable->valueForProgress(i / 40.0);
+            }
+        }
+    } else {
+        QBENCHMARK {
+            for (int i = 0; i < 40; ++i) {
+                sum += curve.valueForProgress(i / 40.0);
+            }
+        }
+    }
+    Q_UNUSED(sum)
+}
+
+QTEST_MAIN(EasingTableTest)
+
+#include "easingtabletest.moc"
@@ -0,0 +1,232 @@
+/*
+    KWin - the KDE window manager
+    This file is part of the KDE project.
+
+    SPDX-FileCopyrightText: 2006-2007 Rivo Laks <rivolaks@hot.ee>
+    SPDX-FileCopyrightText: 2010, 2011 Martin Gräßlin <mgraesslin@kde.org>
+    SPDX-FileCopyrightText: 2012 Philipp Knechtges <philipp-dev@knechtges.com>
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+#include "kwinglplatform.h"
+#include "kwinglutils.h"
+#include "kwingltexture_p.h"
+
+#include <QOffscreenSurface>
+#include <QOpenGLContext>
+#include <QPainter>
+#include <QtTest>
+
+using namespace KWin;
+
+class GLTextureTest : public QObject
+{
+    Q_OBJECT
+private Q_SLOTS:
+    void initTestCase();
+    void cleanupTestCase();
+    void testCoalesce_data();
+    void testCoalesce();
+    void testUpload_data();
+    void testUpload();
+    void testWrapAround();
+
+private:
+    static QImage createImage(const QSize &size, int seed);
+    static QImage readBack(GLTexture &texture);
+    static void compareImages(const QImage &actual, const QImage &expected);
+
+    QScopedPointer<QOffscreenSurface> m_surface;
+    QScopedPointer<QOpenGLContext> m_context;
+    bool m_haveGL = false;
+};
+
+void GLTextureTest::initTestCase()
+{
+    m_context.reset(new QOpenGLContext);
+    if (!m_context->create()) {
+        return;
+    }
+    m_surface.reset(new QOffscreenSurface);
+    m_surface->setFormat(m_context->format());
+    m_surface->create();
+    if (!m_context->makeCurrent(m_surface.data())) {
+        return;
+    }
+
+    GLPlatform::instance()->detect(EglPlatformInterface);
+    if (GLPlatform::instance()->isGLES()) {
+        // glGetTexImage() is needed to read the textures back
+        GLPlatform::cleanup();
+        return;
+    }
+    initGL([](const char *name) {
+        return QOpenGLContext::currentContext()->getProcAddress(name);
+    });
+    m_haveGL = true;
+}
+
+void GLTextureTest::cleanupTestCase()
+{
+    if (m_haveGL) {
+        cleanupGL();
+    }
+    if (m_context) {
+        m_context->doneCurrent();
+    }
+}
+
+QImage GLTextureTest::createImage(const QSize &size, int seed)
+{
+    QImage image(size, QImage::Format_ARGB32_Premultiplied);
+    for (int y = 0; y < size.height(); ++y) {
+        QRgb *line = reinterpret_cast<QRgb *>(image.scanLine(y));
+        for (int x = 0; x < size.width(); ++x) {
+            line[x] = qRgb(x + seed, y + seed, x ^ y ^ seed);
+        }
+    }
+    return image;
+}
+
+QImage GLTextureTest::readBack(GLTexture &texture)
+{
+    QImage image(texture.size(), QImage::Format_ARGB32_Premultiplied);
+    texture.bind();
+    glGetTexImage(texture.target(), 0, GL_BGRA, GL_UNSIGNED_INT_8_8_8_8_REV, image.bits());
+    texture.unbind();
+    return image;
+}
+
+void GLTextureTest::compareImages(const QImage &actual, const QImage &expected)
+{
+    QCOMPARE(actual.size(), expected.size());
+    for (int y = 0; y < expected.height(); ++y) {
+        const QRgb *actualLine = reinterpret_cast<const QRgb *>(actual.constScanLine(y));
+        const QRgb *expectedLine = reinterpret_cast<const QRgb *>(expected.constScanLine(y));
+        for (int x = 0; x < expected.width(); ++x) {
+            if (actualLine[x] != expectedLine[x]) {
+                QFAIL(qPrintable(QStringLiteral("Pixel at %1,%2 is %3, expected %4")
+                                     .arg(x).arg(y)
+                                     .arg(actualLine[x], 8, 16, QLatin1Char('0'))
+                                     .arg(expectedLine[x], 8, 16, QLatin1Char('0'))));
+            }
+        }
+    }
+}
+
+static QRegion grid(const QSize &cellSize, const QSize &spacing, int columns, int rows)
+{
+    QRegion region;
+    for (int row = 0; row < rows; ++row) {
+        for (int column = 0; column < columns; ++column) {
+            region += QRect(QPoint(column * spacing.width(), row * spacing.height()), cellSize);
+        }
+    }
+    return region;
+}
+
+void GLTextureTest::testCoalesce_data()
+{
+    QTest::addColumn<QRegion>("region");
+    QTest::addColumn<bool>("coalesced");
+
+    QTest::newRow("empty") << QRegion() << false;
+    QTest::newRow("single") << QRegion(10, 10, 100, 50) << false;
+    QTest::newRow("two distant") << (QRegion(0, 0, 10, 10) + QRegion(500, 500, 10, 10)) << false;
+    QTest::newRow("two adjacent") << (QRegion(0, 0, 10, 10) + QRegion(11, 0, 10, 10)) << true;
+    // 16 rects covering 16% of their bounding rect
+    QTest::newRow("16 scattered") << grid(QSize(10, 10), QSize(25, 25), 4, 4) << false;
+    // 17 rects are too many, even though they're scattered
+    QTest::newRow("17 scattered") << (grid(QSize(10, 10), QSize(25, 25), 4, 4) + QRegion(200, 200, 10, 10)) << true;
+    QTest::newRow("75% covered") << (QRegion(0, 0, 100, 50) + QRegion(0, 75, 100, 25)) << true;
+    QTest::newRow("74% covered") << (QRegion(0, 0, 100, 50) + QRegion(0, 76, 100, 24)) << false;
+    QTest::newRow("dense") << grid(QSize(30, 30), QSize(32, 32), 4, 4) << true;
+    QTest::newRow("sparse") << grid(QSize(15, 15), QSize(32, 32), 4, 4) << false;
+}
+
+void GLTextureTest::testCoalesce()
+{
+    QFETCH(QRegion, region);
+    QFETCH(bool, coalesced);
+
+    const QRegion uploadRegion = GLTexturePrivate::coalesceUploadRegion(region);
+    if (coalesced) {
+        QCOMPARE(uploadRegion, QRegion(region.boundingRect()));
+    } else {
+        QCOMPARE(uploadRegion, region);
+    }
+}
+
+void GLTextureTest::testUpload_data()
+{
+    QTest::addColumn<QRegion>("region");
+
+    QTest::newRow("single") << QRegion(10, 20, 100, 50);
+    QTest::newRow("odd width") << QRegion(3, 5, 7, 9);
+    QTest::newRow("scattered") << grid(QSize(9, 7), QSize(40, 30), 4, 4);
+    QTest::newRow("dense") << grid(QSize(30, 30), QSize(32, 32), 4, 4);
+    QTest::newRow("too many rects") << grid(QSize(5, 5), QSize(20, 20), 5, 5);
+    QTest::newRow("clipped") << QRegion(200, 200, 100, 100);
+}
+
+void GLTextureTest::testUpload()
+{
+    if (!m_haveGL) {
+        QSKIP("No desktop OpenGL context available");
+    }
+    QFETCH(QRegion, region);
+
+    const QSize size(256, 256);
+    const QImage initial = createImage(size, 0);
+    const QImage source = createImage(size, 100);
+
+    GLTexture texture(initial);
+    texture.update(source, region);
+
+    // Pixels inside the uploaded region come from the new image, the others are untouched.
+    // If the region is coalesced, pixels between its rects are uploaded as well.
+    QImage expected = initial;
+    QPainter painter(&expected);
+    painter.setCompositionMode(QPainter::CompositionMode_Source);
+    const QRegion uploadRegion = GLTexturePrivate::coalesceUploadRegion(region & QRect(QPoint(0, 0), size));
+    for (const QRect &rect : uploadRegion) {
+        painter.drawImage(rect, source, rect);
+    }
+    painter.end();
+
+    compareImages(readBack(texture), expected);
+}
+
+void GLTextureTest::testWrapAround()
+{
+    if (!m_haveGL) {
+        QSKIP("No desktop OpenGL context available");
+    }
+
+    // The persistent upload buffer only has room for a few uploads of this size, so uploads
+    // of varying sizes make it wrap around several times, at offsets that aren't aligned
+    // to the size of the buffer.
+    const QSize size(1024, 1024);
+    QImage expected = createImage(size, 0);
+    GLTexture texture(expected);
+
+    for (int i = 0; i < 12; ++i) {
+        const QImage source = createImage(size, i + 1);
+        const QRegion region = QRect(0, (i * 37) % 300, size.width(), 300 + (i * 53) % 400);
+        texture.update(source, region);
+
+        QPainter painter(&expected);
+        painter.setCompositionMode(QPainter::CompositionMode_Source);
+        painter.drawImage(region.boundingRect(), source, region.boundingRect());
+        painter.end();
+
+        compareImages(readBack(texture), expected);
+        if (QTest::currentTestFailed()) {
+            qWarning() << "Upload" << i << "failed";
+            return;
+        }
+    }
+}
+
+QTEST_MAIN(GLTextureTest)
+#include "gltexturetest.moc"
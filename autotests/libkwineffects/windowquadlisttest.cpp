@@ -7,10 +7,28 @@
     SPDX-License-Identifier: GPL-2.0-or-later
 */
 #include <kwineffects.h>
+#include <QMatrix4x4>
 #include <QTest>
 
+#ifndef GL_TRIANGLES
+#  define GL_TRIANGLES      0x0004
+#endif
+
+#ifndef GL_QUADS
+#  define GL_QUADS          0x0007
+#endif
+
 Q_DECLARE_METATYPE(KWin::WindowQuadList)
 
+// Returns room for @p count vertices in @p storage, starting @p offset bytes past a 16 byte boundary.
+static KWin::GLVertex2D *vertexBuffer(QByteArray &storage, int count, int offset)
+{
+    storage.resize(count * sizeof(KWin::GLVertex2D) + 16 + offset);
+    char *data = storage.data();
+    data += (16 - (reinterpret_cast<quintptr>(data) & 0xf)) & 0xf;
+    return reinterpret_cast<KWin::GLVertex2D *>(data + offset);
+}
+
 class WindowQuadListTest : public QObject
 {
     Q_OBJECT
@@ -19,9 +37,19 @@ private Q_SLOTS:
     void testMakeGrid();
     void testMakeRegularGrid_data();
     void testMakeRegularGrid();
+    void testMakeInterleavedArrays_data();
+    void testMakeInterleavedArrays();
+
+    void benchmarkMakeGrid_data();
+    void benchmarkMakeGrid();
+    void benchmarkMakeRegularGrid_data();
+    void benchmarkMakeRegularGrid();
+    void benchmarkMakeInterleavedArrays_data();
+    void benchmarkMakeInterleavedArrays();
 
 private:
     KWin::WindowQuad makeQuad(const QRectF &rect);
+    KWin::WindowQuadList makeWindow();
 };
 
 KWin::WindowQuad WindowQuadListTest::makeQuad(const QRectF &r)
@@ -197,6 +225,133 @@ void WindowQuadListTest::testMakeRegularGrid()
     }
 }
 
+void WindowQuadListTest::testMakeInterleavedArrays_data()
+{
+    QTest::addColumn<uint>("type");
+    QTest::addColumn<int>("offset");
+
+    QTest::newRow("quads") << uint(GL_QUADS) << 0;
+    QTest::newRow("quads/unaligned") << uint(GL_QUADS) << int(sizeof(float));
+    QTest::newRow("triangles") << uint(GL_TRIANGLES) << 0;
+    QTest::newRow("triangles/unaligned") << uint(GL_TRIANGLES) << int(sizeof(float));
+}
+
+void WindowQuadListTest::testMakeInterleavedArrays()
+{
+    QFETCH(uint, type);
+    QFETCH(int, offset);
+
+    KWin::WindowQuadList quads;
+    for (int i = 0; i < 3; ++i) {
+        KWin::WindowQuad quad;
+        quad[0] = KWin::WindowVertex(10 * i, 20, 1 + i, 2);
+        quad[1] = KWin::WindowVertex(10 * i + 10, 20, 3 + i, 4);
+        quad[2] = KWin::WindowVertex(10 * i + 10, 30, 5 + i, 6);
+        quad[3] = KWin::WindowVertex(10 * i, 30, 7 + i, 8);
+        quads.append(quad);
+    }
+
+    QMatrix4x4 textureMatrix;
+    textureMatrix.translate(0.5, 0.25);
+    textureMatrix.scale(0.5, 2.0);
+
+    const QVector<int> order = type == GL_QUADS ? QVector<int>{0, 1, 2, 3} : QVector<int>{1, 0, 3, 3, 2, 1};
+
+    QByteArray storage;
+    KWin::GLVertex2D *vertices = vertexBuffer(storage, quads.count() * order.count(), offset);
+    quads.makeInterleavedArrays(type, vertices, textureMatrix);
+
+    const KWin::GLVertex2D *vertex = vertices;
+    for (const KWin::WindowQuad &quad : qAsConst(quads)) {
+        for (int index : order) {
+            const KWin::WindowVertex &expected = quad[index];
+            QCOMPARE(vertex->position, QVector2D(expected.x(), expected.y()));
+            QCOMPARE(vertex->texcoord, QVector2D(expected.u() * 0.5 + 0.5, expected.v() * 2.0 + 0.25));
+            ++vertex;
+        }
+    }
+}
+
+KWin::WindowQuadList WindowQuadListTest::makeWindow()
+{
+    // A decorated window, made of the four decoration parts and the contents.
+    KWin::WindowQuadList quads;
+    quads.append(makeQuad(QRectF(0, 0, 1000, 30)));
+    quads.append(makeQuad(QRectF(0, 30, 4, 666)));
+    quads.append(makeQuad(QRectF(996, 30, 4, 666)));
+    quads.append(makeQuad(QRectF(0, 696, 1000, 4)));
+    quads.append(makeQuad(QRectF(4, 30, 992, 666)));
+    return quads;
+}
+
+void WindowQuadListTest::benchmarkMakeGrid_data()
+{
+    QTest::addColumn<int>("quadSize");
+
+    QTest::newRow("100") << 100;
+    QTest::newRow("16") << 16;
+    QTest::newRow("4") << 4;
+}
+
+void WindowQuadListTest::benchmarkMakeGrid()
+{
+    QFETCH(int, quadSize);
+    const KWin::WindowQuadList quads = makeWindow();
+
+    QBENCHMARK {
+        const KWin::WindowQuadList grid = quads.makeGrid(quadSize);
+        Q_UNUSED(grid)
+    }
+}
+
+void WindowQuadListTest::benchmarkMakeRegularGrid_data()
+{
+    QTest::addColumn<int>("subdivisions");
+
+    QTest::newRow("4") << 4;
+    QTest::newRow("20") << 20;
+    QTest::newRow("100") << 100;
+}
+
+void WindowQuadListTest::benchmarkMakeRegularGrid()
+{
+    QFETCH(int, subdivisions);
+    const KWin::WindowQuadList quads = makeWindow();
+
+    QBENCHMARK {
+        const KWin::WindowQuadList grid = quads.makeRegularGrid(subdivisions, subdivisions);
+        Q_UNUSED(grid)
+    }
+}
+
+void WindowQuadListTest::benchmarkMakeInterleavedArrays_data()
+{
+    QTest::addColumn<uint>("type");
+    QTest::addColumn<int>("offset");
+
+    QTest::newRow("triangles") << uint(GL_TRIANGLES) << 0;
+    QTest::newRow("triangles/unaligned") << uint(GL_TRIANGLES) << int(sizeof(float));
+    QTest::newRow("quads") << uint(GL_QUADS) << 0;
+}
+
+void WindowQuadListTest::benchmarkMakeInterleavedArrays()
+{
+    QFETCH(uint, type);
+    QFETCH(int, offset);
+
+    const KWin::WindowQuadList quads = makeWindow().makeRegularGrid(100, 100);
+
+    QMatrix4x4 textureMatrix;
+    textureMatrix.scale(1.0 / 1000, 1.0 / 700);
+
+    QByteArray storage;
+    KWin::GLVertex2D *vertices = vertexBuffer(storage, quads.count() * 6, offset);
+
+    QBENCHMARK {
+        quads.makeInterleavedArrays(type, vertices, textureMatrix);
+    }
+}
+
 QTEST_MAIN(WindowQuadListTest)
 
 #include "windowquadlisttest.moc"
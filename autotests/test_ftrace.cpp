@@ -21,16 +21,25 @@ public:
 private Q_SLOTS:
     void benchmarkTraceOff();
     void benchmarkTraceDurationOff();
+    void benchmarkTraceEventOff();
     void enable();
+    void binaryEvents();
+    void benchmarkTraceOn();
+    void benchmarkTraceDurationOn();
+    void benchmarkTraceEventOn();
+    void benchmarkTraceScopeOn();
 
 private:
     QTemporaryFile m_tempFile;
+    QTemporaryFile m_rawTempFile;
 };
 
 TestFTrace::TestFTrace()
 {
     m_tempFile.open();
     qputenv("KWIN_PERF_FTRACE_FILE", m_tempFile.fileName().toLatin1());
+    m_rawTempFile.open();
+    qputenv("KWIN_PERF_FTRACE_RAW_FILE", m_rawTempFile.fileName().toLatin1());
 
     KWin::FTraceLogger::create();
 }
@@ -50,6 +59,13 @@ void TestFTrace::benchmarkTraceDurationOff()
     }
 }
 
+void TestFTrace::benchmarkTraceEventOff()
+{
+    QBENCHMARK {
+        fTraceEvent("BENCH");
+    }
+}
+
 void TestFTrace::enable()
 {
     KWin::FTraceLogger::self()->setEnabled(true);
@@ -67,6 +83,81 @@ void TestFTrace::enable()
     QCOMPARE(m_tempFile.readLine(), "TEST_DURATIONboo end_ctx=1\n");
 }
 
+void TestFTrace::binaryEvents()
+{
+    QVERIFY(KWin::FTraceLogger::self()->isBinaryEnabled());
+
+    fTraceEvent("TEST_EVENT");
+    {
+        fTraceScope("TEST_SCOPE");
+    }
+    KWin::FTraceLogger::self()->flushEvents();
+
+    using Record = KWin::FTraceLogger::FTraceRecord;
+    QHash<QByteArray, quint32> eventIds;
+    QVector<Record> records;
+    while (m_rawTempFile.bytesAvailable() >= qint64(sizeof(Record))) {
+        Record record;
+        m_rawTempFile.read(reinterpret_cast<char *>(&record), sizeof(record));
+        if (record.eventId == 0) {
+            // The names of the events are announced before they are used
+            eventIds.insert(m_rawTempFile.read(record.context), record.phase);
+        } else {
+            records.append(record);
+        }
+    }
+    QVERIFY(eventIds.contains("TEST_EVENT"));
+    QVERIFY(eventIds.contains("TEST_SCOPE"));
+    QCOMPARE(records.count(), 3);
+
+    const quint32 eventId = eventIds["TEST_EVENT"];
+    const quint32 scopeId = eventIds["TEST_SCOPE"];
+    const Record event = records[0];
+    QCOMPARE(event.eventId, eventId);
+    QCOMPARE(event.phase, quint32(KWin::FTraceLogger::Instant));
+
+    const Record begin = records[1];
+    const Record end = records[2];
+    QCOMPARE(begin.eventId, scopeId);
+    QCOMPARE(begin.phase, quint32(KWin::FTraceLogger::Begin));
+    QCOMPARE(end.eventId, scopeId);
+    QCOMPARE(end.phase, quint32(KWin::FTraceLogger::End));
+    QCOMPARE(begin.context, end.context);
+    QCOMPARE(begin.threadId, event.threadId);
+    QVERIFY(event.timestamp <= begin.timestamp);
+    QVERIFY(begin.timestamp <= end.timestamp);
+}
+
+void TestFTrace::benchmarkTraceOn()
+{
+    QBENCHMARK {
+        fTrace("BENCH", 123, "foo");
+    }
+}
+
+void TestFTrace::benchmarkTraceDurationOn()
+{
+    QBENCHMARK {
+        fTraceDuration("BENCH", 123, "foo");
+    }
+}
+
+void TestFTrace::benchmarkTraceEventOn()
+{
+    QBENCHMARK {
+        fTraceEvent("BENCH");
+    }
+    KWin::FTraceLogger::self()->flushEvents();
+}
+
+void TestFTrace::benchmarkTraceScopeOn()
+{
+    QBENCHMARK {
+        fTraceScope("BENCH_SCOPE");
+    }
+    KWin::FTraceLogger::self()->flushEvents();
+}
+
 QTEST_MAIN(TestFTrace)
 
 #include "test_ftrace.moc"
@@ -0,0 +1,167 @@
+/*
+    KWin - the KDE window manager
+    This file is part of the KDE project.
+
+    SPDX-FileCopyrightText: 2006 Lubos Lunak <l.lunak@kde.org>
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#include <QTest>
+
+#include "occlusionculler.h"
+
+#include <cmath>
+
+using namespace KWin;
+
+Q_DECLARE_METATYPE(QVector<QRegion>)
+
+static const QRect s_screen(0, 0, 1920, 1080);
+
+// Returns the region of a window with rounded corners, as clients that draw their own
+// decoration report it. Each row of the corners adds rectangles to the region.
+static QRegion roundedRect(const QRect &rect, int radius)
+{
+    QRegion region(rect.adjusted(0, radius, 0, -radius));
+    for (int y = 0; y < radius; ++y) {
+        const qreal dy = radius - y - 0.5;
+        const int inset = radius - std::round(std::sqrt(radius * radius - dy * dy));
+        const QRect row(rect.x() + inset, 0, rect.width() - 2 * inset, 1);
+        region += row.translated(0, rect.top() + y);
+        region += row.translated(0, rect.bottom() - y);
+    }
+    return region;
+}
+
+// Returns the opaque regions of the windows from top to bottom.
+static QVector<QRegion> cascadedWindows(int count)
+{
+    QVector<QRegion> windows;
+    for (int i = 0; i < count; ++i) {
+        const QPoint position((i * 37) % 900, (i * 23) % 380);
+        windows.append(roundedRect(QRect(position, QSize(1000, 700)), 8));
+    }
+    return windows;
+}
+
+class TestOcclusionCuller : public QObject
+{
+    Q_OBJECT
+private Q_SLOTS:
+    void testEmpty();
+    void testVisible();
+    void testCovered();
+    void testSimplified();
+
+    void benchmarkCulling_data();
+    void benchmarkCulling();
+};
+
+void TestOcclusionCuller::testEmpty()
+{
+    OcclusionCuller culler(s_screen);
+    QVERIFY(!culler.isCovered());
+    QVERIFY(culler.occluded().isEmpty());
+    QCOMPARE(culler.visible(QRect(10, 10, 100, 100)), QRegion(10, 10, 100, 100));
+}
+
+void TestOcclusionCuller::testVisible()
+{
+    OcclusionCuller culler(s_screen);
+    culler.addOccluder(QRect(0, 0, 960, 1080));
+    QVERIFY(!culler.isCovered());
+    QCOMPARE(culler.occluded(), QRegion(0, 0, 960, 1080));
+    QCOMPARE(culler.visible(QRect(900, 0, 100, 100)), QRegion(960, 0, 40, 100));
+    QVERIFY(culler.visible(QRect(0, 0, 100, 100)).isEmpty());
+}
+
+void TestOcclusionCuller::testCovered()
+{
+    OcclusionCuller culler(s_screen);
+    culler.addOccluder(QRect(0, 0, 960, 1080));
+    culler.addOccluder(QRect(960, 0, 960, 1080));
+    QVERIFY(culler.isCovered());
+    QVERIFY(culler.visible(QRect(-100, -100, 4000, 4000)).isEmpty());
+
+    // Occluders below a covered area don't matter anymore.
+    culler.addOccluder(QRect(-100, -100, 50, 50));
+    QCOMPARE(culler.occluded(), QRegion(s_screen));
+}
+
+void TestOcclusionCuller::testSimplified()
+{
+    const QRegion simple = QRegion(0, 0, 100, 100) + QRegion(200, 0, 100, 100);
+    QCOMPARE(OcclusionCuller::simplified(simple), simple);
+
+    const QRegion rounded = roundedRect(QRect(100, 100, 800, 600), 12);
+    QVERIFY(rounded.rectCount() > 16);
+
+    const QRegion simplified = OcclusionCuller::simplified(rounded);
+    QVERIFY(simplified.rectCount() <= 16);
+    QVERIFY((simplified - rounded).isEmpty());
+    // The middle of the window must still be occluded.
+    QVERIFY(simplified.contains(QRect(100, 112, 800, 576)));
+}
+
+void TestOcclusionCuller::benchmarkCulling_data()
+{
+    QTest::addColumn<QVector<QRegion>>("windows");
+    QTest::addColumn<bool>("culler");
+
+    const QVector<QRegion> cascaded = cascadedWindows(80);
+
+    QVector<QRegion> maximized = cascaded;
+    maximized.prepend(s_screen);
+
+    QVector<QRegion> tiled = cascadedWindows(76);
+    tiled.prepend(roundedRect(QRect(960, 540, 960, 540), 8));
+    tiled.prepend(roundedRect(QRect(0, 540, 960, 540), 8));
+    tiled.prepend(roundedRect(QRect(960, 0, 960, 540), 8));
+    tiled.prepend(roundedRect(QRect(0, 0, 960, 540), 8));
+
+    QTest::newRow("cascaded/QRegion") << cascaded << false;
+    QTest::newRow("cascaded/OcclusionCuller") << cascaded << true;
+    QTest::newRow("tiled/QRegion") << tiled << false;
+    QTest::newRow("tiled/OcclusionCuller") << tiled << true;
+    QTest::newRow("maximized/QRegion") << maximized << false;
+    QTest::newRow("maximized/OcclusionCuller") << maximized << true;
+}
+
+void TestOcclusionCuller::benchmarkCulling()
+{
+    // This benchmark runs the occlusion pass of a full repaint, once with plain region
+    // arithmetic and once with the occlusion culler and simplified clips. The scene caches
+    // the simplified clip of each window, so simplifying is not part of the measurement.
+    QFETCH(QVector<QRegion>, windows);
+    QFETCH(bool, culler);
+
+    const QRegion screen(s_screen);
+
+    if (culler) {
+        QVector<QRegion> clips;
+        for (const QRegion &window : qAsConst(windows)) {
+            clips.append(OcclusionCuller::simplified(window));
+        }
+        QBENCHMARK {
+            OcclusionCuller occlusion(screen);
+            for (const QRegion &clip : qAsConst(clips)) {
+                const QRegion region = occlusion.visible(screen);
+                occlusion.addOccluder(clip);
+                Q_UNUSED(region)
+            }
+        }
+    } else {
+        QBENCHMARK {
+            QRegion allclips;
+            for (const QRegion &clip : qAsConst(windows)) {
+                const QRegion region = screen - allclips;
+                allclips |= clip;
+                Q_UNUSED(region)
+            }
+        }
+    }
+}
+
+QTEST_GUILESS_MAIN(TestOcclusionCuller)
+#include "test_occlusionculler.moc"
@@ -0,0 +1,87 @@
+/*
+    SPDX-FileCopyrightText: 2020 Vlad Zahorodnii <vlad.zahorodnii@kde.org>
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#include <QTest>
+
+#include "renderjournal.h"
+
+using namespace KWin;
+using namespace std::chrono_literals;
+
+class TestRenderJournal : public QObject
+{
+    Q_OBJECT
+private Q_SLOTS:
+    void testEmpty();
+    void testGpuTime();
+    void testPercentile();
+    void testStages();
+};
+
+void TestRenderJournal::testEmpty()
+{
+    RenderJournal journal;
+    QCOMPARE(journal.minimum(), 0ns);
+    QCOMPARE(journal.maximum(), 0ns);
+    QCOMPARE(journal.average(), 0ns);
+    QCOMPARE(journal.percentile(0.95), 0ns);
+}
+
+void TestRenderJournal::testGpuTime()
+{
+    // Without any frames on the CPU side, the estimates are the gpu times only.
+    RenderJournal journal;
+    journal.addGpuTime(2ms);
+    journal.addGpuTime(4ms);
+    journal.addGpuTime(6ms);
+    QCOMPARE(journal.minimum(), 2ms);
+    QCOMPARE(journal.maximum(), 6ms);
+    QCOMPARE(journal.average(), 4ms);
+}
+
+void TestRenderJournal::testPercentile()
+{
+    RenderJournal journal;
+    for (int i = 1; i <= 100; ++i) {
+        journal.addGpuTime(std::chrono::milliseconds(i));
+    }
+    QCOMPARE(journal.percentile(0.95), 95ms);
+    QCOMPARE(journal.percentile(1.0), 100ms);
+
+    // The minimum, maximum and average estimators only look at the most recent frames.
+    QCOMPARE(journal.minimum(), 86ms);
+    QCOMPARE(journal.maximum(), 100ms);
+
+    // A single slow frame must not dominate the percentile estimate.
+    journal.addGpuTime(1000ms);
+    QCOMPARE(journal.maximum(), 1000ms);
+    QVERIFY(journal.percentile(0.95) < 100ms);
+}
+
+void TestRenderJournal::testStages()
+{
+    RenderJournal journal;
+    journal.beginFrame();
+    journal.beginStage(RenderJournal::Stage::EffectsPrePaint);
+    journal.beginStage(RenderJournal::Stage::ScenePaint);
+    QTest::qSleep(5);
+    journal.endFrame();
+
+    // Presenting the frame is timed, but it doesn't count towards the render time.
+    journal.beginStage(RenderJournal::Stage::BackendPresent);
+    QTest::qSleep(50);
+    journal.endStage();
+
+    QVERIFY(journal.stageAverage(RenderJournal::Stage::ScenePaint) >= 5ms);
+    QVERIFY(journal.stageAverage(RenderJournal::Stage::EffectsPrePaint) < journal.stageAverage(RenderJournal::Stage::ScenePaint));
+    QVERIFY(journal.maximum() >= journal.stageAverage(RenderJournal::Stage::ScenePaint));
+    QVERIFY(journal.stageAverage(RenderJournal::Stage::BackendPresent) >= 50ms);
+    QVERIFY(journal.maximum() < journal.stageAverage(RenderJournal::Stage::BackendPresent));
+}
+
+QTEST_GUILESS_MAIN(TestRenderJournal)
+
+#include "test_renderjournal.moc"
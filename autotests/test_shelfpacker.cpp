@@ -0,0 +1,124 @@
+/*
+    KWin - the KDE window manager
+    This file is part of the KDE project.
+
+    SPDX-FileCopyrightText: 2006 Lubos Lunak <l.lunak@kde.org>
+    SPDX-FileCopyrightText: 2009, 2010, 2011 Martin Gräßlin <mgraesslin@kde.org>
+    SPDX-FileCopyrightText: 2019 Vlad Zahorodnii <vlad.zahorodnii@kde.org>
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#include <QTest>
+
+#include "scenes/opengl/decorationatlas.h"
+
+using namespace KWin;
+
+class TestShelfPacker : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void testReuseShelf();
+    void testMergeSpans();
+    void testDropTrailingShelves();
+    void testFull();
+};
+
+void TestShelfPacker::testReuseShelf()
+{
+    ShelfPacker packer(QSize(256, 64));
+
+    QCOMPARE(packer.allocate(QSize(40, 20)), QRect(0, 0, 40, 20));
+
+    // A slightly lower rectangle goes on the existing shelf.
+    QCOMPARE(packer.allocate(QSize(30, 16)), QRect(40, 0, 30, 16));
+
+    // The shelf is more than one and a half times higher than this rectangle.
+    QCOMPARE(packer.allocate(QSize(30, 10)), QRect(0, 20, 30, 10));
+
+    // A rectangle that doesn't fit in the free space of a shelf starts a new one.
+    QCOMPARE(packer.allocate(QSize(200, 20)), QRect(0, 30, 200, 20));
+
+    // Of two suitable shelves, the lower one wastes less space.
+    ShelfPacker other(QSize(256, 64));
+    const QRect full = other.allocate(QSize(256, 20));
+    QCOMPARE(full, QRect(0, 0, 256, 20));
+    QCOMPARE(other.allocate(QSize(40, 16)), QRect(0, 20, 40, 16));
+    other.release(full);
+    QCOMPARE(other.allocate(QSize(30, 14)), QRect(40, 20, 30, 14));
+}
+
+void TestShelfPacker::testMergeSpans()
+{
+    ShelfPacker packer(QSize(100, 64));
+
+    const QRect a = packer.allocate(QSize(30, 10));
+    const QRect b = packer.allocate(QSize(30, 10));
+    const QRect c = packer.allocate(QSize(30, 10));
+    QCOMPARE(a, QRect(0, 0, 30, 10));
+    QCOMPARE(b, QRect(30, 0, 30, 10));
+    QCOMPARE(c, QRect(60, 0, 30, 10));
+    QCOMPARE(packer.allocate(QSize(10, 10)), QRect(90, 0, 10, 10));
+
+    // Keep the first shelf from being the last one.
+    QCOMPARE(packer.allocate(QSize(100, 20)), QRect(0, 10, 100, 20));
+
+    packer.release(a);
+    packer.release(c);
+    QCOMPARE(packer.allocate(QSize(40, 10)), QRect(0, 30, 40, 10));
+
+    // Releasing the rectangle in the middle joins all three spans.
+    packer.release(b);
+    QCOMPARE(packer.allocate(QSize(90, 10)), QRect(0, 0, 90, 10));
+}
+
+void TestShelfPacker::testDropTrailingShelves()
+{
+    ShelfPacker packer(QSize(100, 64));
+
+    const QRect a = packer.allocate(QSize(50, 10));
+    const QRect b = packer.allocate(QSize(50, 20));
+    QCOMPARE(a, QRect(0, 0, 50, 10));
+    QCOMPARE(b, QRect(0, 10, 50, 20));
+
+    // The second shelf is empty after the release, so a rectangle of a different height
+    // can take its place.
+    packer.release(b);
+    QCOMPARE(packer.allocate(QSize(50, 40)), QRect(0, 10, 50, 40));
+
+    ShelfPacker other(QSize(100, 64));
+    const QRect c = other.allocate(QSize(100, 10));
+    const QRect d = other.allocate(QSize(100, 10));
+    QCOMPARE(c, QRect(0, 0, 100, 10));
+    QCOMPARE(d, QRect(0, 10, 100, 10));
+
+    // The first shelf isn't dropped while a used shelf follows it.
+    other.release(c);
+    QCOMPARE(other.allocate(QSize(100, 64)), QRect());
+
+    // Once the last shelf is empty too, both shelves are dropped.
+    other.release(d);
+    QCOMPARE(other.allocate(QSize(100, 64)), QRect(0, 0, 100, 64));
+}
+
+void TestShelfPacker::testFull()
+{
+    ShelfPacker packer(QSize(100, 32));
+    QCOMPARE(packer.size(), QSize(100, 32));
+
+    QCOMPARE(packer.allocate(QSize(101, 10)), QRect());
+    QCOMPARE(packer.allocate(QSize(0, 10)), QRect());
+
+    QCOMPARE(packer.allocate(QSize(100, 20)), QRect(0, 0, 100, 20));
+    QCOMPARE(packer.allocate(QSize(100, 20)), QRect());
+    QCOMPARE(packer.allocate(QSize(10, 13)), QRect());
+
+    packer.setHeight(64);
+    QCOMPARE(packer.size(), QSize(100, 64));
+    QCOMPARE(packer.allocate(QSize(100, 20)), QRect(0, 20, 100, 20));
+}
+
+QTEST_GUILESS_MAIN(TestShelfPacker)
+#include "test_shelfpacker.moc"
@@ -136,6 +136,7 @@ Connection::Connection(Context *input, QObject *parent)
 
 Connection::~Connection()
 {
+    qDeleteAll(m_pendingEvents);
     delete s_adaptor;
     s_adaptor = nullptr;
     s_self = nullptr;
@@ -179,21 +180,40 @@ void Connection::deactivate()
 
 void Connection::handleEvent()
 {
-    QMutexLocker locker(&m_mutex);
-    const bool wasEmpty = m_eventQueue.isEmpty();
+    bool pushed = flushPendingEvents();
     do {
         m_input->dispatch();
         Event *event = m_input->event();
         if (!event) {
             break;
         }
-        m_eventQueue << event;
+        if (m_pendingEvents.isEmpty() && m_eventQueue.push(event)) {
+            pushed = true;
+        } else {
+            m_pendingEvents << event;
+        }
     } while (true);
-    if (wasEmpty && !m_eventQueue.isEmpty()) {
+    if (!m_pendingEvents.isEmpty()) {
+        // The main thread fell behind. It calls handleEvent() again after draining the queue,
+        // retry once in case it has already done so before it could see the flag.
+        m_eventQueueOverflowed = true;
+        pushed |= flushPendingEvents();
+    }
+    if (pushed && !m_eventsReadPending.exchange(true)) {
         Q_EMIT eventsRead();
     }
 }
 
+bool Connection::flushPendingEvents()
+{
+    int count = 0;
+    while (count < m_pendingEvents.count() && m_eventQueue.push(m_pendingEvents.at(count))) {
+        ++count;
+    }
+    m_pendingEvents.remove(0, count);
+    return count > 0;
+}
+
 #ifndef KWIN_BUILD_TESTING
 QPointF devicePointToGlobalPosition(const QPointF &devicePos, const AbstractWaylandOutput *output)
 {
@@ -281,11 +301,13 @@ KWin::TabletToolId createTabletId(libinput_tablet_tool *tool, void *userData)
 
 void Connection::processEvents()
 {
-    QMutexLocker locker(&m_mutex);
-    while (!m_eventQueue.isEmpty()) {
-        QScopedPointer<Event> event(m_eventQueue.takeFirst());
+    // events pushed from now on need another eventsRead() notification
+    m_eventsReadPending = false;
+    while (Event *nextEvent = m_eventQueue.take()) {
+        QScopedPointer<Event> event(nextEvent);
         switch (event->type()) {
             case LIBINPUT_EVENT_DEVICE_ADDED: {
+                QMutexLocker locker(&m_mutex);
                 auto device = new Device(event->nativeDevice());
                 device->moveToThread(thread());
                 m_devices << device;
@@ -297,6 +319,7 @@ void Connection::processEvents()
                 break;
             }
             case LIBINPUT_EVENT_DEVICE_REMOVED: {
+                QMutexLocker locker(&m_mutex);
                 auto it = std::find_if(m_devices.begin(), m_devices.end(), [&event] (Device *d) { return event->device() == d; } );
                 if (it == m_devices.end()) {
                     // we don't know this device
@@ -333,18 +356,16 @@ void Connection::processEvents()
                 auto deltaNonAccel = pe->deltaUnaccelerated();
                 quint32 latestTime = pe->time();
                 quint64 latestTimeUsec = pe->timeMicroseconds();
-                auto it = m_eventQueue.begin();
-                while (it != m_eventQueue.end()) {
-                    if ((*it)->type() == LIBINPUT_EVENT_POINTER_MOTION) {
-                        QScopedPointer<PointerEvent> p(static_cast<PointerEvent*>(*it));
-                        delta += p->delta();
-                        deltaNonAccel += p->deltaUnaccelerated();
-                        latestTime = p->time();
-                        latestTimeUsec = p->timeMicroseconds();
-                        it = m_eventQueue.erase(it);
-                    } else {
+                // coalesce the relative motion events the main thread fell behind on
+                while (Event *next = m_eventQueue.peek()) {
+                    if (next->type() != LIBINPUT_EVENT_POINTER_MOTION) {
                         break;
                     }
+                    QScopedPointer<PointerEvent> p(static_cast<PointerEvent*>(m_eventQueue.take()));
+                    delta += p->delta();
+                    deltaNonAccel += p->deltaUnaccelerated();
+                    latestTime = p->time();
+                    latestTimeUsec = p->timeMicroseconds();
                 }
                 Q_EMIT pe->device()->pointerMotion(delta, deltaNonAccel, latestTime, latestTimeUsec, pe->device());
                 break;
@@ -527,6 +548,9 @@ void Connection::processEvents()
                 break;
         }
     }
+    if (m_eventQueueOverflowed.exchange(false)) {
+        QMetaObject::invokeMethod(this, &Connection::handleEvent, Qt::QueuedConnection);
+    }
 }
 
 void Connection::updateScreens()
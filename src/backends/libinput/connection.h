@@ -11,6 +11,8 @@
 
 #include <kwinglobals.h>
 
+#include "eventqueue.h"
+
 #include <KSharedConfig>
 
 #include <QObject>
@@ -63,12 +65,18 @@ private Q_SLOTS:
 private:
     Connection(Context *input, QObject *parent = nullptr);
     void handleEvent();
+    bool flushPendingEvents();
     void applyDeviceConfig(Device *device);
     void applyScreenToDevice(Device *device);
     Context *m_input;
     QSocketNotifier *m_notifier;
+    // Protects m_devices, which are accessed from both the libinput and the main thread
     QMutex m_mutex;
-    QVector<Event*> m_eventQueue;
+    EventQueue m_eventQueue;
+    // Events read while m_eventQueue was full, only accessed from the libinput thread
+    QVector<Event*> m_pendingEvents;
+    std::atomic<bool> m_eventQueueOverflowed{false};
+    std::atomic<bool> m_eventsReadPending{false};
     QVector<Device*> m_devices;
     KSharedConfigPtr m_config;
 
@@ -0,0 +1,81 @@
+/*
+    KWin - the KDE window manager
+    This file is part of the KDE project.
+
+    SPDX-FileCopyrightText: 2014 Martin Gräßlin <mgraesslin@kde.org>
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+#include "eventqueue.h"
+#include "events.h"
+
+namespace KWin
+{
+namespace LibInput
+{
+
+static quint64 roundUpToPowerOfTwo(int value)
+{
+    quint64 ret = 1;
+    while (ret < quint64(value)) {
+        ret <<= 1;
+    }
+    return ret;
+}
+
+EventQueue::EventQueue(int capacity)
+    : m_events(roundUpToPowerOfTwo(capacity), nullptr)
+    , m_mask(m_events.size() - 1)
+{
+}
+
+EventQueue::~EventQueue()
+{
+    while (Event *event = take()) {
+        delete event;
+    }
+}
+
+bool EventQueue::push(Event *event)
+{
+    const quint64 tail = m_tail.load(std::memory_order_relaxed);
+    if (tail - m_head.load(std::memory_order_acquire) == m_events.size()) {
+        return false;
+    }
+    m_events[tail & m_mask] = event;
+    m_tail.store(tail + 1, std::memory_order_release);
+    return true;
+}
+
+Event *EventQueue::peek(int offset) const
+{
+    const quint64 head = m_head.load(std::memory_order_relaxed);
+    if (m_tail.load(std::memory_order_acquire) - head <= quint64(offset)) {
+        return nullptr;
+    }
+    return m_events[(head + offset) & m_mask];
+}
+
+Event *EventQueue::take()
+{
+    const quint64 head = m_head.load(std::memory_order_relaxed);
+    if (m_tail.load(std::memory_order_acquire) == head) {
+        return nullptr;
+    }
+    Event *event = m_events[head & m_mask];
+    m_head.store(head + 1, std::memory_order_release);
+    return event;
+}
+
+bool EventQueue::isEmpty() const
+{
+    return m_tail.load(std::memory_order_acquire) == m_head.load(std::memory_order_acquire);
+}
+
+int EventQueue::capacity() const
+{
+    return m_events.size();
+}
+
+}
+}
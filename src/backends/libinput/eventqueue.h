@@ -0,0 +1,79 @@
+/*
+    KWin - the KDE window manager
+    This file is part of the KDE project.
+
+    SPDX-FileCopyrightText: 2014 Martin Gräßlin <mgraesslin@kde.org>
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+#ifndef KWIN_LIBINPUT_EVENTQUEUE_H
+#define KWIN_LIBINPUT_EVENTQUEUE_H
+
+#include <kwinglobals.h>
+
+#include <atomic>
+#include <vector>
+
+namespace KWin
+{
+namespace LibInput
+{
+
+class Event;
+
+/**
+ * Bounded lock-free queue for passing events from the libinput thread to the main thread.
+ *
+ * There must be exactly one producer thread calling push() and exactly one consumer
+ * thread calling peek() and take(). Neither side ever blocks or allocates memory.
+ */
+class KWIN_EXPORT EventQueue
+{
+public:
+    /**
+     * Creates a queue which can hold at least @p capacity events. The capacity is rounded
+     * up to the next power of two.
+     */
+    explicit EventQueue(int capacity = 4096);
+    ~EventQueue();
+
+    /**
+     * Appends the @p event to the queue. Returns @c false if the queue is full, in which
+     * case the ownership of @p event stays with the caller.
+     *
+     * Must only be called from the producer thread.
+     */
+    bool push(Event *event);
+
+    /**
+     * Returns the oldest event in the queue without removing it, or @c null if the queue is
+     * empty. If @p offset is given, the event at that position behind the oldest one is returned.
+     *
+     * Must only be called from the consumer thread.
+     */
+    Event *peek(int offset = 0) const;
+
+    /**
+     * Removes and returns the oldest event in the queue, or @c null if the queue is empty.
+     * The caller takes the ownership of the event.
+     *
+     * Must only be called from the consumer thread.
+     */
+    Event *take();
+
+    bool isEmpty() const;
+    int capacity() const;
+
+private:
+    std::vector<Event *> m_events;
+    const quint64 m_mask;
+    // Written by the producer only
+    alignas(64) std::atomic<quint64> m_tail{0};
+    // Written by the consumer only
+    alignas(64) std::atomic<quint64> m_head{0};
+};
+
+}
+}
+
+#endif
@@ -48,4 +48,9 @@ void LibinputBackend::initialize()
     m_connection->setup();
 }
 
+void LibinputBackend::processPendingEvents()
+{
+    m_connection->processEvents();
+}
+
 } // namespace KWin
@@ -27,6 +27,7 @@ public:
     ~LibinputBackend() override;
 
     void initialize() override;
+    void processPendingEvents() override;
 
 private:
     QThread *m_thread = nullptr;
@@ -14,6 +14,7 @@
 #include "deleted.h"
 #include "effects.h"
 #include "ftrace.h"
+#include "input.h"
 #include "internal_client.h"
 #include "openglbackend.h"
 #include "overlaywindow.h"
@@ -42,13 +43,16 @@
 #include <KGlobalAccel>
 #include <KLocalizedString>
 #include <KNotification>
+#include <KScreenLocker/KsldApp>
 #include <KSelectionOwner>
 
 #include <QDateTime>
 #include <QFutureWatcher>
 #include <QMenu>
 #include <QOpenGLContext>
+#include <QPointer>
 #include <QQuickWindow>
+#include <QSet>
 #include <QtConcurrentRun>
 #include <QTextStream>
 #include <QTimerEvent>
@@ -351,6 +355,13 @@ void Compositor::startupWithWorkspace()
             this, &Compositor::cleanupX11, Qt::UniqueConnection);
     initializeX11();
 
+    connect(Workspace::self(), &Workspace::xStackingOrderChanged,
+            this, &Compositor::invalidateWindowsToRender, Qt::UniqueConnection);
+    if (waylandServer() && waylandServer()->hasScreenLockerIntegration()) {
+        connect(ScreenLocker::KSldApp::self(), &ScreenLocker::KSldApp::lockStateChanged,
+                this, &Compositor::invalidateWindowsToRender, Qt::UniqueConnection);
+    }
+
     Workspace::self()->markXStackingOrderAsDirty();
     Q_ASSERT(m_scene);
     m_scene->initialize();
@@ -448,6 +459,9 @@ void Compositor::stop()
     delete effects;
     effects = nullptr;
 
+    m_windowsToRender.clear();
+    invalidateWindowsToRender();
+
     if (Workspace::self()) {
         for (X11Client *c : Workspace::self()->clientList()) {
             m_scene->removeToplevel(c);
@@ -586,16 +600,29 @@ void Compositor::handleFrameRequested(RenderLoop *renderLoop)
 }
 
 QList<Toplevel *> Compositor::windowsToRender() const
+{
+    if (m_windowsToRenderDirty) {
+        updateWindowsToRender();
+    }
+    return m_windowsToRender;
+}
+
+void Compositor::invalidateWindowsToRender()
+{
+    m_windowsToRenderDirty = true;
+}
+
+void Compositor::updateWindowsToRender() const
 {
     // Create a list of all windows in the stacking order
-    QList<Toplevel *> windows = Workspace::self()->xStackingOrder();
+    const QList<Toplevel *> stacking = Workspace::self()->xStackingOrder();
 
-    // Move elevated windows to the top of the stacking order
+    // Elevated windows are moved to the top of the stacking order
     const QList<EffectWindow *> elevatedList = static_cast<EffectsHandlerImpl *>(effects)->elevatedWindows();
+    QSet<Toplevel *> elevated;
+    elevated.reserve(elevatedList.count());
     for (EffectWindow *c : elevatedList) {
-        Toplevel *t = static_cast<EffectWindowImpl *>(c)->window();
-        windows.removeAll(t);
-        windows.append(t);
+        elevated.insert(static_cast<EffectWindowImpl *>(c)->window());
     }
 
     // Skip windows that are not yet ready for being painted and if screen is locked skip windows
@@ -604,24 +631,47 @@ QList<Toplevel *> Compositor::windowsToRender() const
     // TODO? This cannot be used so carelessly - needs protections against broken clients, the
     // window should not get focus before it's displayed, handle unredirected windows properly and
     // so on.
-    for (Toplevel *win : windows) {
+    const bool screenLocked = waylandServer() && waylandServer()->isScreenLocked();
+    auto isRenderable = [screenLocked](Toplevel *win) {
         if (!win->readyForPainting()) {
-            windows.removeAll(win);
+            return false;
         }
-        if (waylandServer() && waylandServer()->isScreenLocked()) {
-            if(!win->isLockScreen() && !win->isInputMethod()) {
-                windows.removeAll(win);
-            }
+        return !screenLocked || win->isLockScreen() || win->isInputMethod();
+    };
+
+    m_windowsToRender.clear();
+    m_windowsToRender.reserve(stacking.count() + elevated.count());
+    for (Toplevel *win : stacking) {
+        if (!elevated.contains(win) && isRenderable(win)) {
+            m_windowsToRender.append(win);
         }
     }
-    return windows;
+    for (EffectWindow *c : elevatedList) {
+        Toplevel *win = static_cast<EffectWindowImpl *>(c)->window();
+        if (isRenderable(win)) {
+            m_windowsToRender.append(win);
+        }
+    }
+    m_windowsToRenderDirty = false;
 }
 
 void Compositor::composite(RenderLoop *renderLoop)
 {
+    if (waylandServer() && input()) {
+        // The render loops of all outputs usually fire in the same event loop iteration, so
+        // input read while the other outputs were being painted would otherwise wait until
+        // all of them are done. Handling it now also gets it into this frame.
+        QPointer<RenderLoop> guard(renderLoop);
+        input()->processPendingEvents();
+        if (!guard || !m_scene || m_state != State::On || !m_renderLoops.contains(renderLoop)) {
+            return;
+        }
+    }
+
     const auto &output = m_renderLoops[renderLoop];
 
     fTraceDuration("Paint (", output ? output->name() : QStringLiteral("screens"), ")");
+    fTraceScope("composite");
 
     const auto windows = windowsToRender();
 
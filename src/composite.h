@@ -84,7 +84,17 @@ public:
     // for delayed supportproperty management of effects
     void keepSupportProperty(xcb_atom_t atom);
     void removeSupportProperty(xcb_atom_t atom);
+    /**
+     * Returns the windows that are going to be painted, in stacking order. The list is
+     * cached between frames and shared by all outputs until invalidateWindowsToRender()
+     * is called.
+     */
     QList<Toplevel *> windowsToRender() const;
+    /**
+     * Marks the list returned by windowsToRender() as outdated, e.g. because the stacking
+     * order has changed or a window has become ready for painting.
+     */
+    void invalidateWindowsToRender();
 
 Q_SIGNALS:
     void compositingToggled(bool active);
@@ -135,6 +145,8 @@ private:
     bool attemptOpenGLCompositing();
     bool attemptQPainterCompositing();
 
+    void updateWindowsToRender() const;
+
     State m_state;
 
     CompositorSelectionOwner *m_selectionOwner;
@@ -144,6 +156,8 @@ private:
     Scene *m_scene;
     RenderBackend *m_backend = nullptr;
     QMap<RenderLoop *, AbstractOutput *> m_renderLoops;
+    mutable QList<Toplevel *> m_windowsToRender;
+    mutable bool m_windowsToRenderDirty = true;
 };
 
 class KWIN_EXPORT WaylandCompositor final : public Compositor
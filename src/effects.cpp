@@ -1085,6 +1085,7 @@ void EffectsHandlerImpl::setElevatedWindow(KWin::EffectWindow* w, bool set)
     elevated_windows.removeAll(w);
     if (set)
         elevated_windows.append(w);
+    m_compositor->invalidateWindowsToRender();
 }
 
 void EffectsHandlerImpl::setTabBoxWindow(EffectWindow* w)
@@ -53,6 +53,7 @@ BlurEffect::BlurEffect()
     connect(effects, &EffectsHandler::windowDeleted, this, &BlurEffect::slotWindowDeleted);
     connect(effects, &EffectsHandler::propertyNotify, this, &BlurEffect::slotPropertyNotify);
     connect(effects, &EffectsHandler::virtualScreenGeometryChanged, this, &BlurEffect::slotScreenGeometryChanged);
+    connect(effects, &EffectsHandler::screenRemoved, this, &BlurEffect::slotScreenRemoved);
     connect(effects, &EffectsHandler::xcbConnectionChanged, this,
         [this] {
             if (m_shader && m_shader->isValid() && m_renderTargetsValid) {
@@ -71,12 +72,27 @@ BlurEffect::BlurEffect()
 BlurEffect::~BlurEffect()
 {
     deleteFBOs();
+    deleteBlurCaches();
+}
+
+void BlurEffect::slotScreenRemoved(EffectScreen *screen)
+{
+    effects->makeOpenGLContextCurrent();
+    for (auto it = m_blurCaches.begin(); it != m_blurCaches.end();) {
+        delete it->take(screen);
+        if (it->isEmpty()) {
+            it = m_blurCaches.erase(it);
+        } else {
+            ++it;
+        }
+    }
 }
 
 void BlurEffect::slotScreenGeometryChanged()
 {
     effects->makeOpenGLContextCurrent();
     updateTexture();
+    deleteBlurCaches();
 
     // Fetch the blur regions for all windows
     const auto stackingOrder = effects->stackingOrder();
@@ -102,6 +118,80 @@ void BlurEffect::deleteFBOs()
     m_renderTextures.clear();
 }
 
+void BlurEffect::deleteBlurCaches()
+{
+    for (const auto &caches : qAsConst(m_blurCaches)) {
+        qDeleteAll(caches);
+    }
+    m_blurCaches.clear();
+}
+
+void BlurEffect::deleteBlurCaches(const EffectWindow *w)
+{
+    qDeleteAll(m_blurCaches.take(w));
+}
+
+void BlurEffect::deleteBlurCache(const EffectWindow *w)
+{
+    auto it = m_blurCaches.find(w);
+    if (it == m_blurCaches.end()) {
+        return;
+    }
+    delete it->take(m_currentScreen);
+    if (it->isEmpty()) {
+        m_blurCaches.erase(it);
+    }
+}
+
+BlurEffect::BlurCache *BlurEffect::findBlurCache(const EffectWindow *w) const
+{
+    auto it = m_blurCaches.constFind(w);
+    if (it == m_blurCaches.constEnd()) {
+        return nullptr;
+    }
+    return it->value(m_currentScreen);
+}
+
+BlurEffect::BlurCache *BlurEffect::blurCache(const EffectWindow *w, const QRegion &blurArea)
+{
+    const qreal scale = GLRenderTarget::virtualScreenScale();
+    const QSize size = blurArea.boundingRect().size() * scale;
+
+    BlurCache *cache = findBlurCache(w);
+    if (cache && cache->blurArea == blurArea && cache->scale == scale) {
+        return cache;
+    }
+    if (blurArea.isEmpty() || !GLRenderTarget::blitSupported()) {
+        deleteBlurCache(w);
+        return nullptr;
+    }
+
+    if (!cache) {
+        cache = new BlurCache;
+        m_blurCaches[w].insert(m_currentScreen, cache);
+    }
+    cache->blurArea = blurArea;
+    cache->valid = QRegion();
+    cache->scale = scale;
+    cache->recording = false;
+
+    if (!cache->texture || cache->texture->size() != size) {
+        cache->renderTarget.reset();
+        // The cache is blitted from and drawn to the framebuffer without any conversion,
+        // so it doesn't use an sRGB format even if the render targets do.
+        cache->texture.reset(new GLTexture(GL_RGBA8, size));
+        cache->texture->setFilter(GL_NEAREST);
+        cache->texture->setWrapMode(GL_CLAMP_TO_EDGE);
+        cache->renderTarget.reset(new GLRenderTarget(*cache->texture));
+        if (!cache->renderTarget->valid()) {
+            deleteBlurCache(w);
+            return nullptr;
+        }
+    }
+
+    return cache;
+}
+
 void BlurEffect::updateTexture()
 {
     deleteFBOs();
@@ -250,6 +340,7 @@ void BlurEffect::reconfigure(ReconfigureFlags flags)
     m_scalingFactor = qMax(1.0, QGuiApplication::primaryScreen()->logicalDotsPerInch() / 96.0);
 
     updateTexture();
+    deleteBlurCaches();
 
     if (!m_shader || !m_shader->isValid()) {
         effects->removeSupportProperty(s_blurAtomName, this);
@@ -326,6 +417,11 @@ void BlurEffect::slotWindowAdded(EffectWindow *w)
 
 void BlurEffect::slotWindowDeleted(EffectWindow *w)
 {
+    if (m_blurCaches.contains(w)) {
+        effects->makeOpenGLContextCurrent();
+        deleteBlurCaches(w);
+    }
+
     auto it = windowBlurChangedConnections.find(w);
     if (it == windowBlurChangedConnections.end()) {
         return;
@@ -477,10 +573,14 @@ void BlurEffect::uploadGeometry(GLVertexBuffer *vbo, const QRegion &blurRegion,
 
 void BlurEffect::prePaintScreen(ScreenPrePaintData &data, std::chrono::milliseconds presentTime)
 {
-    m_paintedArea = QRegion();
     m_currentBlur = QRegion();
+    m_currentScreen = data.screen;
 
     effects->prePaintScreen(data, presentTime);
+
+    // Repaints of the screen, e.g. where a window got minimized or closed, change the
+    // background of the blurred areas on top just like repaints of windows do.
+    m_paintedArea = data.paint;
 }
 
 void BlurEffect::prePaintWindow(EffectWindow* w, WindowPrePaintData& data, std::chrono::milliseconds presentTime)
@@ -489,10 +589,9 @@ void BlurEffect::prePaintWindow(EffectWindow* w, WindowPrePaintData& data, std::
 
     effects->prePaintWindow(w, data, presentTime);
 
-    if (!w->isPaintingEnabled()) {
-        return;
-    }
-    if (!m_shader || !m_shader->isValid()) {
+    if (!w->isPaintingEnabled() || !m_shader || !m_shader->isValid()) {
+        // Nothing tells us whether the background changes while the window is hidden.
+        deleteBlurCache(w);
         return;
     }
 
@@ -517,18 +616,43 @@ void BlurEffect::prePaintWindow(EffectWindow* w, WindowPrePaintData& data, std::
     const QRegion blurArea = blurRegion(w).translated(w->pos()) & screen;
     const QRegion expandedBlur = (w->isDock() ? blurArea : expand(blurArea)) & screen;
 
-    // if this window or a window underneath the blurred area is painted again we have to
-    // blur everything
-    if (m_paintedArea.intersects(expandedBlur) || data.paint.intersects(blurArea)) {
-        data.paint |= expandedBlur;
-        // we have to check again whether we do not damage a blurred area
-        // of a window
-        if (expandedBlur.intersects(m_currentBlur)) {
-            data.paint |= m_currentBlur;
-        }
+    // The blurred background is cached, so it has to be blurred again only if the window
+    // has moved or a window underneath the blurred area is painted again. Repaints of the
+    // window itself can reuse the cached background.
+    // Only the part of the blurred area on the output that is being painted is cached.
+    BlurCache *cache = nullptr;
+    if (data.mask & PAINT_WINDOW_TRANSFORMED) {
+        deleteBlurCache(w);
+    } else {
+        const QRect outputGeometry = m_currentScreen ? m_currentScreen->geometry() : screen;
+        cache = blurCache(w, blurRegion(w).translated(w->pos()) & outputGeometry);
+    }
+    if (cache && m_paintedArea.intersects(expandedBlur)) {
+        cache->valid -= blurArea;
     }
 
-    m_currentBlur |= expandedBlur;
+    if (cache && (blurArea - cache->valid).isEmpty()) {
+        // Repainting part of a cached blurred area gives exactly the same result as blurring
+        // everything, windows above don't have to repaint the whole area.
+        cache->recording = false;
+    } else {
+        // if this window or a window underneath the blurred area is painted again we have to
+        // blur everything
+        const bool repaint = m_paintedArea.intersects(expandedBlur) || data.paint.intersects(blurArea);
+        if (repaint) {
+            data.paint |= expandedBlur;
+            // we have to check again whether we do not damage a blurred area
+            // of a window
+            if (expandedBlur.intersects(m_currentBlur)) {
+                data.paint |= m_currentBlur;
+            }
+        }
+        if (cache) {
+            cache->recording = repaint;
+        }
+
+        m_currentBlur |= expandedBlur;
+    }
 
     m_paintedArea -= data.clip;
     m_paintedArea |= data.paint;
@@ -591,7 +715,20 @@ void BlurEffect::drawWindow(EffectWindow *w, int mask, const QRegion &region, Wi
         const bool transientForIsDock = (modal ? modal->isDock() : false);
 
         if (!shape.isEmpty()) {
-            doBlur(shape, screen, data.opacity(), data.screenProjectionMatrix(), w->isDock() || transientForIsDock, w->frameGeometry());
+            BlurCache *cache = (translated || scaled) ? nullptr : findBlurCache(w);
+            if (cache && (shape - cache->valid).isEmpty()) {
+                paintCachedBlur(cache, shape, data.opacity(), data.screenProjectionMatrix(), w->frameGeometry().topLeft());
+            } else {
+                // The cache holds the blurred background as it is drawn by a fully opaque window,
+                // it can be drawn with any opacity afterwards.
+                if (cache && (!cache->recording || data.opacity() < 1.0)) {
+                    cache = nullptr;
+                }
+                doBlur(shape, screen, data.opacity(), data.screenProjectionMatrix(), w->isDock() || transientForIsDock, w->frameGeometry(), cache);
+                if (cache) {
+                    cache->valid |= shape;
+                }
+            }
         }
     }
 
@@ -639,7 +776,67 @@ void BlurEffect::generateNoiseTexture()
     m_noiseTexture->setWrapMode(GL_REPEAT);
 }
 
-void BlurEffect::doBlur(const QRegion& shape, const QRect& screen, const float opacity, const QMatrix4x4 &screenProjection, bool isDock, QRect windowRect)
+static float blendOpacity(float opacity)
+{
+#if 1 // bow shape, always above y = x
+    float o = 1.0f-opacity;
+    o = 1.0f - o*o;
+#else // sigmoid shape, above y = x for x > 0.5, below y = x for x < 0.5
+    float o = 2.0f*opacity - 1.0f;
+    o = 0.5f + o / (1.0f + qAbs(o));
+#endif
+    return o;
+}
+
+void BlurEffect::paintCachedBlur(const BlurCache *cache, const QRegion &shape, const float opacity, const QMatrix4x4 &screenProjection, QPoint windowPosition)
+{
+    const QRect cacheRect = cache->blurArea.boundingRect();
+
+    // The cache has been blitted from the framebuffer, its rows are stored bottom to top.
+    QVector<float> vertices;
+    QVector<float> texCoords;
+    vertices.reserve(shape.rectCount() * 12);
+    texCoords.reserve(shape.rectCount() * 12);
+    for (const QRect &r : shape) {
+        const float x[] = { float(r.x() + r.width()), float(r.x()), float(r.x()), float(r.x()), float(r.x() + r.width()), float(r.x() + r.width()) };
+        const float y[] = { float(r.y()), float(r.y()), float(r.y() + r.height()), float(r.y() + r.height()), float(r.y() + r.height()), float(r.y()) };
+        for (int i = 0; i < 6; ++i) {
+            vertices << x[i] << y[i];
+            texCoords << (x[i] - cacheRect.x()) / cacheRect.width()
+                      << 1.0f - (y[i] - cacheRect.y()) / cacheRect.height();
+        }
+    }
+
+    GLVertexBuffer *vbo = GLVertexBuffer::streamingBuffer();
+    vbo->reset();
+    vbo->setData(vertices.count() / 2, 2, vertices.constData(), texCoords.constData());
+    vbo->bindArrays();
+
+    if (opacity < 1.0) {
+        glEnable(GL_BLEND);
+        glBlendColor(0, 0, 0, blendOpacity(opacity));
+        glBlendFunc(GL_CONSTANT_ALPHA, GL_ONE_MINUS_CONSTANT_ALPHA);
+    }
+
+    GLShader *shader = ShaderManager::instance()->pushShader(ShaderTrait::MapTexture);
+    shader->setUniform(GLShader::ModelViewProjectionMatrix, screenProjection);
+    cache->texture->bind();
+    vbo->draw(GL_TRIANGLES, 0, vertices.count() / 2);
+    cache->texture->unbind();
+    ShaderManager::instance()->popShader();
+
+    if (opacity < 1.0) {
+        glDisable(GL_BLEND);
+    }
+
+    if (m_noiseStrength > 0) {
+        applyNoise(vbo, 0, vertices.count() / 2, opacity, screenProjection, windowPosition);
+    }
+
+    vbo->unbindArrays();
+}
+
+void BlurEffect::doBlur(const QRegion& shape, const QRect& screen, const float opacity, const QMatrix4x4 &screenProjection, bool isDock, QRect windowRect, BlurCache *cache)
 {
     // Blur would not render correctly on a secondary monitor because of wrong coordinates
     // BUG: 393723
@@ -698,14 +895,7 @@ void BlurEffect::doBlur(const QRegion& shape, const QRect& screen, const float o
     // Modulate the blurred texture with the window opacity if the window isn't opaque
     if (opacity < 1.0) {
         glEnable(GL_BLEND);
-#if 1 // bow shape, always above y = x
-        float o = 1.0f-opacity;
-        o = 1.0f - o*o;
-#else // sigmoid shape, above y = x for x > 0.5, below y = x for x < 0.5
-        float o = 2.0f*opacity - 1.0f;
-        o = 0.5f + o / (1.0f + qAbs(o));
-#endif
-        glBlendColor(0, 0, 0, o);
+        glBlendColor(0, 0, 0, blendOpacity(opacity));
         glBlendFunc(GL_CONSTANT_ALPHA, GL_ONE_MINUS_CONSTANT_ALPHA);
     }
 
@@ -719,25 +909,16 @@ void BlurEffect::doBlur(const QRegion& shape, const QRect& screen, const float o
         glDisable(GL_BLEND);
     }
 
+    if (cache) {
+        // The noise is not cached, it is applied whenever the cache is drawn.
+        const QRect source = shape.boundingRect();
+        const QRect cacheRect = cache->blurArea.boundingRect();
+        cache->renderTarget->blitFromFramebuffer(source, QRect((source.topLeft() - cacheRect.topLeft()) * cache->scale,
+                                                               source.size() * cache->scale));
+    }
+
     if (m_noiseStrength > 0) {
-        // Apply an additive noise onto the blurred image.
-        // The noise is useful to mask banding artifacts, which often happens due to the smooth color transitions in the
-        // blurred image.
-        // The noise is applied in perceptual space (i.e. after glDisable(GL_FRAMEBUFFER_SRGB)). This practice is also
-        // seen in other application of noise synthesis (films, image codecs), and makes the noise less visible overall
-        // (reduces graininess).
-        glEnable(GL_BLEND);
-        if (opacity < 1.0) {
-            // We need to modulate the opacity of the noise as well; otherwise a thin layer would appear when applying
-            // effects like fade out.
-            // glBlendColor should have been set above.
-            glBlendFunc(GL_CONSTANT_ALPHA, GL_ONE);
-        } else {
-            // Add the shader's output directly to the pixels in framebuffer.
-            glBlendFunc(GL_ONE, GL_ONE);
-        }
-        applyNoise(vbo, blurRectCount * (m_downSampleIterations + 1), shape.rectCount() * 6, screenProjection, windowRect.topLeft());
-        glDisable(GL_BLEND);
+        applyNoise(vbo, blurRectCount * (m_downSampleIterations + 1), shape.rectCount() * 6, opacity, screenProjection, windowRect.topLeft());
     }
 
     vbo->unbindArrays();
@@ -758,8 +939,25 @@ void BlurEffect::upscaleRenderToScreen(GLVertexBuffer *vbo, int vboStart, int bl
     m_shader->unbind();
 }
 
-void BlurEffect::applyNoise(GLVertexBuffer *vbo, int vboStart, int blurRectCount, const QMatrix4x4 &screenProjection, QPoint windowPosition)
+void BlurEffect::applyNoise(GLVertexBuffer *vbo, int vboStart, int blurRectCount, const float opacity, const QMatrix4x4 &screenProjection, QPoint windowPosition)
 {
+    // Apply an additive noise onto the blurred image.
+    // The noise is useful to mask banding artifacts, which often happens due to the smooth color transitions in the
+    // blurred image.
+    // The noise is applied in perceptual space (i.e. after glDisable(GL_FRAMEBUFFER_SRGB)). This practice is also
+    // seen in other application of noise synthesis (films, image codecs), and makes the noise less visible overall
+    // (reduces graininess).
+    glEnable(GL_BLEND);
+    if (opacity < 1.0) {
+        // We need to modulate the opacity of the noise as well; otherwise a thin layer would appear when applying
+        // effects like fade out.
+        glBlendColor(0, 0, 0, blendOpacity(opacity));
+        glBlendFunc(GL_CONSTANT_ALPHA, GL_ONE);
+    } else {
+        // Add the shader's output directly to the pixels in framebuffer.
+        glBlendFunc(GL_ONE, GL_ONE);
+    }
+
     m_shader->bind(BlurShader::NoiseSampleType);
     m_shader->setTargetTextureSize(m_renderTextures[0].size() * GLRenderTarget::virtualScreenScale());
     m_shader->setNoiseTextureSize(m_noiseTexture->size() * GLRenderTarget::virtualScreenScale());
@@ -772,6 +970,8 @@ void BlurEffect::applyNoise(GLVertexBuffer *vbo, int vboStart, int blurRectCount
 
     vbo->draw(GL_TRIANGLES, vboStart, blurRectCount);
     m_shader->unbind();
+
+    glDisable(GL_BLEND);
 }
 
 void BlurEffect::downSampleTexture(GLVertexBuffer *vbo, int blurRectCount)
@@ -59,6 +59,7 @@ public Q_SLOTS:
     void slotWindowDeleted(KWin::EffectWindow *w);
     void slotPropertyNotify(KWin::EffectWindow *w, long atom);
     void slotScreenGeometryChanged();
+    void slotScreenRemoved(KWin::EffectScreen *screen);
 
 private:
     QRect expand(const QRect &rect) const;
@@ -70,13 +71,29 @@ private:
     QRegion blurRegion(const EffectWindow *w) const;
     bool shouldBlur(const EffectWindow *w, int mask, const WindowPaintData &data) const;
     void updateBlurRegion(EffectWindow *w) const;
-    void doBlur(const QRegion &shape, const QRect &screen, const float opacity, const QMatrix4x4 &screenProjection, bool isDock, QRect windowRect);
+
+    struct BlurCache {
+        QScopedPointer<GLTexture> texture;
+        QScopedPointer<GLRenderTarget> renderTarget;
+        QRegion blurArea; // the blurred area of the window in global coordinates
+        QRegion valid; // the part of the blurred area whose background didn't change since it was cached
+        qreal scale = 1.0;
+        bool recording = false; // whether the background of the blurred area is repainted in this frame
+    };
+    BlurCache *blurCache(const EffectWindow *w, const QRegion &blurArea);
+    BlurCache *findBlurCache(const EffectWindow *w) const;
+    void deleteBlurCache(const EffectWindow *w);
+    void deleteBlurCaches(const EffectWindow *w);
+    void deleteBlurCaches();
+    void paintCachedBlur(const BlurCache *cache, const QRegion &shape, const float opacity, const QMatrix4x4 &screenProjection, QPoint windowPosition);
+
+    void doBlur(const QRegion &shape, const QRect &screen, const float opacity, const QMatrix4x4 &screenProjection, bool isDock, QRect windowRect, BlurCache *cache = nullptr);
     void uploadRegion(QVector2D *&map, const QRegion &region, const int downSampleIterations);
     void uploadGeometry(GLVertexBuffer *vbo, const QRegion &blurRegion, const QRegion &windowRegion);
     void generateNoiseTexture();
 
     void upscaleRenderToScreen(GLVertexBuffer *vbo, int vboStart, int blurRectCount, const QMatrix4x4 &screenProjection, QPoint windowPosition);
-    void applyNoise(GLVertexBuffer *vbo, int vboStart, int blurRectCount, const QMatrix4x4 &screenProjection, QPoint windowPosition);
+    void applyNoise(GLVertexBuffer *vbo, int vboStart, int blurRectCount, const float opacity, const QMatrix4x4 &screenProjection, QPoint windowPosition);
     void downSampleTexture(GLVertexBuffer *vbo, int blurRectCount);
     void upSampleTexture(GLVertexBuffer *vbo, int blurRectCount);
     void copyScreenSampleTexture(GLVertexBuffer *vbo, int blurRectCount, QRegion blurShape, const QMatrix4x4 &screenProjection);
@@ -116,6 +133,10 @@ private:
     QVector <BlurValuesStruct> blurStrengthValues;
 
     QMap <EffectWindow*, QMetaObject::Connection> windowBlurChangedConnections;
+    // Outputs can have different scales, every output that shows the blurred area of
+    // a window has its own cache. On X11, all outputs are painted at once.
+    QHash<const EffectWindow *, QHash<const EffectScreen *, BlurCache *>> m_blurCaches;
+    EffectScreen *m_currentScreen = nullptr;
     KWaylandServer::ScopedGlobalPointer<KWaylandServer::BlurManagerInterface> m_blurManager;
 };
 
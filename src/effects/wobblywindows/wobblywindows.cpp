@@ -11,8 +11,18 @@
 #include "wobblywindows.h"
 #include "wobblywindowsconfig.h"
 
+#include <kwinglplatform.h>
+#include <kwinglutils.h>
+
+#include <QMatrix4x4>
+#include <QTextStream>
+
 #include <cmath>
 
+#if defined(__SSE2__)
+#  include <emmintrin.h>
+#endif
+
 //#define COMPUTE_STATS
 
 // if you enable it and run kwin in a terminal from the session it manages,
@@ -133,10 +143,6 @@ WobblyWindowsEffect::~WobblyWindowsEffect()
         // we should be empty at this point...
         // emit a warning and clean the list.
         qCDebug(KWINEFFECTS) << "Windows list not empty. Left items : " << windows.count();
-        QHash< const EffectWindow*,  WindowWobblyInfos >::iterator i;
-        for (i = windows.begin(); i != windows.end(); ++i) {
-            freeWobblyInfo(i.value());
-        }
     }
 }
 
@@ -177,6 +183,11 @@ void WobblyWindowsEffect::reconfigure(ReconfigureFlags)
     m_moveWobble = WobblyWindowsConfig::moveWobble();
     m_resizeWobble = WobblyWindowsConfig::resizeWobble();
 
+    // The tesselation may have changed.
+    for (WindowWobblyInfos &wwi : windows) {
+        wwi.grid.clear();
+    }
+
 #if defined VERBOSE_MODE
     qCDebug(KWINEFFECTS) << "Parameters :\n" <<
                  "grid(" << m_stiffness << ", " << m_drag << ", " << m_move_factor << ")\n" <<
@@ -267,7 +278,31 @@ void WobblyWindowsEffect::prePaintWindow(EffectWindow* w, WindowPrePaintData& da
 
 void WobblyWindowsEffect::deform(EffectWindow *w, int mask, WindowPaintData &data, WindowQuadList &quads)
 {
-    if (!(mask & PAINT_SCREEN_TRANSFORMED) && windows.contains(w)) {
+    if (!(mask & PAINT_SCREEN_TRANSFORMED) && windows.contains(w) && ensureShader()) {
+        WindowWobblyInfos& wwi = windows[w];
+
+        // The vertex shader evaluates the bezier surface, the grid only has to be rebuilt
+        // when the window is resized.
+        QRectF bounds;
+        for (const WindowQuad &quad : qAsConst(quads)) {
+            bounds |= QRectF(QPointF(quad.left(), quad.top()), QPointF(quad.right(), quad.bottom()));
+        }
+        if (wwi.gridBounds != bounds || wwi.grid.isEmpty()) {
+            wwi.grid = quads.makeRegularGrid(m_xTesselation, m_yTesselation);
+            wwi.gridBounds = bounds;
+        }
+        quads = wwi.grid;
+
+        QRectF dirtyRect = deformedBounds(wwi, w->frameGeometry());
+        dirtyRect = QRectF(
+            dirtyRect.x() * data.xScale() + w->x() + data.xTranslation(),
+            dirtyRect.y() * data.yScale() + w->y() + data.yTranslation(),
+            (dirtyRect.width() + 1.0) * data.xScale(),
+            (dirtyRect.height() + 1.0) * data.yScale());
+        // Expand the dirty region by 1px to fix potential round/floor issues.
+        dirtyRect.adjust(-1.0, -1.0, 1.0, 1.0);
+        m_updateRegion = m_updateRegion.united(dirtyRect.toRect());
+    } else if (!(mask & PAINT_SCREEN_TRANSFORMED) && windows.contains(w)) {
         quads = quads.makeRegularGrid(m_xTesselation, m_yTesselation);
 
         WindowWobblyInfos& wwi = windows[w];
@@ -302,6 +337,177 @@ void WobblyWindowsEffect::deform(EffectWindow *w, int mask, WindowPaintData &dat
     }
 }
 
+GLShader *WobblyWindowsEffect::deformShader(EffectWindow *w, int mask, const WindowPaintData &data)
+{
+    Q_UNUSED(data)
+
+    auto it = windows.constFind(w);
+    if ((mask & PAINT_SCREEN_TRANSFORMED) || it == windows.constEnd() || !ensureShader()) {
+        return nullptr;
+    }
+
+    // The control points are passed as two matrices, one for each coordinate, so the
+    // surface can be evaluated with two matrix-vector products in the vertex shader.
+    const QRect frameGeometry = w->frameGeometry();
+    QMatrix4x4 controlPointsX;
+    QMatrix4x4 controlPointsY;
+    for (unsigned int j = 0; j < GridSize; ++j) {
+        for (unsigned int i = 0; i < GridSize; ++i) {
+            const Pair &position = it->position[i + j * it->width];
+            controlPointsX(i, j) = position.x - frameGeometry.x();
+            controlPointsY(i, j) = position.y - frameGeometry.y();
+        }
+    }
+
+    ShaderManager::instance()->pushShader(m_shader.data());
+    m_shader->setUniform(m_controlPointsXLocation, controlPointsX);
+    m_shader->setUniform(m_controlPointsYLocation, controlPointsY);
+    m_shader->setUniform(m_frameSizeLocation, QVector2D(frameGeometry.width(), frameGeometry.height()));
+    ShaderManager::instance()->popShader();
+
+    return m_shader.data();
+}
+
+bool WobblyWindowsEffect::ensureShader()
+{
+    if (m_shader) {
+        return true;
+    }
+    if (m_shaderFailed) {
+        return false;
+    }
+
+    QByteArray source;
+    QTextStream stream(&source);
+
+    GLPlatform * const gl = GLPlatform::instance();
+    QByteArray attribute, varying;
+    if (!gl->isGLES()) {
+        const bool glsl_140 = gl->glslVersion() >= kVersionNumber(1, 40);
+        attribute = glsl_140 ? QByteArrayLiteral("in")  : QByteArrayLiteral("attribute");
+        varying   = glsl_140 ? QByteArrayLiteral("out") : QByteArrayLiteral("varying");
+        if (glsl_140) {
+            stream << "#version 140\n\n";
+        }
+    } else {
+        const bool glsl_es_300 = gl->glslVersion() >= kVersionNumber(3, 0);
+        attribute = glsl_es_300 ? QByteArrayLiteral("in")  : QByteArrayLiteral("attribute");
+        varying   = glsl_es_300 ? QByteArrayLiteral("out") : QByteArrayLiteral("varying");
+        if (glsl_es_300) {
+            stream << "#version 300 es\n\n";
+        }
+    }
+
+    stream << attribute << " vec4 position;\n";
+    stream << attribute << " vec4 texcoord;\n\n";
+    stream << varying << " vec2 texcoord0;\n\n";
+    stream << "uniform mat4 modelViewProjectionMatrix;\n";
+    stream << "uniform mat4 controlPointsX;\n";
+    stream << "uniform mat4 controlPointsY;\n";
+    stream << "uniform vec2 frameSize;\n\n";
+    stream << "vec4 bernstein(float t)\n{\n";
+    stream << "    float s = 1.0 - t;\n";
+    stream << "    return vec4(s * s * s, 3.0 * s * s * t, 3.0 * s * t * t, t * t * t);\n";
+    stream << "}\n\n";
+    stream << "void main()\n{\n";
+    stream << "    texcoord0 = texcoord.st;\n";
+    stream << "    vec2 uv = position.xy / frameSize;\n";
+    stream << "    vec4 bu = bernstein(uv.x);\n";
+    stream << "    vec4 bv = bernstein(uv.y);\n";
+    stream << "    vec2 deformed = vec2(dot(bu, controlPointsX * bv), dot(bu, controlPointsY * bv));\n";
+    stream << "    gl_Position = modelViewProjectionMatrix * vec4(deformed, 0.0, 1.0);\n";
+    stream << "}\n";
+    stream.flush();
+
+    const ShaderTraits traits = ShaderTrait::MapTexture | ShaderTrait::Modulate | ShaderTrait::AdjustSaturation;
+    m_shader.reset(ShaderManager::instance()->generateCustomShader(traits, source));
+    if (!m_shader->isValid()) {
+        qCWarning(KWINEFFECTS) << "Failed to compile the wobbly windows shader, deforming windows on the CPU";
+        m_shader.reset();
+        m_shaderFailed = true;
+        return false;
+    }
+
+    m_controlPointsXLocation = m_shader->uniformLocation("controlPointsX");
+    m_controlPointsYLocation = m_shader->uniformLocation("controlPointsY");
+    m_frameSizeLocation = m_shader->uniformLocation("frameSize");
+    return true;
+}
+
+// Computes the control points that describe the part of the cubic bezier curve with the
+// control points @p p between the parameters @p a and @p b. The i-th new control point is
+// the blossom of the curve with 3 - i arguments equal to a and i arguments equal to b.
+static void reparametrizeBezier(const double p[4], double a, double b, double out[4])
+{
+    auto blossom = [p](double t1, double t2, double t3) {
+        double q[3];
+        for (int i = 0; i < 3; ++i) {
+            q[i] = p[i] + (p[i + 1] - p[i]) * t1;
+        }
+        const double r0 = q[0] + (q[1] - q[0]) * t2;
+        const double r1 = q[1] + (q[2] - q[1]) * t2;
+        return r0 + (r1 - r0) * t3;
+    };
+    out[0] = blossom(a, a, a);
+    out[1] = blossom(a, a, b);
+    out[2] = blossom(a, b, b);
+    out[3] = blossom(b, b, b);
+}
+
+QRectF WobblyWindowsEffect::deformedBounds(const WindowWobblyInfos& wwi, const QRect &frameGeometry) const
+{
+    // The grid covers the expanded geometry of the window, e.g. its shadow, so the surface
+    // is evaluated outside of [0, 1] where it isn't bounded by the control points. The
+    // surface over the range of the grid is described by other control points, and lies
+    // inside their convex hull, so their bounding box covers the window however much it
+    // folds.
+    QRectF bounds = wwi.gridBounds;
+    if (frameGeometry.isEmpty()) {
+        return bounds;
+    }
+
+    const double u0 = wwi.gridBounds.left() / frameGeometry.width();
+    const double u1 = wwi.gridBounds.right() / frameGeometry.width();
+    const double v0 = wwi.gridBounds.top() / frameGeometry.height();
+    const double v1 = wwi.gridBounds.bottom() / frameGeometry.height();
+
+    for (int coordinate = 0; coordinate < 2; ++coordinate) {
+        const double offset = coordinate ? frameGeometry.y() : frameGeometry.x();
+
+        double rows[GridSize][GridSize];
+        for (unsigned int j = 0; j < GridSize; ++j) {
+            double p[GridSize];
+            for (unsigned int i = 0; i < GridSize; ++i) {
+                const Pair &position = wwi.position[i + j * wwi.width];
+                p[i] = (coordinate ? position.y : position.x) - offset;
+            }
+            reparametrizeBezier(p, u0, u1, rows[j]);
+        }
+
+        double minimum = coordinate ? bounds.top() : bounds.left();
+        double maximum = coordinate ? bounds.bottom() : bounds.right();
+        for (unsigned int i = 0; i < GridSize; ++i) {
+            const double p[GridSize] = { rows[0][i], rows[1][i], rows[2][i], rows[3][i] };
+            double column[GridSize];
+            reparametrizeBezier(p, v0, v1, column);
+            for (unsigned int j = 0; j < GridSize; ++j) {
+                minimum = qMin(minimum, column[j]);
+                maximum = qMax(maximum, column[j]);
+            }
+        }
+
+        if (coordinate) {
+            bounds.setTop(minimum);
+            bounds.setBottom(maximum);
+        } else {
+            bounds.setLeft(minimum);
+            bounds.setRight(maximum);
+        }
+    }
+
+    return bounds;
+}
+
 void WobblyWindowsEffect::postPaintScreen()
 {
     if (!windows.isEmpty()) {
@@ -446,22 +652,9 @@ void WobblyWindowsEffect::stepMovedResized(EffectWindow* w)
 
 void WobblyWindowsEffect::initWobblyInfo(WindowWobblyInfos& wwi, QRect geometry) const
 {
-    wwi.count = 4 * 4;
-    wwi.width = 4;
-    wwi.height = 4;
-
-    wwi.bezierWidth = m_xTesselation;
-    wwi.bezierHeight = m_yTesselation;
-    wwi.bezierCount = m_xTesselation * m_yTesselation;
-
-    wwi.origin = new Pair[wwi.count];
-    wwi.position = new Pair[wwi.count];
-    wwi.velocity = new Pair[wwi.count];
-    wwi.acceleration = new Pair[wwi.count];
-    wwi.buffer = new Pair[wwi.count];
-    wwi.constraint = new bool[wwi.count];
-
-    wwi.bezierSurface = new Pair[wwi.bezierCount];
+    wwi.count = GridSize * GridSize;
+    wwi.width = GridSize;
+    wwi.height = GridSize;
 
     wwi.status = Moving;
     wwi.clock = std::chrono::duration_cast<std::chrono::milliseconds>(
@@ -501,18 +694,6 @@ void WobblyWindowsEffect::initWobblyInfo(WindowWobblyInfos& wwi, QRect geometry)
     }
 }
 
-void WobblyWindowsEffect::freeWobblyInfo(WindowWobblyInfos& wwi) const
-{
-    delete[] wwi.origin;
-    delete[] wwi.position;
-    delete[] wwi.velocity;
-    delete[] wwi.acceleration;
-    delete[] wwi.buffer;
-    delete[] wwi.constraint;
-
-    delete[] wwi.bezierSurface;
-}
-
 WobblyWindowsEffect::Pair WobblyWindowsEffect::computeBezierPoint(const WindowWobblyInfos& wwi, Pair point) const
 {
     const qreal tx = point.x;
@@ -550,6 +731,15 @@ namespace
 
 static inline void fixVectorBounds(WobblyWindowsEffect::Pair& vec, qreal min, qreal max)
 {
+#if defined(__SSE2__)
+    // Clamp both coordinates at once without branches: keep the sign of each coordinate,
+    // limit its magnitude to max and zero it if the magnitude is below min.
+    const __m128d signMask = _mm_set1_pd(-0.0);
+    const __m128d value = _mm_loadu_pd(&vec.x);
+    const __m128d magnitude = _mm_andnot_pd(signMask, value);
+    const __m128d clamped = _mm_or_pd(_mm_min_pd(magnitude, _mm_set1_pd(max)), _mm_and_pd(signMask, value));
+    _mm_storeu_pd(&vec.x, _mm_andnot_pd(_mm_cmplt_pd(magnitude, _mm_set1_pd(min)), clamped));
+#else
     if (fabs(vec.x) < min) {
         vec.x = 0.0;
     } else if (fabs(vec.x) > max) {
@@ -569,6 +759,22 @@ static inline void fixVectorBounds(WobblyWindowsEffect::Pair& vec, qreal min, qr
             vec.y = -max;
         }
     }
+#endif
+}
+
+// Computes a * s + b * t for both coordinates at once.
+static inline WobblyWindowsEffect::Pair multiplyAdd(const WobblyWindowsEffect::Pair &a, qreal s,
+                                                    const WobblyWindowsEffect::Pair &b, qreal t)
+{
+    WobblyWindowsEffect::Pair res;
+#if defined(__SSE2__)
+    const __m128d product = _mm_mul_pd(_mm_loadu_pd(&a.x), _mm_set1_pd(s));
+    _mm_storeu_pd(&res.x, _mm_add_pd(product, _mm_mul_pd(_mm_loadu_pd(&b.x), _mm_set1_pd(t))));
+#else
+    res.x = a.x * s + b.x * t;
+    res.y = a.y * s + b.y * t;
+#endif
+    return res;
 }
 
 #if defined COMPUTE_STATS
@@ -853,7 +1059,7 @@ bool WobblyWindowsEffect::updateWindowWobblyDatas(EffectWindow* w, qreal time)
         }
     }
 
-    heightRingLinearMean(&wwi.acceleration, wwi);
+    heightRingLinearMean(wwi.acceleration, wwi);
 
 #if defined COMPUTE_STATS
     Pair accBound = {m_maxAcceleration, m_minAcceleration};
@@ -870,13 +1076,12 @@ bool WobblyWindowsEffect::updateWindowWobblyDatas(EffectWindow* w, qreal time)
 #endif
 
         Pair& vel = wwi.velocity[i];
-        vel.x = acc.x * time + vel.x * m_drag;
-        vel.y = acc.y * time + vel.y * m_drag;
+        vel = multiplyAdd(acc, time, vel, m_drag);
 
         acc_sum += fabs(acc.x) + fabs(acc.y);
     }
 
-    heightRingLinearMean(&wwi.velocity, wwi);
+    heightRingLinearMean(wwi.velocity, wwi);
 
     // compute the new pos of each vertex.
     for (unsigned int i = 0; i < wwi.count; ++i) {
@@ -930,7 +1135,6 @@ bool WobblyWindowsEffect::updateWindowWobblyDatas(EffectWindow* w, qreal time)
 #endif
 
     if (wwi.status != Moving && acc_sum < m_stopAcceleration && vel_sum < m_stopVelocity) {
-        freeWobblyInfo(wwi);
         windows.remove(w);
         unredirect(w);
         if (windows.isEmpty())
@@ -941,9 +1145,8 @@ bool WobblyWindowsEffect::updateWindowWobblyDatas(EffectWindow* w, qreal time)
     return true;
 }
 
-void WobblyWindowsEffect::heightRingLinearMean(Pair** data_pointer, WindowWobblyInfos& wwi)
+void WobblyWindowsEffect::heightRingLinearMean(Pair* data, WindowWobblyInfos& wwi)
 {
-    Pair* data = *data_pointer;
     Pair neibourgs[8];
 
     // for corners
@@ -1079,9 +1282,7 @@ void WobblyWindowsEffect::heightRingLinearMean(Pair** data_pointer, WindowWobbly
         }
     }
 
-    Pair* tmp = data;
-    *data_pointer = wwi.buffer;
-    wwi.buffer = tmp;
+    std::copy(wwi.buffer, wwi.buffer + wwi.count, data);
 }
 
 bool WobblyWindowsEffect::isActive() const
@@ -16,6 +16,7 @@
 namespace KWin
 {
 
+class GLShader;
 struct ParameterSet;
 
 /**
@@ -116,6 +117,7 @@ public:
 
 protected:
     void deform(EffectWindow *w, int mask, WindowPaintData &data, WindowQuadList &quads) override;
+    GLShader *deformShader(EffectWindow *w, int mask, const WindowPaintData &data) override;
 
 public Q_SLOTS:
     void slotWindowStartUserMovedResized(KWin::EffectWindow *w);
@@ -128,25 +130,27 @@ private:
     void stepMovedResized(EffectWindow* w);
     bool updateWindowWobblyDatas(EffectWindow* w, qreal time);
 
+    // the control points of the bezier surface form a 4*4 grid
+    static const unsigned int GridSize = 4;
+
     struct WindowWobblyInfos {
-        Pair* origin;
-        Pair* position;
-        Pair* velocity;
-        Pair* acceleration;
-        Pair* buffer;
+        Pair origin[GridSize * GridSize];
+        Pair position[GridSize * GridSize];
+        Pair velocity[GridSize * GridSize];
+        Pair acceleration[GridSize * GridSize];
+        Pair buffer[GridSize * GridSize];
 
         // if true, the physics system moves this point based only on it "normal" destination
         // given by the window position, ignoring neighbour points.
-        bool* constraint;
+        bool constraint[GridSize * GridSize];
 
         unsigned int width;
         unsigned int height;
         unsigned int count;
 
-        Pair* bezierSurface;
-        unsigned int bezierWidth;
-        unsigned int bezierHeight;
-        unsigned int bezierCount;
+        // the tesselated window quads, they only change when the window is resized
+        WindowQuadList grid;
+        QRectF gridBounds;
 
         WindowStatus status;
 
@@ -182,11 +186,18 @@ private:
     bool m_resizeWobble;
 
     void initWobblyInfo(WindowWobblyInfos& wwi, QRect geometry) const;
-    void freeWobblyInfo(WindowWobblyInfos& wwi) const;
 
     WobblyWindowsEffect::Pair computeBezierPoint(const WindowWobblyInfos& wwi, Pair point) const;
+    QRectF deformedBounds(const WindowWobblyInfos& wwi, const QRect &frameGeometry) const;
+    bool ensureShader();
+
+    static void heightRingLinearMean(Pair* data, WindowWobblyInfos& wwi);
 
-    static void heightRingLinearMean(Pair** data_pointer, WindowWobblyInfos& wwi);
+    QScopedPointer<GLShader> m_shader;
+    bool m_shaderFailed = false;
+    int m_controlPointsXLocation = -1;
+    int m_controlPointsYLocation = -1;
+    int m_frameSizeLocation = -1;
 
     void setParameterSet(const ParameterSet& pset);
 };
@@ -162,21 +162,16 @@ bool Workspace::workspaceEvent(xcb_generic_event_t *e)
 
     const xcb_window_t eventWindow = findEventWindow(e);
     if (eventWindow != XCB_WINDOW_NONE) {
-        if (X11Client *c = findClient(Predicate::WindowMatch, eventWindow)) {
-            if (c->windowEvent(e))
-                return true;
-        } else if (X11Client *c = findClient(Predicate::WrapperIdMatch, eventWindow)) {
-            if (c->windowEvent(e))
-                return true;
-        } else if (X11Client *c = findClient(Predicate::FrameIdMatch, eventWindow)) {
-            if (c->windowEvent(e))
-                return true;
-        } else if (X11Client *c = findClient(Predicate::InputIdMatch, eventWindow)) {
-            if (c->windowEvent(e))
-                return true;
-        } else if (Unmanaged* c = findUnmanaged(eventWindow)) {
-            if (c->windowEvent(e))
-                return true;
+        // client, wrapper, frame and input windows as well as unmanaged windows share one index
+        const auto it = m_x11WindowIndex.constFind(eventWindow);
+        if (it != m_x11WindowIndex.constEnd()) {
+            if (X11Client *c = it->client) {
+                if (c->windowEvent(e))
+                    return true;
+            } else if (Unmanaged* c = it->unmanaged) {
+                if (c->windowEvent(e))
+                    return true;
+            }
         }
     }
 
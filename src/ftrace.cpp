@@ -18,8 +18,82 @@
 #include <QScopeGuard>
 #include <QTextStream>
 
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
 namespace KWin
 {
+
+/**
+ * A single producer single consumer ring buffer of binary trace records. The thread that
+ * owns the buffer pushes records, the drain thread pops them.
+ */
+class FTraceBuffer
+{
+public:
+    static constexpr quint32 s_capacity = 4096;
+
+    explicit FTraceBuffer(quint32 threadId)
+        : m_threadId(threadId)
+    {
+    }
+
+    bool push(const FTraceLogger::FTraceRecord &record)
+    {
+        const quint32 tail = m_tail.load(std::memory_order_relaxed);
+        if (tail - m_head.load(std::memory_order_acquire) == s_capacity) {
+            return false;
+        }
+        m_records[tail % s_capacity] = record;
+        m_tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    template<typename Function>
+    void consume(Function function)
+    {
+        const quint32 tail = m_tail.load(std::memory_order_acquire);
+        quint32 head = m_head.load(std::memory_order_relaxed);
+        for (; head != tail; ++head) {
+            function(m_records[head % s_capacity]);
+        }
+        m_head.store(head, std::memory_order_release);
+    }
+
+    quint32 threadId() const
+    {
+        return m_threadId;
+    }
+
+    std::atomic<quint32> dropped = 0;
+
+private:
+    FTraceLogger::FTraceRecord m_records[s_capacity];
+    std::atomic<quint32> m_head = 0;
+    std::atomic<quint32> m_tail = 0;
+    const quint32 m_threadId;
+};
+
+struct FTraceEventRegistry
+{
+    QMutex mutex;
+    QVector<const char *> names;
+};
+
+static FTraceEventRegistry &eventRegistry()
+{
+    static FTraceEventRegistry registry;
+    return registry;
+}
+
+static quint64 monotonicTimestamp()
+{
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return quint64(ts.tv_sec) * 1'000'000'000ull + ts.tv_nsec;
+}
+
 KWIN_SINGLETON_FACTORY(KWin::FTraceLogger)
 
 FTraceLogger::FTraceLogger(QObject *parent)
@@ -32,9 +106,12 @@ FTraceLogger::FTraceLogger(QObject *parent)
     }
 }
 
-bool FTraceLogger::isEnabled() const
+FTraceLogger::~FTraceLogger()
 {
-    return m_file.isOpen();
+    m_binaryEnabled = false;
+    stopDrainThread();
+    qDeleteAll(m_buffers);
+    s_self = nullptr;
 }
 
 void FTraceLogger::setEnabled(bool enabled)
@@ -44,10 +121,19 @@ void FTraceLogger::setEnabled(bool enabled)
         return;
     }
 
+    // The trace files are kept open once they have been opened, other threads may still
+    // be writing markers after tracing has been disabled.
     if (enabled) {
         open();
+        m_enabled = m_file.isOpen();
+        m_binaryEnabled = m_rawFile.isOpen();
+        if (m_binaryEnabled) {
+            startDrainThread();
+        }
     } else {
-        m_file.close();
+        m_enabled = false;
+        m_binaryEnabled = false;
+        stopDrainThread();
     }
     Q_EMIT enabledChanged();
 }
@@ -59,13 +145,165 @@ bool FTraceLogger::open()
         return false;
     }
 
-    m_file.setFileName(path);
-    if (!m_file.open(QIODevice::WriteOnly)) {
-        qWarning() << "No access to trace marker file at:" << path;
+    if (!m_file.isOpen()) {
+        m_file.setFileName(path);
+        if (!m_file.open(QIODevice::WriteOnly | QIODevice::Unbuffered)) {
+            qWarning() << "No access to trace marker file at:" << path;
+        }
+    }
+
+    if (!m_rawFile.isOpen()) {
+        const QString rawPath = rawFilePath(path);
+        if (!rawPath.isEmpty()) {
+            m_rawFile.setFileName(rawPath);
+            if (!m_rawFile.open(QIODevice::WriteOnly | QIODevice::Unbuffered)) {
+                qWarning() << "No access to raw trace marker file at:" << rawPath;
+            }
+        }
     }
     return true;
 }
 
+QString FTraceLogger::rawFilePath(const QString &markerFilePath)
+{
+    if (qEnvironmentVariableIsSet("KWIN_PERF_FTRACE_RAW_FILE")) {
+        return qgetenv("KWIN_PERF_FTRACE_RAW_FILE");
+    }
+    if (qEnvironmentVariableIsSet("KWIN_PERF_FTRACE_FILE")) {
+        return QString();
+    }
+    const QFileInfo rawFileInfo(QFileInfo(markerFilePath).dir(), QStringLiteral("trace_marker_raw"));
+    return rawFileInfo.exists() ? rawFileInfo.absoluteFilePath() : QString();
+}
+
+void FTraceLogger::writeMarker(const QByteArray &message)
+{
+    // trace_marker turns every write into a separate marker, so the message has to be
+    // written at once. A single write() is atomic, no need to lock.
+    const ssize_t written = ::write(m_file.handle(), message.constData(), message.size());
+    Q_UNUSED(written)
+}
+
+quint32 FTraceLogger::registerEvent(const char *name)
+{
+    FTraceEventRegistry &registry = eventRegistry();
+    QMutexLocker lock(&registry.mutex);
+    for (int i = 0; i < registry.names.count(); ++i) {
+        if (qstrcmp(registry.names[i], name) == 0) {
+            return i + 1;
+        }
+    }
+    registry.names.append(name);
+    return registry.names.count(); // 0 is reserved for announcing event names
+}
+
+FTraceBuffer *FTraceLogger::threadBuffer()
+{
+    struct ThreadBuffer
+    {
+        FTraceLogger *logger = nullptr;
+        FTraceBuffer *buffer = nullptr;
+    };
+    thread_local ThreadBuffer threadBuffer;
+    if (Q_UNLIKELY(threadBuffer.logger != this)) {
+        // The buffer is owned by the logger, it outlives the thread
+        threadBuffer.logger = this;
+        threadBuffer.buffer = new FTraceBuffer(syscall(SYS_gettid));
+        std::lock_guard<std::mutex> lock(m_drainMutex);
+        m_buffers.append(threadBuffer.buffer);
+    }
+    return threadBuffer.buffer;
+}
+
+void FTraceLogger::traceEvent(quint32 eventId, Phase phase, quint32 context)
+{
+    FTraceBuffer *buffer = threadBuffer();
+    const FTraceRecord record{
+        .eventId = eventId,
+        .phase = phase,
+        .context = context,
+        .threadId = buffer->threadId(),
+        .timestamp = monotonicTimestamp(),
+    };
+    if (!buffer->push(record)) {
+        buffer->dropped.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void FTraceLogger::startDrainThread()
+{
+    if (m_drainThread.joinable()) {
+        return;
+    }
+    m_drainStopRequested = false;
+    m_drainThread = std::thread([this]() {
+        std::unique_lock<std::mutex> lock(m_drainMutex);
+        while (!m_drainStopRequested) {
+            m_drainCondition.wait_for(lock, std::chrono::milliseconds(50));
+            drain();
+        }
+    });
+}
+
+void FTraceLogger::stopDrainThread()
+{
+    if (!m_drainThread.joinable()) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_drainMutex);
+        m_drainStopRequested = true;
+    }
+    m_drainCondition.notify_one();
+    m_drainThread.join();
+}
+
+void FTraceLogger::flushEvents()
+{
+    std::lock_guard<std::mutex> lock(m_drainMutex);
+    drain();
+}
+
+void FTraceLogger::drain()
+{
+    const int fd = m_rawFile.handle();
+    if (fd == -1) {
+        return;
+    }
+
+    // Announce the names of the events that have been registered since the last drain
+    {
+        FTraceEventRegistry &registry = eventRegistry();
+        QMutexLocker lock(&registry.mutex);
+        for (; m_announcedEvents < registry.names.count(); ++m_announcedEvents) {
+            const QByteArray name(registry.names[m_announcedEvents]);
+            const FTraceRecord header{
+                .eventId = 0,
+                .phase = quint32(m_announcedEvents + 1),
+                .context = quint32(name.size()),
+                .threadId = 0,
+                .timestamp = monotonicTimestamp(),
+            };
+            QByteArray data(reinterpret_cast<const char *>(&header), sizeof(header));
+            data.append(name);
+            if (::write(fd, data.constData(), data.size()) < 0) {
+                return;
+            }
+        }
+    }
+
+    for (FTraceBuffer *buffer : qAsConst(m_buffers)) {
+        buffer->consume([fd](const FTraceRecord &record) {
+            // Every write to trace_marker_raw is a separate entry
+            const ssize_t written = ::write(fd, &record, sizeof(record));
+            Q_UNUSED(written)
+        });
+        if (const quint32 dropped = buffer->dropped.exchange(0)) {
+            qWarning() << "Dropped" << dropped << "trace events of thread" << buffer->threadId();
+        }
+    }
+}
+
 QString FTraceLogger::filePath()
 {
     if (qEnvironmentVariableIsSet("KWIN_PERF_FTRACE_FILE")) {
@@ -115,7 +353,23 @@ QString FTraceLogger::filePath()
 
 FTraceDuration::~FTraceDuration()
 {
-    FTraceLogger::self()->trace(m_message, " end_ctx=", m_context);
+    writeMarker(" end_ctx=");
+}
+
+quint32 FTraceDuration::nextContext()
+{
+    static QAtomicInteger<quint32> s_context = 0;
+    return ++s_context;
+}
+
+void FTraceDuration::writeMarker(const char *suffix)
+{
+    // The arguments are formatted only once, the begin and the end marker differ in the suffix
+    m_message.truncate(m_prefixSize);
+    m_message.append(suffix);
+    m_message.append(QByteArray::number(m_context));
+    m_message.append('\n');
+    FTraceLogger::self()->writeMarker(m_message);
 }
 
 }
@@ -13,12 +13,20 @@
 
 #include <QFile>
 #include <QMutex>
-#include <QMutexLocker>
 #include <QObject>
 #include <QTextStream>
+#include <QVector>
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <optional>
+#include <thread>
 
 namespace KWin
 {
+class FTraceBuffer;
+
 /**
  * FTraceLogger is a singleton utility for writing log messages using ftrace
  *
@@ -26,6 +34,12 @@ namespace KWin
  *  Set the KWIN_PERF_FTRACE environment variable before starting the application
  *  Calling on DBus /FTrace org.kde.kwin.FTrace.setEnabled true
  * After having created the ftrace mount
+ *
+ * Besides the formatted text markers, the logger supports binary events, see fTraceEvent()
+ * and fTraceScope(). Binary events are recorded into per-thread ring buffers and written to
+ * trace_marker_raw, or the file in KWIN_PERF_FTRACE_RAW_FILE, by a background thread. Every
+ * write is one FTraceRecord; the names of the events are announced by records with the
+ * event id 0, followed by the id and the name of the announced event.
  */
 class KWIN_EXPORT FTraceLogger : public QObject
 {
@@ -34,10 +48,41 @@ class KWIN_EXPORT FTraceLogger : public QObject
     Q_PROPERTY(bool isEnabled READ isEnabled NOTIFY enabledChanged)
 
 public:
+    ~FTraceLogger() override;
+
+    enum Phase : quint32 {
+        Instant,
+        Begin,
+        End,
+    };
+
+    /**
+     * The layout of a binary event as it is written to the raw trace file.
+     */
+    struct FTraceRecord
+    {
+        quint32 eventId;
+        quint32 phase;
+        quint32 context;
+        quint32 threadId;
+        quint64 timestamp; ///< CLOCK_MONOTONIC, in nanoseconds
+    };
+
     /**
      * Enabled through DBus and logging has started
      */
-    bool isEnabled() const;
+    bool isEnabled() const
+    {
+        return m_enabled.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * Returns @c true if binary events are being recorded.
+     */
+    bool isBinaryEnabled() const
+    {
+        return m_binaryEnabled.load(std::memory_order_relaxed);
+    }
 
     /**
      * Main log function
@@ -46,14 +91,34 @@ public:
     template<typename... Args> void trace(Args... args)
     {
         Q_ASSERT(isEnabled());
-        QMutexLocker lock(&m_mutex);
-        if (!m_file.isOpen()) {
-            return;
-        }
-        QTextStream stream(&m_file);
-        (stream << ... << args) << Qt::endl;
+        QByteArray message;
+        QTextStream stream(&message);
+        (stream << ... << args) << '\n';
+        stream.flush();
+        writeMarker(message);
     }
 
+    /**
+     * Writes the preformatted @a message as a single marker.
+     */
+    void writeMarker(const QByteArray &message);
+
+    /**
+     * Returns the id of the binary event with the given @a name. The @a name must outlive
+     * the logger, usually it's a string literal.
+     */
+    static quint32 registerEvent(const char *name);
+
+    /**
+     * Records the binary event @a eventId in the ring buffer of the calling thread.
+     */
+    void traceEvent(quint32 eventId, Phase phase, quint32 context = 0);
+
+    /**
+     * Writes all recorded binary events out, without waiting for the background thread.
+     */
+    void flushEvents();
+
 Q_SIGNALS:
     void enabledChanged();
 
@@ -62,9 +127,25 @@ public Q_SLOTS:
 
 private:
     static QString filePath();
+    static QString rawFilePath(const QString &markerFilePath);
     bool open();
+    void startDrainThread();
+    void stopDrainThread();
+    void drain();
+    FTraceBuffer *threadBuffer();
+
     QFile m_file;
+    QFile m_rawFile;
     QMutex m_mutex;
+    std::atomic<bool> m_enabled = false;
+    std::atomic<bool> m_binaryEnabled = false;
+
+    std::mutex m_drainMutex;
+    std::condition_variable m_drainCondition;
+    std::thread m_drainThread;
+    bool m_drainStopRequested = false;
+    QVector<FTraceBuffer *> m_buffers;
+    int m_announcedEvents = 0;
     KWIN_SINGLETON(FTraceLogger)
 };
 
@@ -73,18 +154,43 @@ class KWIN_EXPORT FTraceDuration
 public:
     template<typename... Args> FTraceDuration(Args... args)
     {
-        static QAtomicInteger<quint32> s_context = 0;
         QTextStream stream(&m_message);
         (stream << ... << args);
         stream.flush();
-        m_context = ++s_context;
-        FTraceLogger::self()->trace(m_message, " begin_ctx=", m_context);
+        m_context = nextContext();
+        m_prefixSize = m_message.size();
+        writeMarker(" begin_ctx=");
     }
 
     ~FTraceDuration();
 
+    static quint32 nextContext();
+
 private:
+    void writeMarker(const char *suffix);
+
     QByteArray m_message;
+    int m_prefixSize;
+    quint32 m_context;
+};
+
+class KWIN_EXPORT FTraceScope
+{
+public:
+    explicit FTraceScope(quint32 eventId)
+        : m_eventId(eventId)
+        , m_context(FTraceDuration::nextContext())
+    {
+        FTraceLogger::self()->traceEvent(m_eventId, FTraceLogger::Begin, m_context);
+    }
+
+    ~FTraceScope()
+    {
+        FTraceLogger::self()->traceEvent(m_eventId, FTraceLogger::End, m_context);
+    }
+
+private:
+    quint32 m_eventId;
     quint32 m_context;
 };
 
@@ -103,3 +209,24 @@ private:
  */
 #define fTraceDuration(...)                                                                                                                                    \
     QScopedPointer<KWin::FTraceDuration> _duration(KWin::FTraceLogger::self()->isEnabled() ? new KWin::FTraceDuration(__VA_ARGS__) : nullptr);
+
+/**
+ * Records a binary instant event, @a name must be a string literal. Unlike fTrace(), this can
+ * be used before the logger has been created, e.g. by the render loops of outputs.
+ */
+#define fTraceEvent(name)                                                                                                                                      \
+    do {                                                                                                                                                       \
+        static const quint32 _eventId = KWin::FTraceLogger::registerEvent(name);                                                                               \
+        if (KWin::FTraceLogger::self() && KWin::FTraceLogger::self()->isBinaryEnabled())                                                                       \
+            KWin::FTraceLogger::self()->traceEvent(_eventId, KWin::FTraceLogger::Instant);                                                                     \
+    } while (false)
+
+/**
+ * Records binary begin and end events around the relevant block, @a name must be a string literal.
+ * Like fTraceEvent(), this can be used before the logger has been created.
+ */
+#define fTraceScope(name)                                                                                                                                      \
+    static const quint32 _scopeEventId = KWin::FTraceLogger::registerEvent(name);                                                                              \
+    std::optional<KWin::FTraceScope> _scope;                                                                                                                   \
+    if (KWin::FTraceLogger::self() && KWin::FTraceLogger::self()->isBinaryEnabled())                                                                           \
+        _scope.emplace(_scopeEventId);
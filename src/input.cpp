@@ -12,6 +12,7 @@
 #include "backends/fakeinput/fakeinputbackend.h"
 #include "backends/libinput/connection.h"
 #include "backends/libinput/device.h"
+#include "composite.h"
 #include "effects.h"
 #include "gestures.h"
 #include "globalshortcuts.h"
@@ -2215,6 +2216,72 @@ void InputRedirection::setupWorkspace()
     }
     setupTouchpadShortcuts();
     setupInputFilters();
+
+    Workspace *ws = workspace();
+    connect(ws, &Workspace::stackingOrderChanged, this, &InputRedirection::invalidateInputCandidates);
+    connect(ws, &Workspace::currentActivityChanged, this, &InputRedirection::invalidateInputCandidates);
+    connect(ws, &Workspace::clientMinimizedChanged, this, &InputRedirection::invalidateInputCandidates);
+    connect(ws, &Workspace::clientAdded, this, &InputRedirection::watchInputCandidate);
+    connect(ws, &Workspace::clientRemoved, this, &InputRedirection::invalidateInputCandidates);
+    connect(ws, &Workspace::unmanagedAdded, this, &InputRedirection::watchInputCandidate);
+    connect(ws, &Workspace::unmanagedRemoved, this, &InputRedirection::invalidateInputCandidates);
+    connect(ws, &Workspace::internalClientAdded, this, &InputRedirection::watchInputCandidate);
+    connect(ws, &Workspace::internalClientRemoved, this, &InputRedirection::invalidateInputCandidates);
+    connect(VirtualDesktopManager::self(), &VirtualDesktopManager::currentChanged, this, &InputRedirection::invalidateInputCandidates);
+    ws->forEachToplevel([this](Toplevel *toplevel) {
+        watchInputCandidate(toplevel);
+    });
+}
+
+void InputRedirection::watchInputCandidate(Toplevel *toplevel)
+{
+    // Deleted windows are replaced in the stacking order without a stackingOrderChanged signal
+    connect(toplevel, &Toplevel::windowClosed, this, &InputRedirection::invalidateInputCandidates);
+    connect(toplevel, &Toplevel::windowShown, this, &InputRedirection::invalidateInputCandidates);
+    connect(toplevel, &Toplevel::windowHidden, this, &InputRedirection::invalidateInputCandidates);
+    if (AbstractClient *client = qobject_cast<AbstractClient *>(toplevel)) {
+        connect(client, &AbstractClient::desktopChanged, this, &InputRedirection::invalidateInputCandidates);
+        connect(client, &AbstractClient::activitiesChanged, this, &InputRedirection::invalidateInputCandidates);
+    }
+    invalidateInputCandidates();
+}
+
+void InputRedirection::invalidateInputCandidates()
+{
+    m_inputCandidatesValid = false;
+}
+
+void InputRedirection::updateInputCandidates(bool isScreenLocked)
+{
+    // Windows only announce that they became ready for painting while compositing.
+    if (m_inputCandidatesValid && m_inputCandidatesScreenLocked == isScreenLocked && Compositor::compositing()) {
+        return;
+    }
+    m_inputCandidates.clear();
+    const QList<Toplevel *> &stacking = Workspace::self()->stackingOrder();
+    for (auto it = stacking.crbegin(); it != stacking.crend(); ++it) {
+        Toplevel *t = (*it);
+        if (t->isDeleted()) {
+            // a deleted window doesn't get mouse events
+            continue;
+        }
+        if (AbstractClient *c = qobject_cast<AbstractClient*>(t)) {
+            if (!c->isOnCurrentActivity() || !c->isOnCurrentDesktop() || c->isMinimized() || c->isHiddenInternal()) {
+                continue;
+            }
+        }
+        if (!t->readyForPainting()) {
+            continue;
+        }
+        if (isScreenLocked) {
+            if (!t->isLockScreen() && !t->isInputMethod()) {
+                continue;
+            }
+        }
+        m_inputCandidates.append(t);
+    }
+    m_inputCandidatesValid = true;
+    m_inputCandidatesScreenLocked = isScreenLocked;
 }
 
 class UserActivitySpy : public InputEventSpy
@@ -2586,6 +2653,13 @@ void InputRedirection::disableTouchpads()
     }
 }
 
+void InputRedirection::processPendingEvents()
+{
+    for (InputBackend *inputBackend : qAsConst(m_inputBackends)) {
+        inputBackend->processPendingEvents();
+    }
+}
+
 void InputRedirection::addInputBackend(InputBackend *inputBackend)
 {
     Q_ASSERT(!m_inputBackends.contains(inputBackend));
@@ -2695,35 +2769,12 @@ Toplevel *InputRedirection::findManagedToplevel(const QPoint &pos)
         return nullptr;
     }
     const bool isScreenLocked = waylandServer() && waylandServer()->isScreenLocked();
-    const QList<Toplevel *> &stacking = Workspace::self()->stackingOrder();
-    if (stacking.isEmpty()) {
-        return nullptr;
-    }
-    auto it = stacking.end();
-    do {
-        --it;
-        Toplevel *t = (*it);
-        if (t->isDeleted()) {
-            // a deleted window doesn't get mouse events
-            continue;
-        }
-        if (AbstractClient *c = dynamic_cast<AbstractClient*>(t)) {
-            if (!c->isOnCurrentActivity() || !c->isOnCurrentDesktop() || c->isMinimized() || c->isHiddenInternal()) {
-                continue;
-            }
-        }
-        if (!t->readyForPainting()) {
-            continue;
-        }
-        if (isScreenLocked) {
-            if (!t->isLockScreen() && !t->isInputMethod()) {
-                continue;
-            }
-        }
+    updateInputCandidates(isScreenLocked);
+    for (Toplevel *t : qAsConst(m_inputCandidates)) {
         if (t->hitTest(pos)) {
             return t;
         }
-    } while (it != stacking.begin());
+    }
     return nullptr;
 }
 
@@ -232,6 +232,12 @@ public:
     void enableTouchpads();
     void disableTouchpads();
 
+    /**
+     * Processes the input events that the input backends have already read but not
+     * dispatched yet, without waiting for the event loop to get to them.
+     */
+    void processPendingEvents();
+
 Q_SIGNALS:
     void deviceAdded(InputDevice *device);
     void deviceRemoved(InputDevice *device);
@@ -293,6 +299,9 @@ private:
     void updateLeds(LEDs leds);
     void updateAvailableInputDevices();
     void addInputBackend(InputBackend *inputBackend);
+    void watchInputCandidate(Toplevel *toplevel);
+    void invalidateInputCandidates();
+    void updateInputCandidates(bool isScreenLocked);
     KeyboardInputRedirection *m_keyboard;
     PointerInputRedirection *m_pointer;
     TabletInputRedirection *m_tablet;
@@ -317,6 +326,11 @@ private:
     bool m_hasTabletModeSwitch = false;
     bool m_touchpadsEnabled = true;
 
+    // Managed windows that can receive pointer input, topmost first
+    QVector<Toplevel *> m_inputCandidates;
+    bool m_inputCandidatesValid = false;
+    bool m_inputCandidatesScreenLocked = false;
+
     KWIN_SINGLETON(InputRedirection)
     friend InputRedirection *input();
     friend class DecorationEventFilter;
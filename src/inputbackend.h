@@ -28,6 +28,10 @@ public:
     void setConfig(KSharedConfigPtr config);
 
     virtual void initialize() {}
+    /**
+     * Dispatches the events that have been read from the devices but not processed yet.
+     */
+    virtual void processPendingEvents() {}
 
 Q_SIGNALS:
     void deviceAdded(InputDevice *device);
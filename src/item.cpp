@@ -26,9 +26,9 @@ Item::Item(Item *parent)
 Item::~Item()
 {
     setParentItem(nullptr);
-    for (const auto &dirty : qAsConst(m_repaints)) {
-        if (!dirty.isEmpty()) {
-            Compositor::self()->scene()->addRepaint(dirty);
+    for (const OutputRepaints &dirty : qAsConst(m_repaints)) {
+        if (!dirty.region.isEmpty()) {
+            Compositor::self()->scene()->addRepaint(dirty.region);
         }
     }
 }
@@ -76,6 +76,7 @@ void Item::addChild(Item *item)
 
     m_childItems.append(item);
     markSortedChildItemsDirty();
+    markAllRepaintsPending();
 
     updateBoundingRect();
     scheduleRepaint(item->boundingRect().translated(item->position()));
@@ -92,7 +93,7 @@ void Item::removeChild(Item *item)
     updateBoundingRect();
 }
 
-QList<Item *> Item::childItems() const
+const QList<Item *> &Item::childItems() const
 {
     return m_childItems;
 }
@@ -261,12 +262,12 @@ void Item::scheduleRepaintInternal(const QRegion &region)
         for (const auto &output : outputs) {
             const QRegion dirtyRegion = globalRegion & output->geometry();
             if (!dirtyRegion.isEmpty()) {
-                m_repaints[output] += dirtyRegion;
+                addRepaints(output, dirtyRegion);
                 output->renderLoop()->scheduleRepaint(this);
             }
         }
     } else {
-        m_repaints[nullptr] += globalRegion;
+        addRepaints(nullptr, globalRegion);
         kwinApp()->platform()->renderLoop()->scheduleRepaint(this);
     }
 }
@@ -313,17 +314,82 @@ WindowQuadList Item::quads() const
 
 QRegion Item::repaints(AbstractOutput *output) const
 {
-    return m_repaints.value(output, QRect(QPoint(0, 0), screens()->size()));
+    for (const OutputRepaints &repaints : m_repaints) {
+        if (repaints.output == output) {
+            return repaints.region;
+        }
+    }
+    return QRect(QPoint(0, 0), screens()->size());
+}
+
+void Item::addRepaints(AbstractOutput *output, const QRegion &region)
+{
+    markRepaintsPending(output);
+    for (OutputRepaints &repaints : m_repaints) {
+        if (repaints.output == output) {
+            repaints.region += region;
+            return;
+        }
+    }
+    m_repaints.append(OutputRepaints{output, region});
 }
 
 void Item::resetRepaints(AbstractOutput *output)
 {
-    m_repaints.insert(output, QRegion());
+    auto it = std::find_if(m_repaints.begin(), m_repaints.end(), [output](const OutputRepaints &repaints) {
+        return repaints.output == output;
+    });
+    if (it != m_repaints.end()) {
+        it->region = QRegion();
+    } else {
+        m_repaints.append(OutputRepaints{output, QRegion()});
+    }
+
+    // The subtree is clean if none of the children has pending repaints. The children
+    // have to be reset before their parent for this to work.
+    if (!hasPendingRepaints(output)) {
+        return;
+    }
+    for (const Item *childItem : qAsConst(m_childItems)) {
+        if (childItem->hasPendingRepaints(output)) {
+            return;
+        }
+    }
+    m_cleanOutputs.append(output);
 }
 
 void Item::removeRepaints(AbstractOutput *output)
 {
-    m_repaints.remove(output);
+    for (int i = 0; i < m_repaints.count(); ++i) {
+        if (m_repaints[i].output == output) {
+            m_repaints.remove(i);
+            break;
+        }
+    }
+    markRepaintsPending(output);
+}
+
+bool Item::hasPendingRepaints(AbstractOutput *output) const
+{
+    return !m_cleanOutputs.contains(output);
+}
+
+void Item::markRepaintsPending(AbstractOutput *output)
+{
+    for (Item *item = this; item; item = item->m_parentItem) {
+        const int index = item->m_cleanOutputs.indexOf(output);
+        if (index == -1) {
+            break;
+        }
+        item->m_cleanOutputs.remove(index);
+    }
+}
+
+void Item::markAllRepaintsPending()
+{
+    for (Item *item = this; item && !item->m_cleanOutputs.isEmpty(); item = item->m_parentItem) {
+        item->m_cleanOutputs.clear();
+    }
 }
 
 bool Item::isVisible() const
@@ -11,6 +11,7 @@
 
 #include <QMatrix4x4>
 #include <QObject>
+#include <QVarLengthArray>
 
 #include <optional>
 
@@ -54,7 +55,7 @@ public:
      */
     Item *parentItem() const;
     void setParentItem(Item *parent);
-    QList<Item *> childItems() const;
+    const QList<Item *> &childItems() const;
     QList<Item *> sortedChildItems() const;
 
     QPoint rootPosition() const;
@@ -89,6 +90,12 @@ public:
     void scheduleFrame();
     QRegion repaints(AbstractOutput *output) const;
     void resetRepaints(AbstractOutput *output);
+    /**
+     * Returns @c true if this item or any of its descendants has repaints scheduled for the
+     * specified @a output. If it returns @c false, the whole subtree can be skipped when
+     * collecting repaints.
+     */
+    bool hasPendingRepaints(AbstractOutput *output) const;
 
     WindowQuadList quads() const;
     virtual void preprocess();
@@ -122,7 +129,10 @@ private:
 
     bool computeEffectiveVisibility() const;
     void updateEffectiveVisibility();
+    void addRepaints(AbstractOutput *output, const QRegion &region);
     void removeRepaints(AbstractOutput *output);
+    void markRepaintsPending(AbstractOutput *output);
+    void markAllRepaintsPending();
 
     QPointer<Item> m_parentItem;
     QList<Item *> m_childItems;
@@ -133,7 +143,14 @@ private:
     int m_z = 0;
     bool m_visible = true;
     bool m_effectiveVisible = true;
-    QMap<AbstractOutput *, QRegion> m_repaints;
+    struct OutputRepaints {
+        AbstractOutput *output;
+        QRegion region;
+    };
+    QVarLengthArray<OutputRepaints, 2> m_repaints;
+    // Outputs for which neither this item nor its descendants have pending repaints. An item's
+    // clean outputs are always a subset of the clean outputs of each of its children.
+    QVarLengthArray<AbstractOutput *, 2> m_cleanOutputs;
     mutable std::optional<WindowQuadList> m_quads;
     mutable std::optional<QList<Item *>> m_sortedChildItems;
 };
@@ -83,6 +83,7 @@
 #include "virtualdesktops.h"
 
 #include <array>
+#include <list>
 
 #include <QDebug>
 #include <QQueue>
@@ -509,6 +510,97 @@ static Layer computeLayer(const Toplevel *toplevel)
     }
 }
 
+namespace {
+
+/**
+ * Helper for applying the stacking order constraints. The windows are kept in a linked list
+ * and every window is assigned a monotonically increasing order key, so both checking whether
+ * a window is below another one and moving a window right above another one are constant time
+ * operations, unlike QList::indexOf() and QList::insert().
+ */
+class ConstrainedStackingList
+{
+public:
+    void reserve(int size)
+    {
+        m_index.reserve(size);
+    }
+
+    void append(Toplevel *window)
+    {
+        const quint64 key = m_nodes.empty() ? s_keySpacing : m_nodes.back().key + s_keySpacing;
+        m_nodes.push_back(Node{window, key});
+        m_index.insert(window, std::prev(m_nodes.end()));
+    }
+
+    bool contains(Toplevel *window) const
+    {
+        return m_index.contains(window);
+    }
+
+    /**
+     * Returns @c true if @p window is stacked below @p other. Both windows must be in the list.
+     */
+    bool isBelow(Toplevel *window, Toplevel *other) const
+    {
+        return m_index.value(window)->key < m_index.value(other)->key;
+    }
+
+    /**
+     * Moves @p window so it is stacked directly above @p below.
+     */
+    void moveAbove(Toplevel *window, Toplevel *below)
+    {
+        auto windowIt = m_index.value(window);
+        const auto belowIt = m_index.value(below);
+        m_nodes.erase(windowIt);
+
+        const auto nextIt = std::next(belowIt);
+        if (nextIt != m_nodes.end() && nextIt->key - belowIt->key < 2) {
+            relabel();
+        }
+        quint64 key;
+        if (nextIt == m_nodes.end()) {
+            key = belowIt->key + s_keySpacing;
+        } else {
+            key = belowIt->key + (nextIt->key - belowIt->key) / 2;
+        }
+        m_index.insert(window, m_nodes.insert(nextIt, Node{window, key}));
+    }
+
+    QList<Toplevel *> toList() const
+    {
+        QList<Toplevel *> ret;
+        ret.reserve(m_index.count());
+        for (const Node &node : m_nodes) {
+            ret.append(node.window);
+        }
+        return ret;
+    }
+
+private:
+    struct Node
+    {
+        Toplevel *window;
+        quint64 key;
+    };
+
+    void relabel()
+    {
+        quint64 key = 0;
+        for (Node &node : m_nodes) {
+            key += s_keySpacing;
+            node.key = key;
+        }
+    }
+
+    static constexpr quint64 s_keySpacing = quint64(1) << 32;
+    std::list<Node> m_nodes;
+    QHash<Toplevel *, std::list<Node>::iterator> m_index;
+};
+
+} // namespace
+
 /**
  * Returns a stacking order based upon \a list that fulfills certain contained.
  */
@@ -522,10 +614,21 @@ QList<Toplevel *> Workspace::constrainedStackingOrder()
         windows[layer] << window;
     }
 
-    QList<Toplevel *> stacking;
+    if (m_constraints.isEmpty()) {
+        QList<Toplevel *> stacking;
+        stacking.reserve(unconstrained_stacking_order.count());
+        for (uint layer = FirstLayer; layer < NumLayers; ++layer) {
+            stacking += windows[layer];
+        }
+        return stacking;
+    }
+
+    ConstrainedStackingList stacking;
     stacking.reserve(unconstrained_stacking_order.count());
     for (uint layer = FirstLayer; layer < NumLayers; ++layer) {
-        stacking += windows[layer];
+        for (Toplevel *window : qAsConst(windows[layer])) {
+            stacking.append(window);
+        }
     }
 
     // Apply the stacking order constraints. First, we enqueue the root constraints, i.e.
@@ -547,13 +650,10 @@ QList<Toplevel *> Workspace::constrainedStackingOrder()
     while (!constraints.isEmpty()) {
         Constraint *constraint = constraints.dequeue();
 
-        const int belowIndex = stacking.indexOf(constraint->below);
-        const int aboveIndex = stacking.indexOf(constraint->above);
-        if (belowIndex == -1 || aboveIndex == -1) {
+        if (!stacking.contains(constraint->below) || !stacking.contains(constraint->above)) {
             continue;
-        } else if (aboveIndex < belowIndex) {
-            stacking.removeAt(aboveIndex);
-            stacking.insert(belowIndex, constraint->above);
+        } else if (stacking.isBelow(constraint->above, constraint->below)) {
+            stacking.moveAbove(constraint->above, constraint->below);
         }
 
         for (Constraint *child : qAsConst(constraint->children)) {
@@ -564,7 +664,7 @@ QList<Toplevel *> Workspace::constrainedStackingOrder()
         }
     }
 
-    return stacking;
+    return stacking.toList();
 }
 
 void Workspace::blockStackingUpdates(bool block)
@@ -57,9 +57,53 @@ PreviousWindowPixmapLock::~PreviousWindowPixmapLock()
     effects->addRepaint(m_window->expandedGeometry());
 }
 
+EasingTable::EasingTable(const QEasingCurve &curve)
+    : m_curve(curve)
+{
+    for (int i = 0; i <= s_sampleCount; ++i) {
+        m_samples[i] = curve.valueForProgress(qreal(i) / s_sampleCount);
+    }
+}
+
+EasingTablePtr EasingTable::get(const QEasingCurve &curve)
+{
+    // Effects only use a handful of different curves, a plain list is good enough.
+    static QList<QWeakPointer<const EasingTable>> tables;
+
+    for (auto it = tables.begin(); it != tables.end();) {
+        EasingTablePtr table = it->toStrongRef();
+        if (!table) {
+            it = tables.erase(it);
+            continue;
+        }
+        if (table->curve() == curve) {
+            return table;
+        }
+        ++it;
+    }
+
+    EasingTablePtr table(new EasingTable(curve));
+    tables.append(table.toWeakRef());
+    return table;
+}
+
+const QEasingCurve &EasingTable::curve() const
+{
+    return m_curve;
+}
+
+float EasingTable::valueForProgress(float progress) const
+{
+    const float position = qBound(0.0f, progress, 1.0f) * s_sampleCount;
+    const int index = qMin(int(position), s_sampleCount - 1);
+    const float fraction = position - index;
+    return m_samples[index] + fraction * (m_samples[index + 1] - m_samples[index]);
+}
+
 AniData::AniData()
  : attribute(AnimationEffect::Opacity)
  , customCurve(0) // Linear
+ , value(0)
  , meta(0)
  , startTime(0)
  , waitAtSource(false)
@@ -75,6 +119,7 @@ AniData::AniData(AnimationEffect::Attribute a, int meta_, const FPx2 &to_,
  : attribute(a)
  , from(from_)
  , to(to_)
+ , value(0)
  , meta(meta_)
  , startTime(AnimationEffect::clock() + delay)
  , fullScreenEffectLock(std::move(fullScreenEffectLock_))
@@ -98,6 +143,16 @@ bool AniData::isActive() const
     return !(terminationFlags & AnimationEffect::TerminateAtTarget);
 }
 
+void AniData::updateValue()
+{
+    if (!easingTable) {
+        value = timeLine.value();
+        return;
+    }
+    const qreal progress = timeLine.progress();
+    value = easingTable->valueForProgress(timeLine.direction() == TimeLine::Backward ? 1.0 - progress : progress);
+}
+
 static QString attributeString(KWin::AnimationEffect::Attribute attribute)
 {
     switch (attribute) {
@@ -60,6 +60,30 @@ private:
 };
 typedef QSharedPointer<PreviousWindowPixmapLock> PreviousWindowPixmapLockPtr;
 
+/**
+ * Holds samples of an easing curve, so it can be evaluated without going through QEasingCurve.
+ *
+ * Tables are shared between all animations that use the same curve.
+ */
+class KWINEFFECTS_EXPORT EasingTable
+{
+public:
+    static QSharedPointer<const EasingTable> get(const QEasingCurve &curve);
+
+    const QEasingCurve &curve() const;
+    float valueForProgress(float progress) const;
+
+private:
+    explicit EasingTable(const QEasingCurve &curve);
+
+    static const int s_sampleCount = 1024;
+
+    QEasingCurve m_curve;
+    float m_samples[s_sampleCount + 1];
+    Q_DISABLE_COPY(EasingTable)
+};
+typedef QSharedPointer<const EasingTable> EasingTablePtr;
+
 class KWINEFFECTS_EXPORT AniData {
 public:
     AniData();
@@ -70,6 +94,12 @@ public:
 
     bool isActive() const;
 
+    /**
+     * Evaluates the easing curve at the current position of the timeline, the
+     * interpolations during painting use the cached value.
+     */
+    void updateValue();
+
     inline bool isOneDimensional() const {
         return from[0] == from[1] && to[0] == to[1];
     }
@@ -80,6 +110,8 @@ public:
     int customCurve;
     FPx2 from, to;
     TimeLine timeLine;
+    EasingTablePtr easingTable;
+    float value;
     uint meta;
     qint64 startTime;
     QSharedPointer<FullScreenEffectLock> fullScreenEffectLock;
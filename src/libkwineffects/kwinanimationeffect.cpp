@@ -253,6 +253,7 @@ quint64 AnimationEffect::p_animate( EffectWindow *w, Attribute a, uint meta, int
     animation.timeLine.setDirection(TimeLine::Forward);
     animation.timeLine.setDuration(std::chrono::milliseconds(ms));
     animation.timeLine.setEasingCurve(curve);
+    animation.easingTable = EasingTable::get(curve);
     animation.timeLine.setSourceRedirectMode(TimeLine::RedirectMode::Strict);
     animation.timeLine.setTargetRedirectMode(TimeLine::RedirectMode::Relaxed);
 
@@ -260,6 +261,7 @@ quint64 AnimationEffect::p_animate( EffectWindow *w, Attribute a, uint meta, int
     if (!keepAtTarget) {
         animation.terminationFlags |= TerminateAtTarget;
     }
+    animation.updateValue();
 
     it->second = QRect();
 
@@ -294,6 +296,7 @@ bool AnimationEffect::retarget(quint64 animationId, FPx2 newTarget, int newRemai
                 anim->timeLine.setDirection(TimeLine::Forward);
                 anim->timeLine.setDuration(std::chrono::milliseconds(newRemainingTime));
                 anim->timeLine.reset();
+                anim->updateValue();
 
                 return true;
             }
@@ -331,6 +334,7 @@ bool AnimationEffect::redirect(quint64 animationId, Direction direction, Termina
         }
 
         animIt->terminationFlags = terminationFlags & ~TerminateAtTarget;
+        animIt->updateValue();
 
         return true;
     }
@@ -357,6 +361,7 @@ bool AnimationEffect::complete(quint64 animationId)
         }
 
         animIt->timeLine.setElapsed(animIt->timeLine.duration());
+        animIt->updateValue();
 
         return true;
     }
@@ -394,11 +399,15 @@ void AnimationEffect::prePaintScreen( ScreenPrePaintData& data, std::chrono::mil
         return;
     }
 
+    // Advance all timelines and evaluate their easing curves once per frame, the window
+    // paint passes only read the cached values.
+    const qint64 now = clock();
     for (auto entry = d->m_animations.begin(); entry != d->m_animations.end(); ++entry) {
         for (auto anim = entry->first.begin(); anim != entry->first.end(); ++anim) {
-            if (anim->startTime <= clock()) {
+            if (anim->startTime <= now) {
                 if (anim->lastPresentTime.count()) {
                     anim->timeLine.update(presentTime - anim->lastPresentTime);
+                    anim->updateValue();
                 }
                 anim->lastPresentTime = presentTime;
             }
@@ -682,12 +691,12 @@ void AnimationEffect::postPaintScreen()
 
 float AnimationEffect::interpolated( const AniData &a, int i ) const
 {
-    return a.from[i] + a.timeLine.value() * (a.to[i] - a.from[i]);
+    return a.from[i] + a.value * (a.to[i] - a.from[i]);
 }
 
 float AnimationEffect::progress( const AniData &a ) const
 {
-    return a.startTime < clock() ? a.timeLine.value() : 0.0;
+    return a.startTime < clock() ? a.value : 0.0;
 }
 
 
@@ -769,7 +778,7 @@ void AnimationEffect::triggerRepaint()
 
 static float fixOvershoot(float f, const AniData &d, short int dir, float s = 1.1)
 {
-    switch(d.timeLine.easingCurve().type()) {
+    switch(d.easingTable->curve().type()) {
         case QEasingCurve::InOutElastic:
         case QEasingCurve::InOutBack:
             return f * s;
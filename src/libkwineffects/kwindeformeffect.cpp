@@ -11,24 +11,147 @@
 namespace KWin
 {
 
-struct DeformOffscreenData
+struct DeformOffscreenTexture
 {
     QScopedPointer<GLTexture> texture;
     QScopedPointer<GLRenderTarget> renderTarget;
+};
+
+/**
+ * The DeformTexturePool class keeps the offscreen textures of unredirected windows around
+ * so they can be reused by other windows, it is shared by all deform effects.
+ *
+ * Texture sizes are rounded up so windows of similar sizes can share textures. Idle textures
+ * are evicted in least recently used order once they exceed the budget, which can be set in
+ * MiB with the KWIN_DEFORM_TEXTURE_POOL_BUDGET environment variable.
+ */
+class DeformTexturePool
+{
+public:
+    DeformTexturePool();
+    ~DeformTexturePool();
+
+    static QSharedPointer<DeformTexturePool> instance();
+
+    DeformOffscreenTexture *acquire(const QSize &size);
+    void release(DeformOffscreenTexture *texture);
+
+    QSize bucketSize(const QSize &size) const;
+
+private:
+    static qint64 byteCount(const DeformOffscreenTexture *texture);
+
+    QList<DeformOffscreenTexture *> m_idleTextures; // most recently released first
+    qint64 m_idleBytes = 0;
+    qint64 m_budget;
+    GLint m_maxTextureSize = 0;
+};
+
+DeformTexturePool::DeformTexturePool()
+{
+    bool ok = false;
+    const int budget = qEnvironmentVariableIntValue("KWIN_DEFORM_TEXTURE_POOL_BUDGET", &ok);
+    m_budget = qint64(ok ? qMax(budget, 0) : 64) * 1024 * 1024;
+}
+
+DeformTexturePool::~DeformTexturePool()
+{
+    qDeleteAll(m_idleTextures);
+}
+
+QSharedPointer<DeformTexturePool> DeformTexturePool::instance()
+{
+    // The pool lives as long as there is a deform effect, so the textures are gone
+    // by the time the OpenGL context is destroyed.
+    static QWeakPointer<DeformTexturePool> pool;
+
+    QSharedPointer<DeformTexturePool> ret = pool.toStrongRef();
+    if (!ret) {
+        ret.reset(new DeformTexturePool);
+        pool = ret;
+    }
+    return ret;
+}
+
+QSize DeformTexturePool::bucketSize(const QSize &size) const
+{
+    Q_ASSERT(m_maxTextureSize);
+    const int granularity = 64;
+    const auto roundUp = [this, granularity](int value) {
+        const int rounded = (value + granularity - 1) / granularity * granularity;
+        return qMax(value, qMin(rounded, int(m_maxTextureSize)));
+    };
+    return QSize(roundUp(size.width()), roundUp(size.height()));
+}
+
+qint64 DeformTexturePool::byteCount(const DeformOffscreenTexture *texture)
+{
+    return qint64(texture->texture->width()) * texture->texture->height() * 4;
+}
+
+DeformOffscreenTexture *DeformTexturePool::acquire(const QSize &size)
+{
+    // The pool can be created outside of painting, when no OpenGL context is current.
+    if (!m_maxTextureSize) {
+        glGetIntegerv(GL_MAX_TEXTURE_SIZE, &m_maxTextureSize);
+    }
+
+    const QSize bucket = bucketSize(size);
+
+    for (auto it = m_idleTextures.begin(); it != m_idleTextures.end(); ++it) {
+        if ((*it)->texture->size() == bucket) {
+            DeformOffscreenTexture *texture = *it;
+            m_idleTextures.erase(it);
+            m_idleBytes -= byteCount(texture);
+            return texture;
+        }
+    }
+
+    DeformOffscreenTexture *texture = new DeformOffscreenTexture;
+    texture->texture.reset(new GLTexture(GL_RGBA8, bucket));
+    texture->texture->setFilter(GL_LINEAR);
+    texture->texture->setWrapMode(GL_CLAMP_TO_EDGE);
+    texture->renderTarget.reset(new GLRenderTarget(*texture->texture));
+    return texture;
+}
+
+void DeformTexturePool::release(DeformOffscreenTexture *texture)
+{
+    if (!texture) {
+        return;
+    }
+
+    m_idleTextures.prepend(texture);
+    m_idleBytes += byteCount(texture);
+
+    while (m_idleBytes > m_budget) {
+        DeformOffscreenTexture *evicted = m_idleTextures.takeLast();
+        m_idleBytes -= byteCount(evicted);
+        delete evicted;
+    }
+}
+
+struct DeformOffscreenData
+{
+    DeformOffscreenTexture *texture = nullptr;
+    QSize size;
+    QRegion damage;
     bool isDirty = true;
 };
 
 class DeformEffectPrivate
 {
 public:
+    QSharedPointer<DeformTexturePool> pool;
     QHash<EffectWindow *, DeformOffscreenData *> windows;
     QMetaObject::Connection windowDamagedConnection;
     QMetaObject::Connection windowDeletedConnection;
 
-    void paint(EffectWindow *window, GLTexture *texture, const QRegion &region,
-               const WindowPaintData &data, const WindowQuadList &quads);
+    void paint(EffectWindow *window, GLTexture *texture, const QMatrix4x4 &textureMatrix, const QRegion &region,
+               const WindowPaintData &data, const WindowQuadList &quads, GLShader *shader);
 
     GLTexture *maybeRender(EffectWindow *window, DeformOffscreenData *offscreenData);
+    void release(DeformOffscreenData *offscreenData);
 };
 
 DeformEffect::DeformEffect(QObject *parent)
@@ -39,7 +162,9 @@ DeformEffect::DeformEffect(QObject *parent)
 
 DeformEffect::~DeformEffect()
 {
-    qDeleteAll(d->windows);
+    for (DeformOffscreenData *offscreenData : qAsConst(d->windows)) {
+        d->release(offscreenData);
+    }
 }
 
 bool DeformEffect::supported()
@@ -58,11 +183,14 @@ void DeformEffect::redirect(EffectWindow *window)
     if (d->windows.count() == 1) {
         setupConnections();
     }
+    if (!d->pool) {
+        d->pool = DeformTexturePool::instance();
+    }
 }
 
 void DeformEffect::unredirect(EffectWindow *window)
 {
-    delete d->windows.take(window);
+    d->release(d->windows.take(window));
     if (d->windows.isEmpty()) {
         destroyConnections();
     }
@@ -76,25 +204,60 @@ void DeformEffect::deform(EffectWindow *window, int mask, WindowPaintData &data,
     Q_UNUSED(quads)
 }
 
+GLShader *DeformEffect::deformShader(EffectWindow *window, int mask, const WindowPaintData &data)
+{
+    Q_UNUSED(window)
+    Q_UNUSED(mask)
+    Q_UNUSED(data)
+    return nullptr;
+}
+
+void DeformEffectPrivate::release(DeformOffscreenData *offscreenData)
+{
+    if (offscreenData) {
+        pool->release(offscreenData->texture);
+        delete offscreenData;
+    }
+}
+
 GLTexture *DeformEffectPrivate::maybeRender(EffectWindow *window, DeformOffscreenData *offscreenData)
 {
     const QRect geometry = window->expandedGeometry();
-    QSize textureSize = geometry.size();
-
+    qreal devicePixelRatio = 1;
     if (const EffectScreen *screen = window->screen()) {
-        textureSize *= screen->devicePixelRatio();
+        devicePixelRatio = screen->devicePixelRatio();
     }
-
-    if (!offscreenData->texture || offscreenData->texture->size() != textureSize) {
-        offscreenData->texture.reset(new GLTexture(GL_RGBA8, textureSize));
-        offscreenData->texture->setFilter(GL_LINEAR);
-        offscreenData->texture->setWrapMode(GL_CLAMP_TO_EDGE);
-        offscreenData->renderTarget.reset(new GLRenderTarget(*offscreenData->texture));
+    const QSize textureSize = geometry.size() * devicePixelRatio;
+
+    if (offscreenData->size != textureSize) {
+        if (!offscreenData->texture || offscreenData->texture->texture->size() != pool->bucketSize(textureSize)) {
+            pool->release(offscreenData->texture);
+            offscreenData->texture = pool->acquire(textureSize);
+        }
+        offscreenData->size = textureSize;
         offscreenData->isDirty = true;
     }
 
-    if (offscreenData->isDirty) {
-        GLRenderTarget::pushRenderTarget(offscreenData->renderTarget.data());
+    // Only the damaged part of the window has to be painted again if the contents are still there.
+    QRect dirtyRect;
+    if (!offscreenData->isDirty) {
+        if (offscreenData->damage.isEmpty()) {
+            return offscreenData->texture->texture.data();
+        }
+        const QRectF damage = offscreenData->damage.boundingRect();
+        dirtyRect = QRectF(damage.topLeft() * devicePixelRatio, damage.size() * devicePixelRatio).toAlignedRect();
+        dirtyRect &= QRect(QPoint(0, 0), textureSize);
+    }
+    offscreenData->damage = QRegion();
+
+    if (offscreenData->isDirty || !dirtyRect.isEmpty()) {
+        GLRenderTarget::pushRenderTarget(offscreenData->texture->renderTarget.data());
+        glViewport(0, 0, textureSize.width(), textureSize.height());
+        if (!offscreenData->isDirty) {
+            glEnable(GL_SCISSOR_TEST);
+            glScissor(dirtyRect.x(), textureSize.height() - dirtyRect.y() - dirtyRect.height(),
+                      dirtyRect.width(), dirtyRect.height());
+        }
         glClearColor(0.0, 0.0, 0.0, 0.0);
         glClear(GL_COLOR_BUFFER_BIT);
 
@@ -110,18 +273,21 @@ GLTexture *DeformEffectPrivate::maybeRender(EffectWindow *window, DeformOffscree
         const int mask = Effect::PAINT_WINDOW_TRANSFORMED | Effect::PAINT_WINDOW_TRANSLUCENT;
         effects->drawWindow(window, mask, infiniteRegion(), data);
 
+        glDisable(GL_SCISSOR_TEST);
         GLRenderTarget::popRenderTarget();
         offscreenData->isDirty = false;
     }
 
-    return offscreenData->texture.data();
+    return offscreenData->texture->texture.data();
 }
 
-void DeformEffectPrivate::paint(EffectWindow *window, GLTexture *texture, const QRegion &region,
-                                const WindowPaintData &data, const WindowQuadList &quads)
+void DeformEffectPrivate::paint(EffectWindow *window, GLTexture *texture, const QMatrix4x4 &textureMatrix, const QRegion &region,
+                                const WindowPaintData &data, const WindowQuadList &quads, GLShader *shader)
 {
-    ShaderBinder binder(ShaderTrait::MapTexture | ShaderTrait::Modulate | ShaderTrait::AdjustSaturation);
-    GLShader *shader = binder.shader();
+    if (!shader) {
+        shader = ShaderManager::instance()->shader(ShaderTrait::MapTexture | ShaderTrait::Modulate | ShaderTrait::AdjustSaturation);
+    }
+    ShaderBinder binder(shader);
 
     const bool indexedQuads = GLVertexBuffer::supportsIndexedQuads();
     const GLenum primitiveType = indexedQuads ? GL_QUADS : GL_TRIANGLES;
@@ -138,7 +304,7 @@ void DeformEffectPrivate::paint(EffectWindow *window, GLTexture *texture, const
     const size_t size = verticesPerQuad * quads.count() * sizeof(GLVertex2D);
     GLVertex2D *map = static_cast<GLVertex2D *>(vbo->map(size));
 
-    quads.makeInterleavedArrays(primitiveType, map, texture->matrix(NormalizedCoordinates));
+    quads.makeInterleavedArrays(primitiveType, map, textureMatrix);
     vbo->unmap();
     vbo->bindArrays();
     glEnable(GL_SCISSOR_TEST);
@@ -187,14 +353,25 @@ void DeformEffect::drawWindow(EffectWindow *window, int mask, const QRegion& reg
     deform(window, mask, data, quads);
 
     GLTexture *texture = d->maybeRender(window, offscreenData);
-    d->paint(window, texture, region, data, quads);
+
+    // The window covers only part of the pooled texture. The texture coordinates are inset
+    // by half a texel, so the cleared padding doesn't bleed into the edges of the window.
+    const QSize size = offscreenData->size;
+    QMatrix4x4 textureMatrix;
+    textureMatrix.translate(0.5 / texture->width(), 0.5 / texture->height());
+    textureMatrix.scale(qreal(size.width() - 1) / texture->width(),
+                        qreal(size.height() - 1) / texture->height());
+    textureMatrix *= texture->matrix(NormalizedCoordinates);
+
+    d->paint(window, texture, textureMatrix, region, data, quads, deformShader(window, mask, data));
 }
 
-void DeformEffect::handleWindowDamaged(EffectWindow *window)
+void DeformEffect::handleWindowDamaged(EffectWindow *window, const QRegion &region)
 {
     DeformOffscreenData *offscreenData = d->windows.value(window);
     if (offscreenData) {
-        offscreenData->isDirty = true;
+        const QRect geometry = window->expandedGeometry();
+        offscreenData->damage += (region & geometry).translated(-geometry.topLeft());
     }
 }
 
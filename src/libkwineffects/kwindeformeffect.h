@@ -12,12 +12,15 @@ namespace KWin
 {
 
 class DeformEffectPrivate;
+class GLShader;
 
 /**
  * The DeformEffect class is the base class for effects that paint deformed windows.
  *
  * Under the hood, the DeformEffect will paint the window into an offscreen texture,
- * which will be mapped onto transformed window quad grid later on.
+ * which will be mapped onto transformed window quad grid later on. The offscreen textures
+ * are taken from a pool shared by all deform effects, and only the damaged parts of a
+ * window are painted again.
  *
  * The redirect() function must be called when the effect wants to transform a window.
  * Once the effect is no longer interested in the window, the unredirect() function
@@ -56,9 +59,21 @@ protected:
      * Override this function to transform the window quad grid of the given window.
      */
     virtual void deform(EffectWindow *window, int mask, WindowPaintData &data, WindowQuadList &quads);
+    /**
+     * Override this function to deform the given window in a vertex shader rather than
+     * by transforming the window quads on the CPU. It is called after deform().
+     *
+     * The returned shader must accept the same uniforms as the shader generated with the
+     * MapTexture, Modulate, and AdjustSaturation traits. Uniforms that are specific to the
+     * effect can be set in this function by binding the shader temporarily.
+     *
+     * The default implementation returns @c nullptr, the window quads are painted with
+     * the default shader.
+     */
+    virtual GLShader *deformShader(EffectWindow *window, int mask, const WindowPaintData &data);
 
 private Q_SLOTS:
-    void handleWindowDamaged(EffectWindow *window);
+    void handleWindowDamaged(EffectWindow *window, const QRegion &region);
     void handleWindowDeleted(EffectWindow *window);
 
 private:
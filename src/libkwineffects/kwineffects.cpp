@@ -20,12 +20,15 @@
 #include <QPainter>
 #include <QPixmap>
 #include <QtMath>
+#include <QVarLengthArray>
 
 #include <ksharedconfig.h>
 #include <kconfiggroup.h>
 
 #if defined(__SSE2__)
 #  include <emmintrin.h>
+#elif defined(__aarch64__)
+#  include <arm_neon.h>
 #endif
 
 
@@ -839,19 +842,81 @@ EffectWindowGroup::~EffectWindowGroup()
  WindowQuad
 ***************************************************************/
 
+namespace
+{
+
+/**
+ * Interpolates the texture coordinates of a quad bilinearly. Both texture coordinates
+ * are interpolated at once if SSE2 or NEON is available.
+ */
+class TexCoordInterpolator
+{
+public:
+    explicit TexCoordInterpolator(const WindowQuad &quad)
+    {
+        for (int i = 0; i < 4; ++i) {
+#if defined(__SSE2__)
+            m_corners[i] = _mm_set_pd(quad[i].v(), quad[i].u());
+#elif defined(__aarch64__)
+            const double uv[] = { quad[i].u(), quad[i].v() };
+            m_corners[i] = vld1q_f64(uv);
+#else
+            m_u[i] = quad[i].u();
+            m_v[i] = quad[i].v();
+#endif
+        }
+    }
+
+    /**
+     * Returns the vertex at @a x, @a y. @a w1 and @a w2 are the relative position of the
+     * vertex inside the quad.
+     */
+    WindowVertex vertex(double x, double y, double w1, double w2) const
+    {
+        const double c0 = (1 - w1) * (1 - w2);
+        const double c1 = w1 * (1 - w2);
+        const double c2 = w1 * w2;
+        const double c3 = (1 - w1) * w2;
+
+#if defined(__SSE2__)
+        __m128d uv = _mm_mul_pd(_mm_set1_pd(c0), m_corners[0]);
+        uv = _mm_add_pd(uv, _mm_mul_pd(_mm_set1_pd(c1), m_corners[1]));
+        uv = _mm_add_pd(uv, _mm_mul_pd(_mm_set1_pd(c2), m_corners[2]));
+        uv = _mm_add_pd(uv, _mm_mul_pd(_mm_set1_pd(c3), m_corners[3]));
+
+        double result[2];
+        _mm_storeu_pd(result, uv);
+        return WindowVertex(x, y, result[0], result[1]);
+#elif defined(__aarch64__)
+        float64x2_t uv = vmulq_n_f64(m_corners[0], c0);
+        uv = vaddq_f64(uv, vmulq_n_f64(m_corners[1], c1));
+        uv = vaddq_f64(uv, vmulq_n_f64(m_corners[2], c2));
+        uv = vaddq_f64(uv, vmulq_n_f64(m_corners[3], c3));
+
+        return WindowVertex(x, y, vgetq_lane_f64(uv, 0), vgetq_lane_f64(uv, 1));
+#else
+        return WindowVertex(x, y,
+                            c0 * m_u[0] + c1 * m_u[1] + c2 * m_u[2] + c3 * m_u[3],
+                            c0 * m_v[0] + c1 * m_v[1] + c2 * m_v[2] + c3 * m_v[3]);
+#endif
+    }
+
+private:
+#if defined(__SSE2__)
+    __m128d m_corners[4];
+#elif defined(__aarch64__)
+    float64x2_t m_corners[4];
+#else
+    double m_u[4];
+    double m_v[4];
+#endif
+};
+
+} // namespace
+
 WindowQuad WindowQuad::makeSubQuad(double x1, double y1, double x2, double y2) const
 {
     Q_ASSERT(x1 < x2 && y1 < y2 && x1 >= left() && x2 <= right() && y1 >= top() && y2 <= bottom());
-    WindowQuad ret(*this);
-    // vertices are clockwise starting from topleft
-    ret.verts[ 0 ].px = x1;
-    ret.verts[ 3 ].px = x1;
-    ret.verts[ 1 ].px = x2;
-    ret.verts[ 2 ].px = x2;
-    ret.verts[ 0 ].py = y1;
-    ret.verts[ 1 ].py = y1;
-    ret.verts[ 2 ].py = y2;
-    ret.verts[ 3 ].py = y2;
 
     const double xOrigin = left();
     const double yOrigin = top();
@@ -859,19 +924,16 @@ WindowQuad WindowQuad::makeSubQuad(double x1, double y1, double x2, double y2) c
     const double widthReciprocal  = 1 / (right() - xOrigin);
     const double heightReciprocal = 1 / (bottom() - yOrigin);
 
-    for (int i = 0; i < 4; ++i) {
-        const double w1 = (ret.verts[i].px - xOrigin) * widthReciprocal;
-        const double w2 = (ret.verts[i].py - yOrigin) * heightReciprocal;
-
-        // Use bilinear interpolation to compute the texture coords.
-        ret.verts[i].tx = (1 - w1) * (1 - w2) * verts[0].tx +
-                w1 * (1 - w2) * verts[1].tx +
-                w1 * w2 * verts[2].tx + (1 - w1) * w2 * verts[3].tx;
-        ret.verts[i].ty = (1 - w1) * (1 - w2) * verts[0].ty +
-                w1 * (1 - w2) * verts[1].ty +
-                w1 * w2 * verts[2].ty + (1 - w1) * w2 * verts[3].ty;
-    }
+    const double w1[] = { (x1 - xOrigin) * widthReciprocal, (x2 - xOrigin) * widthReciprocal };
+    const double w2[] = { (y1 - yOrigin) * heightReciprocal, (y2 - yOrigin) * heightReciprocal };
 
+    // vertices are clockwise starting from topleft
+    const TexCoordInterpolator interpolator(*this);
+    WindowQuad ret;
+    ret.verts[0] = interpolator.vertex(x1, y1, w1[0], w2[0]);
+    ret.verts[1] = interpolator.vertex(x2, y1, w1[1], w2[0]);
+    ret.verts[2] = interpolator.vertex(x2, y2, w1[1], w2[1]);
+    ret.verts[3] = interpolator.vertex(x1, y2, w1[0], w2[1]);
     return ret;
 }
 
@@ -937,6 +999,66 @@ WindowQuadList WindowQuadList::splitAtY(double y) const
     return ret;
 }
 
+typedef QVarLengthArray<double, 64> GridLines;
+
+/**
+ * Computes the grid lines that cut the range from @a low to @a high, starting at @a begin,
+ * as well as their relative positions in the range.
+ */
+static void makeGridLines(GridLines &lines, GridLines &weights, double begin, double increment, double low, double high)
+{
+    lines.append(qMax(begin, low));
+    for (double position = begin + increment; position < high; position += increment) {
+        lines.append(position);
+    }
+    lines.append(high);
+
+    const double reciprocal = 1 / (high - low);
+    weights.resize(lines.count());
+    for (int i = 0; i < lines.count(); ++i) {
+        weights[i] = (lines[i] - low) * reciprocal;
+    }
+}
+
+/**
+ * Splits the @a quad along the lines of a grid and appends the cells to @a quads. The grid
+ * lines and the weights of the grid points are computed once per quad rather than once per
+ * cell, neighbouring cells share the interpolated grid points.
+ */
+static void appendGridCells(WindowQuadList &quads, const WindowQuad &quad,
+                            double xBegin, double xIncrement, double yBegin, double yIncrement)
+{
+    GridLines xs, xWeights;
+    GridLines ys, yWeights;
+    makeGridLines(xs, xWeights, xBegin, xIncrement, quad.left(), quad.right());
+    makeGridLines(ys, yWeights, yBegin, yIncrement, quad.top(), quad.bottom());
+
+    const int columns = xs.count();
+    const int rows = ys.count();
+
+    const TexCoordInterpolator interpolator(quad);
+    QVarLengthArray<WindowVertex, 256> points(columns * rows);
+    for (int row = 0; row < rows; ++row) {
+        for (int column = 0; column < columns; ++column) {
+            points[row * columns + column] = interpolator.vertex(xs[column], ys[row], xWeights[column], yWeights[row]);
+        }
+    }
+
+    for (int row = 0; row < rows - 1; ++row) {
+        const WindowVertex *top = points.constData() + row * columns;
+        const WindowVertex *bottom = top + columns;
+        for (int column = 0; column < columns - 1; ++column) {
+            // vertices are clockwise starting from topleft
+            WindowQuad cell;
+            cell[0] = top[column];
+            cell[1] = top[column + 1];
+            cell[2] = bottom[column + 1];
+            cell[3] = bottom[column];
+            quads.append(cell);
+        }
+    }
+}
+
 WindowQuadList WindowQuadList::makeGrid(int maxQuadSize) const
 {
     if (empty())
@@ -956,6 +1078,7 @@ WindowQuadList WindowQuadList::makeGrid(int maxQuadSize) const
     }
 
     WindowQuadList ret;
+    ret.reserve(count() + qCeil((right - left) / maxQuadSize) * qCeil((bottom - top) / maxQuadSize));
 
     for (const WindowQuad &quad : qAsConst(*this)) {
         const double quadLeft   = quad.left();
@@ -973,18 +1096,7 @@ WindowQuadList WindowQuadList::makeGrid(int maxQuadSize) const
         const double xBegin = left + qFloor((quadLeft - left) / maxQuadSize) * maxQuadSize;
         const double yBegin = top  + qFloor((quadTop  - top)  / maxQuadSize) * maxQuadSize;
 
-        // Loop over all intersecting cells and add sub-quads
-        for (double y = yBegin; y < quadBottom; y += maxQuadSize) {
-            const double y0 = qMax(y, quadTop);
-            const double y1 = qMin(quadBottom, y + maxQuadSize);
-
-            for (double x = xBegin; x < quadRight; x += maxQuadSize) {
-                const double x0 = qMax(x, quadLeft);
-                const double x1 = qMin(quadRight, x + maxQuadSize);
-
-                ret.append(quad.makeSubQuad(x0, y0, x1, y1));
-            }
-        }
+        appendGridCells(ret, quad, xBegin, maxQuadSize, yBegin, maxQuadSize);
     }
 
     return ret;
@@ -1012,6 +1124,7 @@ WindowQuadList WindowQuadList::makeRegularGrid(int xSubdivisions, int ySubdivisi
     double yIncrement = (bottom - top) / ySubdivisions;
 
     WindowQuadList ret;
+    ret.reserve(count() + xSubdivisions * ySubdivisions);
 
     for (const WindowQuad &quad : *this) {
         const double quadLeft   = quad.left();
@@ -1029,18 +1142,7 @@ WindowQuadList WindowQuadList::makeRegularGrid(int xSubdivisions, int ySubdivisi
         const double xBegin = left + qFloor((quadLeft - left) / xIncrement) * xIncrement;
         const double yBegin = top  + qFloor((quadTop  - top)  / yIncrement) * yIncrement;
 
-        // Loop over all intersecting cells and add sub-quads
-        for (double y = yBegin; y < quadBottom; y += yIncrement) {
-            const double y0 = qMax(y, quadTop);
-            const double y1 = qMin(quadBottom, y + yIncrement);
-
-            for (double x = xBegin; x < quadRight; x += xIncrement) {
-                const double x0 = qMax(x, quadLeft);
-                const double x1 = qMin(quadRight, x + xIncrement);
-
-                ret.append(quad.makeSubQuad(x0, y0, x1, y1));
-            }
-        }
+        appendGridCells(ret, quad, xBegin, xIncrement, yBegin, yIncrement);
     }
 
     return ret;
@@ -1054,116 +1156,140 @@ WindowQuadList WindowQuadList::makeRegularGrid(int xSubdivisions, int ySubdivisi
 #  define GL_QUADS          0x0007
 #endif
 
-void WindowQuadList::makeInterleavedArrays(unsigned int type, GLVertex2D *vertices, const QMatrix4x4 &textureMatrix) const
+namespace
 {
-    // Since we know that the texture matrix just scales and translates
-    // we can use this information to optimize the transformation
-    const QVector2D coeff(textureMatrix(0, 0), textureMatrix(1, 1));
-    const QVector2D offset(textureMatrix(0, 3), textureMatrix(1, 3));
 
-    GLVertex2D *vertex = vertices;
+/**
+ * Converts window vertices to GL vertices. The texture matrix is known to only scale and
+ * translate, so it is applied to the texture coordinates as a multiply-add. If SSE2 or NEON
+ * is available, each vertex is converted and stored with a few vector instructions.
+ */
+class VertexConverter
+{
+public:
+    explicit VertexConverter(const QMatrix4x4 &textureMatrix)
+    {
+#if defined(__SSE2__)
+        m_coeff = _mm_setr_ps(textureMatrix(0, 0), textureMatrix(1, 1), 0, 0);
+        m_offset = _mm_setr_ps(textureMatrix(0, 3), textureMatrix(1, 3), 0, 0);
+#elif defined(__aarch64__)
+        const float coeff[] = { textureMatrix(0, 0), textureMatrix(1, 1) };
+        const float offset[] = { textureMatrix(0, 3), textureMatrix(1, 3) };
+        m_coeff = vld1_f32(coeff);
+        m_offset = vld1_f32(offset);
+#else
+        m_coeff = QVector2D(textureMatrix(0, 0), textureMatrix(1, 1));
+        m_offset = QVector2D(textureMatrix(0, 3), textureMatrix(1, 3));
+#endif
+    }
 
-    Q_ASSERT(type == GL_QUADS || type == GL_TRIANGLES);
+#if defined(__SSE2__)
+    typedef __m128 Vertex;
 
-    switch (type)
+    Vertex convert(const WindowVertex &wv) const
     {
-    case GL_QUADS:
-#if defined(__SSE2__)
-        if (!(intptr_t(vertex) & 0xf)) {
-            for (const WindowQuad &quad : *this) {
-                alignas(16) GLVertex2D v[4];
+        const __m128 position = _mm_cvtpd_ps(_mm_set_pd(wv.y(), wv.x()));
+        const __m128 texcoord = _mm_cvtpd_ps(_mm_set_pd(wv.v(), wv.u()));
+        return _mm_movelh_ps(position, _mm_add_ps(_mm_mul_ps(texcoord, m_coeff), m_offset));
+    }
 
-                for (int j = 0; j < 4; j++) {
-                    const WindowVertex &wv = quad[j];
+    static void store(GLVertex2D *dst, Vertex vertex, bool aligned)
+    {
+        // The vertices are written to a mapped buffer object and never read back.
+        if (aligned) {
+            _mm_stream_ps(reinterpret_cast<float *>(dst), vertex);
+        } else {
+            _mm_storeu_ps(reinterpret_cast<float *>(dst), vertex);
+        }
+    }
+#elif defined(__aarch64__)
+    typedef float32x4_t Vertex;
 
-                    v[j].position = QVector2D(wv.x(), wv.y());
-                    v[j].texcoord = QVector2D(wv.u(), wv.v()) * coeff + offset;
-                }
+    Vertex convert(const WindowVertex &wv) const
+    {
+        const double position[] = { wv.x(), wv.y() };
+        const double texcoord[] = { wv.u(), wv.v() };
+        const float32x2_t uv = vcvt_f32_f64(vld1q_f64(texcoord));
+        return vcombine_f32(vcvt_f32_f64(vld1q_f64(position)), vadd_f32(vmul_f32(uv, m_coeff), m_offset));
+    }
 
-                const __m128i *srcP = reinterpret_cast<const __m128i *>(&v);
-                __m128i *dstP = reinterpret_cast<__m128i *>(vertex);
+    static void store(GLVertex2D *dst, Vertex vertex, bool aligned)
+    {
+        Q_UNUSED(aligned)
+        vst1q_f32(reinterpret_cast<float *>(dst), vertex);
+    }
+#else
+    typedef GLVertex2D Vertex;
 
-                _mm_stream_si128(&dstP[0], _mm_load_si128(&srcP[0])); // Top-left
-                _mm_stream_si128(&dstP[1], _mm_load_si128(&srcP[1])); // Top-right
-                _mm_stream_si128(&dstP[2], _mm_load_si128(&srcP[2])); // Bottom-right
-                _mm_stream_si128(&dstP[3], _mm_load_si128(&srcP[3])); // Bottom-left
+    Vertex convert(const WindowVertex &wv) const
+    {
+        GLVertex2D v;
+        v.position = QVector2D(wv.x(), wv.y());
+        v.texcoord = QVector2D(wv.u(), wv.v()) * m_coeff + m_offset;
+        return v;
+    }
 
-                vertex += 4;
-            }
-        } else
-#endif // __SSE2__
-        {
-            for (const WindowQuad &quad : *this) {
-                for (int j = 0; j < 4; j++) {
-                    const WindowVertex &wv = quad[j];
-
-                    GLVertex2D v;
-                    v.position = QVector2D(wv.x(), wv.y());
-                    v.texcoord = QVector2D(wv.u(), wv.v()) * coeff + offset;
-
-                    *(vertex++) = v;
-                }
-            }
-        }
-        break;
+    static void store(GLVertex2D *dst, Vertex vertex, bool aligned)
+    {
+        Q_UNUSED(aligned)
+        *dst = vertex;
+    }
+#endif
 
-    case GL_TRIANGLES:
+private:
 #if defined(__SSE2__)
-        if (!(intptr_t(vertex) & 0xf)) {
-            for (const WindowQuad &quad : *this) {
-                alignas(16) GLVertex2D v[4];
-
-                for (int j = 0; j < 4; j++) {
-                    const WindowVertex &wv = quad[j];
+    __m128 m_coeff;
+    __m128 m_offset;
+#elif defined(__aarch64__)
+    float32x2_t m_coeff;
+    float32x2_t m_offset;
+#else
+    QVector2D m_coeff;
+    QVector2D m_offset;
+#endif
+};
 
-                    v[j].position = QVector2D(wv.x(), wv.y());
-                    v[j].texcoord = QVector2D(wv.u(), wv.v()) * coeff + offset;
-                }
+} // namespace
 
-                const __m128i *srcP = reinterpret_cast<const __m128i *>(&v);
-                __m128i *dstP = reinterpret_cast<__m128i *>(vertex);
+void WindowQuadList::makeInterleavedArrays(unsigned int type, GLVertex2D *vertices, const QMatrix4x4 &textureMatrix) const
+{
+    const VertexConverter converter(textureMatrix);
+    const bool aligned = !(intptr_t(vertices) & 0xf);
 
-                __m128i src[4];
-                src[0] = _mm_load_si128(&srcP[0]); // Top-left
-                src[1] = _mm_load_si128(&srcP[1]); // Top-right
-                src[2] = _mm_load_si128(&srcP[2]); // Bottom-right
-                src[3] = _mm_load_si128(&srcP[3]); // Bottom-left
+    GLVertex2D *vertex = vertices;
 
-                // First triangle
-                _mm_stream_si128(&dstP[0], src[1]); // Top-right
-                _mm_stream_si128(&dstP[1], src[0]); // Top-left
-                _mm_stream_si128(&dstP[2], src[3]); // Bottom-left
+    Q_ASSERT(type == GL_QUADS || type == GL_TRIANGLES);
 
-                // Second triangle
-                _mm_stream_si128(&dstP[3], src[3]); // Bottom-left
-                _mm_stream_si128(&dstP[4], src[2]); // Bottom-right
-                _mm_stream_si128(&dstP[5], src[1]); // Top-right
+    switch (type)
+    {
+    case GL_QUADS:
+        for (const WindowQuad &quad : *this) {
+            VertexConverter::store(vertex++, converter.convert(quad[0]), aligned); // Top-left
+            VertexConverter::store(vertex++, converter.convert(quad[1]), aligned); // Top-right
+            VertexConverter::store(vertex++, converter.convert(quad[2]), aligned); // Bottom-right
+            VertexConverter::store(vertex++, converter.convert(quad[3]), aligned); // Bottom-left
+        }
+        break;
 
-                vertex += 6;
-            }
-        } else
-#endif // __SSE2__
-        {
-            for (const WindowQuad &quad : *this) {
-                GLVertex2D v[4]; // Four unique vertices / quad
-
-                for (int j = 0; j < 4; j++) {
-                    const WindowVertex &wv = quad[j];
-
-                    v[j].position = QVector2D(wv.x(), wv.y());
-                    v[j].texcoord = QVector2D(wv.u(), wv.v()) * coeff + offset;
-                }
-
-                // First triangle
-                *(vertex++) = v[1]; // Top-right
-                *(vertex++) = v[0]; // Top-left
-                *(vertex++) = v[3]; // Bottom-left
-
-                // Second triangle
-                *(vertex++) = v[3]; // Bottom-left
-                *(vertex++) = v[2]; // Bottom-right
-                *(vertex++) = v[1]; // Top-right
-            }
+    case GL_TRIANGLES:
+        for (const WindowQuad &quad : *this) {
+            // Four unique vertices / quad
+            const VertexConverter::Vertex v[] = {
+                converter.convert(quad[0]), // Top-left
+                converter.convert(quad[1]), // Top-right
+                converter.convert(quad[2]), // Bottom-right
+                converter.convert(quad[3]), // Bottom-left
+            };
+
+            // First triangle
+            VertexConverter::store(vertex++, v[1], aligned); // Top-right
+            VertexConverter::store(vertex++, v[0], aligned); // Top-left
+            VertexConverter::store(vertex++, v[3], aligned); // Bottom-left
+
+            // Second triangle
+            VertexConverter::store(vertex++, v[3], aligned); // Bottom-left
+            VertexConverter::store(vertex++, v[2], aligned); // Bottom-right
+            VertexConverter::store(vertex++, v[1], aligned); // Top-right
         }
         break;
 
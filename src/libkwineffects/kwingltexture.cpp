@@ -16,6 +16,7 @@
 #include "kwinglutils.h"
 
 #include "kwingltexture_p.h"
+#include "logging_p.h"
 
 #include <QPixmap>
 #include <QImage>
@@ -23,6 +24,8 @@
 #include <QVector3D>
 #include <QVector4D>
 
+#include <deque>
+
 namespace KWin
 {
 
@@ -36,7 +39,13 @@ bool GLTexturePrivate::s_supportsUnpack = false;
 bool GLTexturePrivate::s_supportsTextureStorage = false;
 bool GLTexturePrivate::s_supportsTextureSwizzle = false;
 bool GLTexturePrivate::s_supportsTextureFormatRG = false;
+bool GLTexturePrivate::s_supportsPixelUnpackBuffer = false;
 uint GLTexturePrivate::s_fbo = 0;
+GLUploadBuffer *GLTexturePrivate::s_uploadBuffer = nullptr;
+
+// The maximum number of rects uploaded separately by GLTexture::update(QImage, QRegion),
+// regions with more rects are uploaded as their bounding rect.
+static const int s_maxUploadRects = 16;
 
 // Table of GL formats/types associated with different values of QImage::Format.
 // Zero values indicate a direct upload is not feasible.
@@ -75,6 +84,157 @@ struct {
     { GL_R8,       GL_RED,  GL_UNSIGNED_BYTE               }, // QImage::Format_Grayscale8
 };
 
+//****************************************
+// GLUploadBuffer
+//****************************************
+
+/**
+ * A pixel unpack buffer that streams texture data to the GPU.
+ *
+ * If buffer storage and sync objects are available, the buffer is mapped persistently and
+ * used as a ring; fences protect the ranges the GPU may still be reading from. Otherwise the
+ * buffer is orphaned and mapped again for every upload.
+ */
+class GLUploadBuffer
+{
+public:
+    explicit GLUploadBuffer(bool persistent);
+    ~GLUploadBuffer();
+
+    /**
+     * Binds the buffer and returns a pointer to @p size bytes of memory that can be written.
+     * The offset of the memory inside the buffer is returned in @p offset.
+     */
+    uint8_t *map(size_t size, intptr_t *offset);
+    /**
+     * Makes the data written since map() visible to the GPU. Uploads from the buffer must
+     * happen between unmap() and release().
+     */
+    void unmap();
+    /**
+     * Unbinds the buffer once the texture uploads that read from it have been issued.
+     */
+    void release();
+
+private:
+    struct Fence
+    {
+        GLsync sync;
+        quint64 start;
+    };
+
+    void reallocate(size_t size);
+
+    GLuint m_buffer = 0;
+    uint8_t *m_map = nullptr;
+    size_t m_size = 0;
+    quint64 m_position = 0;
+    quint64 m_batchStart = 0;
+    std::deque<Fence> m_fences;
+    const bool m_persistent;
+};
+
+GLUploadBuffer::GLUploadBuffer(bool persistent)
+    : m_persistent(persistent)
+{
+    glGenBuffers(1, &m_buffer);
+}
+
+GLUploadBuffer::~GLUploadBuffer()
+{
+    for (const Fence &fence : m_fences) {
+        glDeleteSync(fence.sync);
+    }
+    // This also unmaps the buffer
+    glDeleteBuffers(1, &m_buffer);
+}
+
+void GLUploadBuffer::reallocate(size_t size)
+{
+    // The old buffer remains alive until the GPU is done with it
+    for (const Fence &fence : m_fences) {
+        glDeleteSync(fence.sync);
+    }
+    m_fences.clear();
+    glDeleteBuffers(1, &m_buffer);
+    glGenBuffers(1, &m_buffer);
+
+    // Round the size up to 1 Mb, big enough for a few frames of typical damage
+    m_size = (qMax<size_t>(size, 4 * 1024 * 1024) + 0xfffff) & ~size_t(0xfffff);
+    m_position = 0;
+
+    const GLbitfield access = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_buffer);
+    glBufferStorage(GL_PIXEL_UNPACK_BUFFER, m_size, nullptr, access);
+    m_map = static_cast<uint8_t *>(glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, m_size, access));
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
+
+uint8_t *GLUploadBuffer::map(size_t size, intptr_t *offset)
+{
+    if (!m_persistent) {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_buffer);
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, size, nullptr, GL_STREAM_DRAW);
+        *offset = 0;
+        return static_cast<uint8_t *>(glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size,
+                                                       GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT));
+    }
+
+    if (size > m_size || !m_map) {
+        reallocate(size * 2);
+        if (!m_map) {
+            return nullptr;
+        }
+    }
+
+    // Handle wrap-around, the data of an upload has to be contiguous
+    quint64 position = m_position;
+    if (position % m_size + size > m_size) {
+        position += m_size - position % m_size;
+    }
+
+    // Wait until the GPU has finished reading the previous contents of the range
+    while (!m_fences.empty() && m_fences.front().start + m_size < position + size) {
+        const Fence &fence = m_fences.front();
+        const GLenum ret = glClientWaitSync(fence.sync, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+        if (ret == GL_TIMEOUT_EXPIRED || ret == GL_WAIT_FAILED) {
+            qCCritical(LIBKWINGLUTILS) << "Wait on texture upload fence failed";
+            return nullptr;
+        }
+        glDeleteSync(fence.sync);
+        m_fences.pop_front();
+    }
+
+    m_batchStart = position;
+    m_position = position + size;
+
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_buffer);
+    *offset = position % m_size;
+    return m_map + *offset;
+}
+
+void GLUploadBuffer::unmap()
+{
+    if (!m_persistent) {
+        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+    }
+}
+
+void GLUploadBuffer::release()
+{
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    if (m_persistent) {
+        Fence fence;
+        fence.sync = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        fence.start = m_batchStart;
+        m_fences.push_back(fence);
+    }
+}
+
+//****************************************
+// GLTexture
+//****************************************
+
 GLTexture::GLTexture(GLenum target)
     : d_ptr(new GLTexturePrivate())
 {
@@ -321,12 +481,33 @@ void GLTexturePrivate::initStatic()
 
         s_supportsUnpack = hasGLExtension(QByteArrayLiteral("GL_EXT_unpack_subimage"));
     }
+
+    bool haveBufferStorage;
+    bool haveSyncFences;
+    if (!GLPlatform::instance()->isGLES()) {
+        s_supportsPixelUnpackBuffer = hasGLVersion(3, 0) || (hasGLExtension(QByteArrayLiteral("GL_ARB_pixel_buffer_object"))
+                                                             && hasGLExtension(QByteArrayLiteral("GL_ARB_map_buffer_range")));
+        haveBufferStorage = hasGLVersion(4, 4) || hasGLExtension(QByteArrayLiteral("GL_ARB_buffer_storage"));
+        haveSyncFences = hasGLVersion(3, 2) || hasGLExtension(QByteArrayLiteral("GL_ARB_sync"));
+    } else {
+        s_supportsPixelUnpackBuffer = hasGLVersion(3, 0);
+        haveBufferStorage = hasGLExtension(QByteArrayLiteral("GL_EXT_buffer_storage"));
+        haveSyncFences = hasGLVersion(3, 0);
+    }
+    if (s_supportsPixelUnpackBuffer && qgetenv("KWIN_GL_UPLOAD_BUFFER") != QByteArrayLiteral("0")) {
+        const bool persistent = haveBufferStorage && haveSyncFences
+                && qgetenv("KWIN_PERSISTENT_UPLOAD_BUFFER") != QByteArrayLiteral("0");
+        s_uploadBuffer = new GLUploadBuffer(persistent);
+    }
 }
 
 void GLTexturePrivate::cleanup()
 {
     s_supportsFramebufferObjects = false;
     s_supportsARGB32 = false;
+    s_supportsPixelUnpackBuffer = false;
+    delete s_uploadBuffer;
+    s_uploadBuffer = nullptr;
     if (s_fbo) {
         glDeleteFramebuffers(1, &s_fbo);
         s_fbo = 0;
@@ -355,40 +536,45 @@ void GLTexture::setSize(const QSize &size)
     d->updateMatrix();
 }
 
-void GLTexture::update(const QImage &image, const QPoint &offset, const QRect &src)
+static void uploadFormatForImage(const QImage &image, GLenum *glFormat, GLenum *type, QImage::Format *uploadFormat)
 {
-    if (image.isNull() || isNull())
-        return;
-
-    Q_D(GLTexture);
-    Q_ASSERT(!d->m_foreign);
-
-    GLenum glFormat;
-    GLenum type;
-    QImage::Format uploadFormat;
     if (!GLPlatform::instance()->isGLES()) {
         const QImage::Format index = image.format();
 
         if (index < sizeof(formatTable) / sizeof(formatTable[0]) && formatTable[index].internalFormat) {
-            glFormat = formatTable[index].format;
-            type = formatTable[index].type;
-            uploadFormat = index;
+            *glFormat = formatTable[index].format;
+            *type = formatTable[index].type;
+            *uploadFormat = index;
         } else {
-            glFormat = GL_BGRA;
-            type = GL_UNSIGNED_INT_8_8_8_8_REV;
-            uploadFormat = QImage::Format_ARGB32_Premultiplied;
+            *glFormat = GL_BGRA;
+            *type = GL_UNSIGNED_INT_8_8_8_8_REV;
+            *uploadFormat = QImage::Format_ARGB32_Premultiplied;
         }
     } else {
-        if (d->s_supportsARGB32) {
-            glFormat = GL_BGRA_EXT;
-            type = GL_UNSIGNED_BYTE;
-            uploadFormat = QImage::Format_ARGB32_Premultiplied;
+        if (GLTexturePrivate::s_supportsARGB32) {
+            *glFormat = GL_BGRA_EXT;
+            *type = GL_UNSIGNED_BYTE;
+            *uploadFormat = QImage::Format_ARGB32_Premultiplied;
         } else {
-            glFormat = GL_RGBA;
-            type = GL_UNSIGNED_BYTE;
-            uploadFormat = QImage::Format_RGBA8888_Premultiplied;
+            *glFormat = GL_RGBA;
+            *type = GL_UNSIGNED_BYTE;
+            *uploadFormat = QImage::Format_RGBA8888_Premultiplied;
         }
     }
+}
+
+void GLTexture::update(const QImage &image, const QPoint &offset, const QRect &src)
+{
+    if (image.isNull() || isNull())
+        return;
+
+    Q_D(GLTexture);
+    Q_ASSERT(!d->m_foreign);
+
+    GLenum glFormat;
+    GLenum type;
+    QImage::Format uploadFormat;
+    uploadFormatForImage(image, &glFormat, &type, &uploadFormat);
     bool useUnpack = d->s_supportsUnpack && image.format() == uploadFormat && !src.isNull();
 
     QImage im;
@@ -429,6 +615,105 @@ void GLTexture::update(const QImage &image, const QPoint &offset, const QRect &s
     }
 }
 
+// Uploading a rect has a fixed cost, so when the rects of a region cover most of their bounding
+// rect, or when there are too many of them, the bounding rect is uploaded in one go instead.
+QRegion GLTexturePrivate::coalesceUploadRegion(const QRegion &region)
+{
+    if (region.rectCount() <= 1) {
+        return region;
+    }
+
+    const QRect bounds = region.boundingRect();
+    if (region.rectCount() > s_maxUploadRects) {
+        return bounds;
+    }
+
+    qint64 area = 0;
+    for (const QRect &rect : region) {
+        area += qint64(rect.width()) * rect.height();
+    }
+    if (area * 4 >= qint64(bounds.width()) * bounds.height() * 3) {
+        return bounds;
+    }
+    return region;
+}
+
+void GLTexture::update(const QImage &image, const QRegion &region)
+{
+    if (image.isNull() || isNull())
+        return;
+
+    Q_D(GLTexture);
+    Q_ASSERT(!d->m_foreign);
+
+    const QRegion uploadRegion = GLTexturePrivate::coalesceUploadRegion(region & QRect(QPoint(0, 0), image.size()));
+    if (uploadRegion.isEmpty()) {
+        return;
+    }
+
+    if (!d->s_uploadBuffer) {
+        for (const QRect &rect : uploadRegion) {
+            update(image, rect.topLeft(), rect);
+        }
+        return;
+    }
+
+    GLenum glFormat;
+    GLenum type;
+    QImage::Format uploadFormat;
+    uploadFormatForImage(image, &glFormat, &type, &uploadFormat);
+
+    // Rows are padded to 4 bytes, which matches the default GL_UNPACK_ALIGNMENT
+    const int bytesPerPixel = QImage::toPixelFormat(uploadFormat).bitsPerPixel() / 8;
+    size_t size = 0;
+    for (const QRect &rect : uploadRegion) {
+        size += size_t((rect.width() * bytesPerPixel + 3) & ~3) * rect.height();
+    }
+
+    intptr_t offset;
+    uint8_t *data = d->s_uploadBuffer->map(size, &offset);
+    if (!data) {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        for (const QRect &rect : uploadRegion) {
+            update(image, rect.topLeft(), rect);
+        }
+        return;
+    }
+
+    QVector<intptr_t> offsets;
+    offsets.reserve(uploadRegion.rectCount());
+    for (const QRect &rect : uploadRegion) {
+        const int stride = (rect.width() * bytesPerPixel + 3) & ~3;
+        offsets.append(offset);
+
+        if (image.format() == uploadFormat) {
+            for (int y = 0; y < rect.height(); ++y) {
+                memcpy(data + y * stride, image.constScanLine(rect.y() + y) + rect.x() * bytesPerPixel,
+                       rect.width() * bytesPerPixel);
+            }
+        } else {
+            const QImage converted = image.copy(rect).convertToFormat(uploadFormat);
+            for (int y = 0; y < rect.height(); ++y) {
+                memcpy(data + y * stride, converted.constScanLine(y), rect.width() * bytesPerPixel);
+            }
+        }
+
+        data += size_t(stride) * rect.height();
+        offset += intptr_t(stride) * rect.height();
+    }
+    d->s_uploadBuffer->unmap();
+
+    bind();
+    int i = 0;
+    for (const QRect &rect : uploadRegion) {
+        glTexSubImage2D(d->m_target, 0, rect.x(), rect.y(), rect.width(), rect.height(),
+                        glFormat, type, reinterpret_cast<const GLvoid *>(offsets[i++]));
+    }
+    unbind();
+
+    d->s_uploadBuffer->release();
+}
+
 void GLTexture::discard()
 {
     d_ptr = new GLTexturePrivate();
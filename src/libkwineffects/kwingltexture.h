@@ -100,6 +100,15 @@ public:
     QMatrix4x4 matrix(TextureCoordinateType type) const;
 
     void update(const QImage& image, const QPoint &offset = QPoint(0, 0), const QRect &src = QRect());
+    /**
+     * Uploads the given @p region of the @p image to the same position in the texture.
+     *
+     * Small or numerous rects are coalesced, and the pixels are streamed through a pixel
+     * unpack buffer if the platform supports it, so the upload doesn't block on the GPU.
+     *
+     * @since 5.24
+     */
+    void update(const QImage &image, const QRegion &region);
     virtual void discard();
     void bind();
     void unbind();
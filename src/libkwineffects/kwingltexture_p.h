@@ -16,6 +16,7 @@
 #include "kwinglutils.h"
 #include <kwinglutils_export.h>
 
+#include <QRegion>
 #include <QSize>
 #include <QSharedData>
 #include <QImage>
@@ -25,6 +26,7 @@
 namespace KWin
 {
 // forward declarations
+class GLUploadBuffer;
 class GLVertexBuffer;
 
 class KWINGLUTILS_EXPORT GLTexturePrivate
@@ -62,13 +64,20 @@ public:
 
     static void initStatic();
 
+    /**
+     * Returns the rects that GLTexture::update() uploads separately for the given @p region.
+     */
+    static QRegion coalesceUploadRegion(const QRegion &region);
+
     static bool s_supportsFramebufferObjects;
     static bool s_supportsARGB32;
     static bool s_supportsUnpack;
     static bool s_supportsTextureStorage;
     static bool s_supportsTextureSwizzle;
     static bool s_supportsTextureFormatRG;
+    static bool s_supportsPixelUnpackBuffer;
     static GLuint s_fbo;
+    static GLUploadBuffer *s_uploadBuffer;
 private:
     friend void KWin::cleanupGL();
     static void cleanup();
@@ -20,7 +20,13 @@
 #include <QPixmap>
 #include <QImage>
 #include <QHash>
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDir>
 #include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QStandardPaths>
 #include <QVector2D>
 #include <QVector3D>
 #include <QVector4D>
@@ -31,6 +37,9 @@
 #include <cmath>
 #include <deque>
 
+#include <fcntl.h>
+#include <sys/stat.h>
+
 #define DEBUG_GLRENDERTARGET 0
 
 #ifdef __GNUC__
@@ -616,6 +625,67 @@ void ShaderManager::cleanup()
     s_shaderManager = nullptr;
 }
 
+static bool supportsProgramBinaries()
+{
+    if (qEnvironmentVariableIsSet("KWIN_GL_NO_PROGRAM_CACHE")) {
+        return false;
+    }
+    bool supported;
+    if (GLPlatform::instance()->isGLES()) {
+        supported = hasGLVersion(3, 0) || hasGLExtension(QByteArrayLiteral("GL_OES_get_program_binary"));
+    } else {
+        supported = hasGLVersion(4, 1) || hasGLExtension(QByteArrayLiteral("GL_ARB_get_program_binary"));
+    }
+    if (!supported) {
+        return false;
+    }
+    // Some drivers advertise the extension without supporting any binary format
+    GLint formatCount = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formatCount);
+    return formatCount > 0;
+}
+
+// Program binaries are only valid for the exact driver that produced them, so every driver
+// gets its own cache directory. Several drivers can be in use at the same time, e.g. on
+// systems with more than one GPU or with nested sessions, so the directory of a driver is
+// only removed once no kwin instance has used it for a while.
+static QString programCachePath()
+{
+    const GLPlatform *platform = GLPlatform::instance();
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    hash.addData(platform->glVendorString());
+    hash.addData("\0", 1);
+    hash.addData(platform->glRendererString());
+    hash.addData("\0", 1);
+    hash.addData(platform->glVersionString());
+    const QString driver = QString::fromLatin1(hash.result().toHex());
+
+    QDir cacheDir(QStandardPaths::writableLocation(QStandardPaths::GenericCacheLocation)
+            + QStringLiteral("/kwin/programs"));
+    if (!cacheDir.mkpath(driver)) {
+        return QString();
+    }
+    const QString driverPath = cacheDir.absoluteFilePath(driver);
+
+    // Mark the directory of this driver as used.
+    utimensat(AT_FDCWD, QFile::encodeName(driverPath).constData(), nullptr, 0);
+
+    const QDateTime expiry = QDateTime::currentDateTimeUtc().addDays(-30);
+    const QFileInfoList entries = cacheDir.entryInfoList(QDir::AllEntries | QDir::NoDotAndDotDot | QDir::Hidden);
+    for (const QFileInfo &entry : entries) {
+        if (entry.fileName() == driver || entry.lastModified() >= expiry) {
+            continue;
+        }
+        if (entry.isDir()) {
+            QDir(entry.absoluteFilePath()).removeRecursively();
+        } else {
+            QFile::remove(entry.absoluteFilePath());
+        }
+    }
+
+    return driverPath + QLatin1Char('/');
+}
+
 ShaderManager::ShaderManager()
 {
     const qint64 coreVersionNumber = GLPlatform::instance()->isGLES() ? kVersionNumber(3, 0) : kVersionNumber(1, 40);
@@ -624,6 +694,10 @@ ShaderManager::ShaderManager()
     } else {
         m_resourcePath = QStringLiteral(":/effect-shaders-1.10/");
     }
+
+    if (supportsProgramBinaries()) {
+        m_programCachePath = programCachePath();
+    }
 }
 
 ShaderManager::~ShaderManager()
@@ -773,16 +847,99 @@ GLShader *ShaderManager::generateCustomShader(ShaderTraits traits, const QByteAr
 #endif
 
     GLShader *shader = new GLShader(GLShader::ExplicitLinking);
+
+    QByteArray cacheKey;
+    if (!m_programCachePath.isEmpty()) {
+        cacheKey = programCacheKey(vertex, fragment);
+        if (loadProgramBinary(shader, cacheKey)) {
+            return shader;
+        }
+    }
+
     shader->load(vertex, fragment);
 
     shader->bindAttributeLocation("position", VA_Position);
     shader->bindAttributeLocation("texcoord", VA_TexCoord);
     shader->bindFragDataLocation("fragColor", 0);
 
-    shader->link();
+    if (!cacheKey.isEmpty() && (!GLPlatform::instance()->isGLES() || hasGLVersion(3, 0))) {
+        glProgramParameteri(shader->mProgram, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    }
+
+    if (shader->link() && !cacheKey.isEmpty()) {
+        storeProgramBinary(shader, cacheKey);
+    }
     return shader;
 }
 
+QByteArray ShaderManager::programCacheKey(const QByteArray &vertexSource, const QByteArray &fragmentSource) const
+{
+    // The driver is already part of the cache path
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    hash.addData(vertexSource);
+    hash.addData("\0", 1);
+    hash.addData(fragmentSource);
+    return hash.result().toHex();
+}
+
+bool ShaderManager::loadProgramBinary(GLShader *shader, const QByteArray &key) const
+{
+    QFile file(m_programCachePath + QString::fromLatin1(key));
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+    const QByteArray data = file.readAll();
+    if (data.size() <= int(sizeof(GLenum))) {
+        file.remove();
+        return false;
+    }
+
+    GLenum format;
+    memcpy(&format, data.constData(), sizeof(format));
+    glProgramBinary(shader->mProgram, format, data.constData() + sizeof(format), data.size() - sizeof(format));
+
+    GLint status = 0;
+    glGetProgramiv(shader->mProgram, GL_LINK_STATUS, &status);
+    if (!status) {
+        // The driver rejects binaries from other driver builds, compile from source instead
+        qCDebug(LIBKWINGLUTILS) << "Discarding outdated program binary" << key;
+        file.remove();
+        glDeleteProgram(shader->mProgram);
+        shader->mProgram = glCreateProgram();
+        return false;
+    }
+
+    shader->mValid = true;
+    return true;
+}
+
+void ShaderManager::storeProgramBinary(GLShader *shader, const QByteArray &key) const
+{
+    GLint length = 0;
+    glGetProgramiv(shader->mProgram, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0) {
+        return;
+    }
+
+    QByteArray data(sizeof(GLenum) + length, Qt::Uninitialized);
+    GLenum format = 0;
+    glGetProgramBinary(shader->mProgram, length, &length, &format, data.data() + sizeof(GLenum));
+    if (length <= 0) {
+        return;
+    }
+    memcpy(data.data(), &format, sizeof(format));
+    data.resize(sizeof(GLenum) + length);
+
+    QSaveFile file(m_programCachePath + QString::fromLatin1(key));
+    if (!file.open(QIODevice::WriteOnly)) {
+        return;
+    }
+    file.write(data);
+    if (!file.commit()) {
+        qCDebug(LIBKWINGLUTILS) << "Failed to store program binary" << key;
+    }
+}
+
 GLShader *ShaderManager::generateShaderFromResources(ShaderTraits traits, const QString &vertexFile, const QString &fragmentFile)
 {
     auto loadShaderFile = [this] (const QString &fileName) {
@@ -304,9 +304,14 @@ private:
     QByteArray generateFragmentSource(ShaderTraits traits) const;
     GLShader *generateShader(ShaderTraits traits);
 
+    QByteArray programCacheKey(const QByteArray &vertexSource, const QByteArray &fragmentSource) const;
+    bool loadProgramBinary(GLShader *shader, const QByteArray &key) const;
+    void storeProgramBinary(GLShader *shader, const QByteArray &key) const;
+
     QStack<GLShader*> m_boundShaders;
     QHash<ShaderTraits, GLShader *> m_shaderHash;
     QString m_resourcePath;
+    QString m_programCachePath;
     static ShaderManager *s_shaderManager;
 };
 
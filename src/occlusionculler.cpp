@@ -0,0 +1,82 @@
+/*
+    KWin - the KDE window manager
+    This file is part of the KDE project.
+
+    SPDX-FileCopyrightText: 2006 Lubos Lunak <l.lunak@kde.org>
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#include "occlusionculler.h"
+
+#include <QVarLengthArray>
+
+#include <algorithm>
+#include <numeric>
+
+namespace KWin
+{
+
+OcclusionCuller::OcclusionCuller(const QRegion &area)
+    : m_uncovered(area)
+{
+}
+
+QRegion OcclusionCuller::occluded() const
+{
+    return m_occluded;
+}
+
+bool OcclusionCuller::isCovered() const
+{
+    return m_uncovered.isEmpty();
+}
+
+void OcclusionCuller::addOccluder(const QRegion &region)
+{
+    if (region.isEmpty() || isCovered()) {
+        return;
+    }
+    m_occluded += region;
+    m_uncovered -= region;
+}
+
+QRegion OcclusionCuller::visible(const QRegion &region) const
+{
+    if (isCovered()) {
+        return QRegion();
+    }
+    if (m_occluded.isEmpty()) {
+        return region;
+    }
+    return region - m_occluded;
+}
+
+QRegion OcclusionCuller::simplified(const QRegion &region, int maxRectCount)
+{
+    if (region.rectCount() <= maxRectCount) {
+        return region;
+    }
+
+    QVarLengthArray<QRect, 64> rects;
+    for (const QRect &rect : region) {
+        rects.append(rect);
+    }
+
+    // Pick the largest rectangles, but keep them in the y-x order of the region so
+    // they can be added to the result cheaply.
+    QVarLengthArray<int, 64> indices(rects.count());
+    std::iota(indices.begin(), indices.end(), 0);
+    std::nth_element(indices.begin(), indices.begin() + maxRectCount, indices.end(), [&rects](int a, int b) {
+        return rects[a].width() * rects[a].height() > rects[b].width() * rects[b].height();
+    });
+    std::sort(indices.begin(), indices.begin() + maxRectCount);
+
+    QRegion result;
+    for (int i = 0; i < maxRectCount; ++i) {
+        result += rects[indices[i]];
+    }
+    return result;
+}
+
+} // namespace KWin
@@ -0,0 +1,58 @@
+/*
+    KWin - the KDE window manager
+    This file is part of the KDE project.
+
+    SPDX-FileCopyrightText: 2006 Lubos Lunak <l.lunak@kde.org>
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#pragma once
+
+#include "kwinglobals.h"
+
+#include <QRegion>
+
+namespace KWin
+{
+
+/**
+ * The OcclusionCuller class tracks which parts of an area are hidden behind opaque windows.
+ *
+ * Occluders must be added from top to bottom. Once the whole area is covered, the windows
+ * below are culled without any further region arithmetic.
+ */
+class KWIN_EXPORT OcclusionCuller
+{
+public:
+    explicit OcclusionCuller(const QRegion &area);
+
+    /**
+     * Returns the union of all occluders added so far.
+     */
+    QRegion occluded() const;
+    /**
+     * Returns @c true if the whole area is covered by occluders.
+     */
+    bool isCovered() const;
+
+    void addOccluder(const QRegion &region);
+    /**
+     * Returns the part of the given @a region that is not hidden behind an occluder.
+     */
+    QRegion visible(const QRegion &region) const;
+
+    /**
+     * Returns a region made of the largest rectangles of the given @a region, so that it has
+     * at most @a maxRectCount rectangles. The result is contained in @a region, therefore it
+     * is still a valid occluder; rounded corners and other shapes with lots of small rectangles
+     * simply occlude a little bit less.
+     */
+    static QRegion simplified(const QRegion &region, int maxRectCount = 16);
+
+private:
+    QRegion m_uncovered;
+    QRegion m_occluded;
+};
+
+} // namespace KWin
@@ -60,6 +60,7 @@ enum RenderTimeEstimator {
     RenderTimeEstimatorMinimum,
     RenderTimeEstimatorMaximum,
     RenderTimeEstimatorAverage,
+    RenderTimeEstimatorPercentile,
 };
 
 class Settings;
@@ -764,7 +765,7 @@ public:
         return LatencyMedium;
     }
     static RenderTimeEstimator defaultRenderTimeEstimator() {
-        return RenderTimeEstimatorMaximum;
+        return RenderTimeEstimatorPercentile;
     }
     /**
      * Performs loading all settings except compositing related.
@@ -79,10 +79,7 @@ bool BasicEGLSurfaceTextureInternal::updateFromImage(const QRegion &region)
     if (!m_texture) {
         m_texture.reset(new GLTexture(image));
     } else {
-        const QRegion nativeRegion = scale(region, image.devicePixelRatio());
-        for (const QRect &rect : nativeRegion) {
-            m_texture->update(image, rect.topLeft(), rect);
-        }
+        m_texture->update(image, scale(region, image.devicePixelRatio()));
     }
 
     return true;
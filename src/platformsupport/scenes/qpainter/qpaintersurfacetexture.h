@@ -20,10 +20,10 @@ class KWIN_EXPORT QPainterSurfaceTexture : public SurfaceTexture
 public:
     explicit QPainterSurfaceTexture(QPainterBackend *backend);
 
-    bool isValid() const;
+    bool isValid() const override;
 
     QPainterBackend *backend() const;
-    QImage image() const;
+    virtual QImage image() const;
 
     virtual bool create() = 0;
     virtual void update(const QRegion &region) = 0;
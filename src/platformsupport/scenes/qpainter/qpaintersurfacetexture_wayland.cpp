@@ -23,9 +23,64 @@ QPainterSurfaceTextureWayland::QPainterSurfaceTextureWayland(QPainterBackend *ba
 {
 }
 
+static bool zeroCopyEnabled()
+{
+    return qEnvironmentVariableIntValue("KWIN_QPAINTER_SHM_ZERO_COPY") == 1;
+}
+
+KWaylandServer::ShmClientBuffer *QPainterSurfaceTextureWayland::shmBuffer() const
+{
+    return qobject_cast<KWaylandServer::ShmClientBuffer *>(m_pixmap->buffer());
+}
+
+bool QPainterSurfaceTextureWayland::isValid() const
+{
+    if (m_zeroCopy) {
+        return shmBuffer();
+    }
+    return QPainterSurfaceTexture::isValid();
+}
+
+QImage QPainterSurfaceTextureWayland::image() const
+{
+    if (m_zeroCopy) {
+        // The returned image accesses the client's memory, so it must only be
+        // held while painting.
+        auto buffer = shmBuffer();
+        return buffer ? buffer->data() : QImage();
+    }
+    return QPainterSurfaceTexture::image();
+}
+
+void QPainterSurfaceTextureWayland::detach()
+{
+    if (!m_zeroCopy) {
+        return;
+    }
+
+    // The pixmap outlives the attached buffer, e.g. for a closing animation, and the
+    // client may destroy the buffer any time now, so keep a copy of its contents.
+    if (auto buffer = shmBuffer()) {
+        m_image = buffer->data().copy();
+    }
+    m_zeroCopy = false;
+}
+
 bool QPainterSurfaceTextureWayland::create()
 {
-    auto buffer = qobject_cast<KWaylandServer::ShmClientBuffer *>(m_pixmap->buffer());
+    auto buffer = shmBuffer();
+    if (Q_LIKELY(buffer) && zeroCopyEnabled() && !m_pixmap->isDiscarded()) {
+        // The buffer is referenced by the pixmap and painting happens synchronously, so
+        // the client can't write to it while it's being sampled.
+        if (!m_discardedConnection) {
+            m_discardedConnection = QObject::connect(m_pixmap, &SurfacePixmap::discarded, m_pixmap, [this]() {
+                detach();
+            });
+        }
+        m_image = QImage();
+        m_zeroCopy = true;
+        return true;
+    }
     if (Q_LIKELY(buffer)) {
         // The buffer data is copied as the buffer interface returns a QImage
         // which doesn't own the data of the underlying wl_shm_buffer object.
@@ -36,7 +91,11 @@ bool QPainterSurfaceTextureWayland::create()
 
 void QPainterSurfaceTextureWayland::update(const QRegion &region)
 {
-    auto buffer = qobject_cast<KWaylandServer::ShmClientBuffer *>(m_pixmap->buffer());
+    if (m_zeroCopy) {
+        return;
+    }
+
+    auto buffer = shmBuffer();
     if (Q_UNLIKELY(!buffer)) {
         return;
     }
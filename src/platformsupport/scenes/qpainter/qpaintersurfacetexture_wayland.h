@@ -8,6 +8,11 @@
 
 #include "qpaintersurfacetexture.h"
 
+namespace KWaylandServer
+{
+class ShmClientBuffer;
+}
+
 namespace KWin
 {
 
@@ -18,11 +23,22 @@ class KWIN_EXPORT QPainterSurfaceTextureWayland : public QPainterSurfaceTexture
 public:
     QPainterSurfaceTextureWayland(QPainterBackend *backend, SurfacePixmapWayland *pixmap);
 
+    bool isValid() const override;
+    QImage image() const override;
+
     bool create() override;
     void update(const QRegion &region) override;
 
 private:
+    KWaylandServer::ShmClientBuffer *shmBuffer() const;
+    void detach();
+
     SurfacePixmapWayland *m_pixmap;
+    QMetaObject::Connection m_discardedConnection;
+    /**
+     * Whether the texture samples the attached wl_shm buffer directly instead of a copy in m_image.
+     */
+    bool m_zeroCopy = false;
 };
 
 } // namespace KWin
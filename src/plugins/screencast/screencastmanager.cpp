@@ -29,6 +29,19 @@
 namespace KWin
 {
 
+static QRegion scaleRegion(const QRegion &region, qreal scale)
+{
+    if (scale == 1) {
+        return region;
+    }
+
+    QRegion scaled;
+    for (const QRect &rect : region) {
+        scaled += QRectF(rect.topLeft() * scale, rect.size() * scale).toAlignedRect();
+    }
+    return scaled;
+}
+
 ScreencastManager::ScreencastManager(QObject *parent)
     : Plugin(parent)
     , m_screencast(new KWaylandServer::ScreencastV1Interface(waylandServer()->display(), this))
@@ -73,7 +86,8 @@ private:
 
     void bufferToStream () {
         if (!m_damagedRegion.isEmpty()) {
-            recordFrame(m_damagedRegion);
+            // The damage is not in the coordinate space of the captured frame, so report the whole frame
+            recordFrame(QRect(QPoint(0, 0), m_toplevel->clientGeometry().size()));
             m_damagedRegion = {};
         }
     }
@@ -133,7 +147,7 @@ void ScreencastManager::streamOutput(KWaylandServer::ScreencastStreamV1Interface
         }
 
         const QRect frame({}, streamOutput->modeSize());
-        const QRegion region = streamOutput->pixelSize() != streamOutput->modeSize() ? frame : damagedRegion.translated(-streamOutput->geometry().topLeft()).intersected(frame);
+        const QRegion region = streamOutput->pixelSize() != streamOutput->modeSize() ? frame : scaleRegion(damagedRegion.translated(-streamOutput->geometry().topLeft()), streamOutput->scale()).intersected(frame);
         stream->recordFrame(region);
     };
     connect(stream, &ScreenCastStream::startStreaming, waylandStream, [streamOutput, stream, bufferToStream] {
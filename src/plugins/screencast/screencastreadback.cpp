@@ -0,0 +1,119 @@
+/*
+    SPDX-FileCopyrightText: 2018-2020 Red Hat Inc
+    SPDX-FileCopyrightText: 2020 Aleix Pol Gonzalez <aleixpol@kde.org>
+    SPDX-FileContributor: Jan Grulich <jgrulich@redhat.com>
+
+    SPDX-License-Identifier: LGPL-2.0-or-later
+*/
+
+#include "screencastreadback.h"
+
+#include "kwinglplatform.h"
+#include "kwingltexture.h"
+
+namespace KWin
+{
+
+ScreenCastReadback::ScreenCastReadback(const QSize &size, bool hasAlpha)
+    : m_size(size)
+    , m_hasAlpha(hasAlpha)
+    , m_bytesPerPixel(hasAlpha ? 4 : 3)
+    , m_texture(new GLTexture(hasAlpha ? GL_RGBA8 : GL_RGB8, size))
+    , m_renderTarget(new GLRenderTarget(*m_texture))
+{
+    for (PixelPackBuffer &buffer : m_buffers) {
+        glGenBuffers(1, &buffer.buffer);
+    }
+}
+
+ScreenCastReadback::~ScreenCastReadback()
+{
+    for (PixelPackBuffer &buffer : m_buffers) {
+        glDeleteBuffers(1, &buffer.buffer);
+    }
+}
+
+bool ScreenCastReadback::supported()
+{
+    if (GLPlatform::instance()->isGLES()) {
+        return hasGLVersion(3, 0);
+    }
+    return hasGLVersion(3, 0) || (hasGLExtension(QByteArrayLiteral("GL_ARB_pixel_buffer_object"))
+                                  && hasGLExtension(QByteArrayLiteral("GL_ARB_map_buffer_range")));
+}
+
+QSize ScreenCastReadback::size() const
+{
+    return m_size;
+}
+
+bool ScreenCastReadback::hasAlphaChannel() const
+{
+    return m_hasAlpha;
+}
+
+GLRenderTarget *ScreenCastReadback::renderTarget() const
+{
+    return m_renderTarget.data();
+}
+
+int ScreenCastReadback::read(const QRect &rect)
+{
+    int index = -1;
+    for (int i = 0; i < int(m_buffers.size()); ++i) {
+        if (!m_buffers[i].busy) {
+            index = i;
+            break;
+        }
+    }
+    if (index == -1) {
+        return -1;
+    }
+
+    PixelPackBuffer &buffer = m_buffers[index];
+    buffer.rect = rect & QRect(QPoint(0, 0), m_size);
+    buffer.busy = true;
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, buffer.buffer);
+    glBufferData(GL_PIXEL_PACK_BUFFER, buffer.rect.width() * buffer.rect.height() * m_bytesPerPixel, nullptr, GL_STREAM_READ);
+
+    GLRenderTarget::pushRenderTarget(m_renderTarget.data());
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(buffer.rect.x(), buffer.rect.y(), buffer.rect.width(), buffer.rect.height(),
+                 m_hasAlpha ? GL_BGRA : GL_BGR, GL_UNSIGNED_BYTE, nullptr);
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    GLRenderTarget::popRenderTarget();
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    return index;
+}
+
+void ScreenCastReadback::finish(int index, QImage *image)
+{
+    PixelPackBuffer &buffer = m_buffers[index];
+    Q_ASSERT(buffer.busy);
+    buffer.busy = false;
+    if (buffer.rect.isEmpty()) {
+        return;
+    }
+
+    const int rowSize = buffer.rect.width() * m_bytesPerPixel;
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, buffer.buffer);
+    const uchar *pixels = static_cast<const uchar *>(glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, rowSize * buffer.rect.height(), GL_MAP_READ_BIT));
+    if (pixels) {
+        for (int y = 0; y < buffer.rect.height(); ++y) {
+            uchar *destination = image->scanLine(buffer.rect.y() + y) + buffer.rect.x() * m_bytesPerPixel;
+            memcpy(destination, pixels + y * rowSize, rowSize);
+        }
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+
+void ScreenCastReadback::discard(int index)
+{
+    m_buffers[index].busy = false;
+}
+
+} // namespace KWin
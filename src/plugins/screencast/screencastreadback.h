@@ -0,0 +1,77 @@
+/*
+    SPDX-FileCopyrightText: 2018-2020 Red Hat Inc
+    SPDX-FileCopyrightText: 2020 Aleix Pol Gonzalez <aleixpol@kde.org>
+    SPDX-FileContributor: Jan Grulich <jgrulich@redhat.com>
+
+    SPDX-License-Identifier: LGPL-2.0-or-later
+*/
+
+#pragma once
+
+#include "kwinglutils.h"
+
+#include <QImage>
+#include <QScopedPointer>
+
+#include <array>
+
+namespace KWin
+{
+
+/**
+ * The ScreenCastReadback class copies frames from the GPU to the CPU without stalling the
+ * graphics pipeline.
+ *
+ * Frames are rendered into an offscreen texture, which is then read into one of a few pixel
+ * pack buffers. The contents of a pixel pack buffer can be copied out as soon as the GPU has
+ * finished writing it, in the meantime the compositor can go on rendering the next frame.
+ *
+ * The first row of the render target is the top of the frame, so no vertical mirroring is
+ * needed after the readback.
+ */
+class ScreenCastReadback
+{
+public:
+    ScreenCastReadback(const QSize &size, bool hasAlpha);
+    ~ScreenCastReadback();
+
+    static bool supported();
+
+    QSize size() const;
+    bool hasAlphaChannel() const;
+    GLRenderTarget *renderTarget() const;
+
+    /**
+     * Starts reading the @a rect of the render target into a pixel pack buffer. Returns the
+     * index of the buffer, or -1 if all buffers are still in use.
+     */
+    int read(const QRect &rect);
+
+    /**
+     * Copies the pixels read into the buffer @a index to the same rect in @a image, and makes
+     * the buffer available again. The GPU must have finished executing the read() call.
+     */
+    void finish(int index, QImage *image);
+
+    /**
+     * Makes the buffer @a index available again without copying the pixels.
+     */
+    void discard(int index);
+
+private:
+    struct PixelPackBuffer
+    {
+        GLuint buffer = 0;
+        QRect rect;
+        bool busy = false;
+    };
+
+    QSize m_size;
+    bool m_hasAlpha;
+    int m_bytesPerPixel;
+    QScopedPointer<GLTexture> m_texture;
+    QScopedPointer<GLRenderTarget> m_renderTarget;
+    std::array<PixelPackBuffer, 2> m_buffers;
+};
+
+} // namespace KWin
@@ -17,6 +17,7 @@
 #include "main.h"
 #include "pipewirecore.h"
 #include "platform.h"
+#include "screencastreadback.h"
 #include "screencastsource.h"
 #include "utils.h"
 
@@ -68,6 +69,8 @@ void ScreenCastStream::onStreamStateChanged(void *data, pw_stream_state old, pw_
 #define CURSOR_META_SIZE(w,h)	(sizeof(struct spa_meta_cursor) + \
 				 sizeof(struct spa_meta_bitmap) + w * h * CURSOR_BPP)
 static const int videoDamageRegionCount = 16;
+static const int s_maxPendingFrames = 2;
+static const int s_maxDamageHistory = 16;
 
 void ScreenCastStream::newStreamParams()
 {
@@ -194,6 +197,12 @@ void ScreenCastStream::onStreamRemoveBuffer(void *data, pw_buffer *buffer)
 {
     ScreenCastStream *stream = static_cast<ScreenCastStream *>(data);
     stream->m_dmabufDataForPwBuffer.remove(buffer);
+    stream->m_bufferSequences.remove(buffer);
+    for (PendingFrame *frame : qAsConst(stream->m_pendingFrames)) {
+        if (frame->buffer == buffer) {
+            frame->buffer = nullptr;
+        }
+    }
 
     struct spa_buffer *spa_buffer = buffer->buffer;
     struct spa_data *spa_data = spa_buffer->datas;
@@ -220,6 +229,7 @@ ScreenCastStream::ScreenCastStream(ScreenCastSource *source, QObject *parent)
 ScreenCastStream::~ScreenCastStream()
 {
     m_stopped = true;
+    qDeleteAll(m_pendingFrames);
     if (pwStream) {
         pw_stream_destroy(pwStream);
     }
@@ -325,8 +335,9 @@ void ScreenCastStream::recordFrame(const QRegion &damagedRegion)
 {
     Q_ASSERT(!m_stopped);
 
-    if (m_pendingBuffer) {
+    if (m_pendingFrames.count() >= s_maxPendingFrames) {
         qCWarning(KWIN_SCREENCAST) << "Dropping a screencast frame because the compositor is slow";
+        m_shadowImageValid = false;
         return;
     }
 
@@ -342,12 +353,14 @@ void ScreenCastStream::recordFrame(const QRegion &damagedRegion)
         if (error) {
             qCWarning(KWIN_SCREENCAST) << "Failed to record frame: stream is not active" << error;
         }
+        m_shadowImageValid = false;
         return;
     }
 
     struct pw_buffer *buffer = pw_stream_dequeue_buffer(pwStream);
 
     if (!buffer) {
+        m_shadowImageValid = false;
         return;
     }
 
@@ -361,6 +374,9 @@ void ScreenCastStream::recordFrame(const QRegion &damagedRegion)
         return;
     }
 
+    PendingFrame *frame = new PendingFrame;
+    frame->buffer = buffer;
+
     const auto size = m_source->textureSize();
     spa_data->chunk->offset = 0;
     if (data || spa_data[0].type == SPA_DATA_MemFd) {
@@ -372,20 +388,78 @@ void ScreenCastStream::recordFrame(const QRegion &damagedRegion)
         if (dest.sizeInBytes() > spa_data->maxsize) {
             qCDebug(KWIN_SCREENCAST) << "Failed to record frame: frame is too big";
             pw_stream_queue_buffer(pwStream, buffer);
+            delete frame;
             return;
         }
 
         spa_data->chunk->size = dest.sizeInBytes();
         spa_data->chunk->stride = dest.bytesPerLine();
 
-        m_source->render(&dest);
+        if (m_shadowImage.size() != size || m_shadowImage.format() != dest.format()) {
+            m_shadowImage = QImage(size, dest.format());
+            m_shadowImageValid = false;
+            m_bufferSequences.clear();
+            m_damageHistory.clear();
+        }
+
+        // Only the damaged part of the frame is updated in the shadow image
+        QRect updateRect = damagedRegion.boundingRect();
+        if (ScreenCastReadback::supported()) {
+            if (!m_readback || m_readback->size() != size || m_readback->hasAlphaChannel() != hasAlpha) {
+                // The read backs of the old buffers are lost, the whole frame is read back again
+                for (PendingFrame *pendingFrame : qAsConst(m_pendingFrames)) {
+                    pendingFrame->readback = -1;
+                }
+                m_readback.reset(new ScreenCastReadback(size, hasAlpha));
+                m_shadowImageValid = false;
+            }
 
-        auto cursor = Cursors::self()->currentCursor();
-        if (m_cursor.mode == KWaylandServer::ScreencastV1Interface::Embedded && m_cursor.viewport.contains(cursor->pos())) {
-            QPainter painter(&dest);
-            const auto position = (cursor->pos() - m_cursor.viewport.topLeft() - cursor->hotspot()) * m_cursor.scale;
-            painter.drawImage(QRect{position, cursor->image().size()}, cursor->image());
+            m_source->render(m_readback->renderTarget());
+            if (m_cursor.mode == KWaylandServer::ScreencastV1Interface::Embedded) {
+                updateRect |= m_cursor.lastRect;
+                renderCursor(m_readback->renderTarget());
+                updateRect |= m_cursor.lastRect;
+            }
+            if (!m_shadowImageValid) {
+                updateRect = QRect(QPoint(0, 0), size);
+                m_shadowImageValid = true;
+            }
+            updateRect &= QRect(QPoint(0, 0), size);
+
+            // The pixels are copied into the buffer once the GPU has finished the readback
+            frame->readback = m_readback->read(updateRect);
+            if (frame->readback == -1) {
+                pw_stream_queue_buffer(pwStream, buffer);
+                m_shadowImageValid = false;
+                delete frame;
+                return;
+            }
+        } else {
+            m_source->render(&m_shadowImage);
+
+            // The cursor is painted over the freshly grabbed frame, so only the patches
+            // under its old and new position need to be copied into the buffer
+            auto cursor = Cursors::self()->currentCursor();
+            if (m_cursor.mode == KWaylandServer::ScreencastV1Interface::Embedded) {
+                updateRect |= m_cursor.lastRect;
+                m_cursor.lastRect = QRect();
+                if (m_cursor.viewport.contains(cursor->pos())) {
+                    QPainter painter(&m_shadowImage);
+                    const auto position = (cursor->pos() - m_cursor.viewport.topLeft() - cursor->hotspot()) * m_cursor.scale;
+                    m_cursor.lastRect = QRect{position, cursor->image().size()};
+                    painter.drawImage(m_cursor.lastRect, cursor->image());
+                    updateRect |= m_cursor.lastRect;
+                }
+            }
+            if (!m_shadowImageValid) {
+                updateRect = QRect(QPoint(0, 0), size);
+                m_shadowImageValid = true;
+            }
+            updateRect &= QRect(QPoint(0, 0), size);
         }
+
+        frame->image = dest;
+        frame->damage = updateRect;
     } else {
         auto &buf = m_dmabufDataForPwBuffer[buffer];
 
@@ -394,35 +468,8 @@ void ScreenCastStream::recordFrame(const QRegion &damagedRegion)
 
         m_source->render(buf->framebuffer());
 
-        auto cursor = Cursors::self()->currentCursor();
-        if (m_cursor.mode == KWaylandServer::ScreencastV1Interface::Embedded && m_cursor.viewport.contains(cursor->pos())) {
-            GLRenderTarget::pushRenderTarget(buf->framebuffer());
-
-            QRect r(QPoint(), size);
-            auto shader = ShaderManager::instance()->pushShader(ShaderTrait::MapTexture);
-
-            QMatrix4x4 mvp;
-            mvp.ortho(r);
-            shader->setUniform(GLShader::ModelViewProjectionMatrix, mvp);
-
-            if (!m_cursor.texture || m_cursor.lastKey != cursor->image().cacheKey())
-                m_cursor.texture.reset(new GLTexture(cursor->image()));
-
-            m_cursor.texture->setYInverted(false);
-            m_cursor.texture->bind();
-            const auto cursorRect = cursorGeometry(cursor);
-            mvp.translate(cursorRect.left(), r.height() - cursorRect.top() - cursor->image().height() * m_cursor.scale);
-            shader->setUniform(GLShader::ModelViewProjectionMatrix, mvp);
-
-            glEnable(GL_BLEND);
-            glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-            m_cursor.texture->render(cursorRect, cursorRect, true);
-            glDisable(GL_BLEND);
-            m_cursor.texture->unbind();
-            m_cursor.lastRect = cursorRect;
-
-            ShaderManager::instance()->popShader();
-            GLRenderTarget::popRenderTarget();
+        if (m_cursor.mode == KWaylandServer::ScreencastV1Interface::Embedded) {
+            renderCursor(buf->framebuffer());
         }
     }
 
@@ -455,12 +502,54 @@ void ScreenCastStream::recordFrame(const QRegion &damagedRegion)
         }
     }
 
-    tryEnqueue(buffer);
+    tryEnqueue(frame);
 }
 
-void ScreenCastStream::tryEnqueue(pw_buffer *buffer)
+void ScreenCastStream::renderCursor(GLRenderTarget *target)
 {
-    m_pendingBuffer = buffer;
+    auto cursor = Cursors::self()->currentCursor();
+    if (!m_cursor.viewport.contains(cursor->pos())) {
+        return;
+    }
+
+    GLRenderTarget::pushRenderTarget(target);
+
+    QRect r(QPoint(), m_source->textureSize());
+    auto shader = ShaderManager::instance()->pushShader(ShaderTrait::MapTexture);
+
+    QMatrix4x4 mvp;
+    mvp.ortho(r);
+    shader->setUniform(GLShader::ModelViewProjectionMatrix, mvp);
+
+    if (!m_cursor.texture || m_cursor.lastKey != cursor->image().cacheKey())
+        m_cursor.texture.reset(new GLTexture(cursor->image()));
+
+    m_cursor.texture->setYInverted(false);
+    m_cursor.texture->bind();
+    const auto cursorRect = cursorGeometry(cursor);
+    mvp.translate(cursorRect.left(), r.height() - cursorRect.top() - cursor->image().height() * m_cursor.scale);
+    shader->setUniform(GLShader::ModelViewProjectionMatrix, mvp);
+
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    m_cursor.texture->render(cursorRect, cursorRect, true);
+    glDisable(GL_BLEND);
+    m_cursor.texture->unbind();
+    m_cursor.lastRect = cursorRect;
+
+    ShaderManager::instance()->popShader();
+    GLRenderTarget::popRenderTarget();
+}
+
+ScreenCastStream::PendingFrame::~PendingFrame()
+{
+    delete fence;
+    delete notifier;
+}
+
+void ScreenCastStream::tryEnqueue(PendingFrame *frame)
+{
+    m_pendingFrames.append(frame);
 
     // The GPU doesn't necessarily process draw commands as soon as they are issued. Thus,
     // we need to insert a fence into the command stream and enqueue the pipewire buffer
@@ -468,36 +557,91 @@ void ScreenCastStream::tryEnqueue(pw_buffer *buffer)
     // a corrupted buffer.
     if (kwinApp()->platform()->supportsNativeFence()) {
         Q_ASSERT_X(eglGetCurrentContext(), "tryEnqueue", "no current context");
-        m_pendingFence = new EGLNativeFence(kwinApp()->platform()->sceneEglDisplay());
-        if (!m_pendingFence->isValid()) {
+        frame->fence = new EGLNativeFence(kwinApp()->platform()->sceneEglDisplay());
+        if (!frame->fence->isValid()) {
             qCWarning(KWIN_SCREENCAST) << "Failed to create a native EGL fence";
             glFinish();
-            enqueue();
+            enqueue(frame);
         } else {
-            m_pendingNotifier = new QSocketNotifier(m_pendingFence->fileDescriptor(),
-                                                    QSocketNotifier::Read, this);
-            connect(m_pendingNotifier, &QSocketNotifier::activated, this, &ScreenCastStream::enqueue);
+            frame->notifier = new QSocketNotifier(frame->fence->fileDescriptor(),
+                                                  QSocketNotifier::Read, this);
+            connect(frame->notifier, &QSocketNotifier::activated, this, [this, frame]() {
+                enqueue(frame);
+            });
         }
     } else {
         // The compositing backend doesn't support native fences. We don't have any other choice
         // but stall the graphics pipeline. Otherwise stream consumers may see an incomplete buffer.
         glFinish();
-        enqueue();
+        enqueue(frame);
     }
 }
 
-void ScreenCastStream::enqueue()
+void ScreenCastStream::enqueue(PendingFrame *frame)
 {
-    Q_ASSERT_X(m_pendingBuffer, "enqueue", "pending buffer must be valid");
+    Q_ASSERT_X(m_pendingFrames.contains(frame), "enqueue", "pending frame must be valid");
+
+    // The GPU executes the frames in order, so if the fence of this frame has been signaled,
+    // all the frames before it are done as well.
+    while (!m_pendingFrames.isEmpty()) {
+        PendingFrame *pendingFrame = m_pendingFrames.takeFirst();
+        if (!pendingFrame->image.isNull() && (pendingFrame->image.size() != m_shadowImage.size()
+                                              || pendingFrame->image.format() != m_shadowImage.format())) {
+            // The frame has been recorded before the size or the format of the stream changed,
+            // it doesn't match the shadow image anymore. Its buffer is given back as it is.
+            if (pendingFrame->readback != -1) {
+                m_readback->discard(pendingFrame->readback);
+            }
+        } else if (!pendingFrame->image.isNull()) {
+            if (pendingFrame->readback != -1) {
+                m_readback->finish(pendingFrame->readback, &m_shadowImage);
+            }
 
-    delete m_pendingFence;
-    delete m_pendingNotifier;
+            m_damageHistory.prepend(pendingFrame->damage);
+            if (m_damageHistory.count() > s_maxDamageHistory) {
+                m_damageHistory.removeLast();
+            }
+            ++m_frameSequence;
 
-    pw_stream_queue_buffer(pwStream, m_pendingBuffer);
+            if (pendingFrame->buffer) {
+                updateBuffer(pendingFrame->buffer, &pendingFrame->image);
+            }
+        }
+        if (pendingFrame->buffer) {
+            pw_stream_queue_buffer(pwStream, pendingFrame->buffer);
+        }
+        const bool done = pendingFrame == frame;
+        delete pendingFrame;
+        if (done) {
+            break;
+        }
+    }
+}
 
-    m_pendingBuffer = nullptr;
-    m_pendingFence = nullptr;
-    m_pendingNotifier = nullptr;
+void ScreenCastStream::updateBuffer(pw_buffer *buffer, QImage *image)
+{
+    // Like with the buffer age of a swapchain, the buffer only needs the damage of the
+    // frames that have been recorded since it was filled the last time
+    QRegion region;
+    const auto it = m_bufferSequences.constFind(buffer);
+    const quint64 age = it != m_bufferSequences.constEnd() ? m_frameSequence - *it : 0;
+    if (age == 0 || age > quint64(m_damageHistory.count())) {
+        region = QRect(QPoint(0, 0), image->size());
+    } else {
+        for (quint64 i = 0; i < age; ++i) {
+            region += m_damageHistory[i];
+        }
+    }
+    m_bufferSequences[buffer] = m_frameSequence;
+
+    const int bytesPerPixel = image->depth() / 8;
+    for (const QRect &rect : region) {
+        const int rowSize = rect.width() * bytesPerPixel;
+        for (int y = rect.top(); y <= rect.bottom(); ++y) {
+            memcpy(image->scanLine(y) + rect.x() * bytesPerPixel,
+                   m_shadowImage.constScanLine(y) + rect.x() * bytesPerPixel, rowSize);
+        }
+    }
 }
 
 spa_pod *ScreenCastStream::buildFormat(struct spa_pod_builder *b, enum spa_video_format format, struct spa_rectangle *resolution,
@@ -14,10 +14,13 @@
 #include <KWaylandServer/screencast_v1_interface.h>
 
 #include <QHash>
+#include <QImage>
 #include <QObject>
+#include <QRegion>
 #include <QSharedPointer>
 #include <QSize>
 #include <QSocketNotifier>
+#include <QVector>
 
 #include <pipewire/pipewire.h>
 #include <spa/param/format-utils.h>
@@ -30,8 +33,10 @@ namespace KWin
 class Cursor;
 class DmaBufTexture;
 class EGLNativeFence;
+class GLRenderTarget;
 class GLTexture;
 class PipeWireCore;
+class ScreenCastReadback;
 class ScreenCastSource;
 
 class KWIN_EXPORT ScreenCastStream : public QObject
@@ -71,8 +76,22 @@ private:
     void coreFailed(const QString &errorMessage);
     void sendCursorData(Cursor *cursor, spa_meta_cursor *spa_cursor);
     void newStreamParams();
-    void tryEnqueue(pw_buffer *buffer);
-    void enqueue();
+    void renderCursor(GLRenderTarget *target);
+
+    struct PendingFrame
+    {
+        ~PendingFrame();
+
+        pw_buffer *buffer = nullptr;
+        QImage image;
+        QRect damage;
+        int readback = -1;
+        EGLNativeFence *fence = nullptr;
+        QSocketNotifier *notifier = nullptr;
+    };
+    void tryEnqueue(PendingFrame *frame);
+    void enqueue(PendingFrame *frame);
+    void updateBuffer(pw_buffer *buffer, QImage *image);
     spa_pod* buildFormat(struct spa_pod_builder *b, enum spa_video_format format, struct spa_rectangle *resolution,
                          struct spa_fraction *defaultFramerate, struct spa_fraction *minFramerate, struct spa_fraction *maxFramerate,
                          uint64_t *modifiers, int modifier_count);
@@ -104,9 +123,18 @@ private:
 
     QHash<struct pw_buffer *, QSharedPointer<DmaBufTexture>> m_dmabufDataForPwBuffer;
 
-    pw_buffer *m_pendingBuffer = nullptr;
-    QSocketNotifier *m_pendingNotifier = nullptr;
-    EGLNativeFence *m_pendingFence = nullptr;
+    // Frames that have been recorded but are still being rendered or read back by the GPU,
+    // in the order they have been recorded
+    QVector<PendingFrame *> m_pendingFrames;
+    QScopedPointer<ScreenCastReadback> m_readback;
+    QImage m_shadowImage;
+    bool m_shadowImageValid = false;
+
+    // The damage of the last frames copied out of the shadow image, the most recent first,
+    // and the frame sequence each memfd buffer has been filled with the last time
+    QVector<QRegion> m_damageHistory;
+    QHash<struct pw_buffer *, quint64> m_bufferSequences;
+    quint64 m_frameSequence = 0;
 };
 
 } // namespace KWin
@@ -6,51 +6,164 @@
 
 #include "renderjournal.h"
 
+#include <algorithm>
+#include <cmath>
+
 namespace KWin
 {
 
+static const int s_historySize = 120;
+
+RenderJournal::Log::Log(int capacity)
+    : m_samples(capacity, std::chrono::nanoseconds::zero())
+{
+}
+
+void RenderJournal::Log::add(std::chrono::nanoseconds duration)
+{
+    m_samples[m_next] = duration;
+    m_next = (m_next + 1) % m_samples.count();
+    m_count = std::min(m_count + 1, m_samples.count());
+}
+
+bool RenderJournal::Log::isEmpty() const
+{
+    return !m_count;
+}
+
+template<typename Function>
+void RenderJournal::Log::forEachRecent(int window, Function function) const
+{
+    const int count = std::min(window, m_count);
+    for (int i = 1; i <= count; ++i) {
+        function(m_samples[(m_next - i + m_samples.count()) % m_samples.count()]);
+    }
+}
+
+std::chrono::nanoseconds RenderJournal::Log::minimum(int window) const
+{
+    if (isEmpty()) {
+        return std::chrono::nanoseconds::zero();
+    }
+    std::chrono::nanoseconds result = std::chrono::nanoseconds::max();
+    forEachRecent(window, [&result](std::chrono::nanoseconds sample) {
+        result = std::min(result, sample);
+    });
+    return result;
+}
+
+std::chrono::nanoseconds RenderJournal::Log::maximum(int window) const
+{
+    std::chrono::nanoseconds result = std::chrono::nanoseconds::zero();
+    forEachRecent(window, [&result](std::chrono::nanoseconds sample) {
+        result = std::max(result, sample);
+    });
+    return result;
+}
+
+std::chrono::nanoseconds RenderJournal::Log::average(int window) const
+{
+    if (isEmpty()) {
+        return std::chrono::nanoseconds::zero();
+    }
+    std::chrono::nanoseconds result = std::chrono::nanoseconds::zero();
+    int count = 0;
+    forEachRecent(window, [&result, &count](std::chrono::nanoseconds sample) {
+        result += sample;
+        ++count;
+    });
+    return result / count;
+}
+
+std::chrono::nanoseconds RenderJournal::Log::percentile(qreal percentile) const
+{
+    if (isEmpty()) {
+        return std::chrono::nanoseconds::zero();
+    }
+    // The history is small, a partial sort of a copy is cheaper than maintaining an order
+    // statistics tree.
+    std::array<std::chrono::nanoseconds, s_historySize> sorted;
+    const int count = std::min<int>(m_count, sorted.size());
+    std::copy_n(m_samples.constBegin(), count, sorted.begin());
+    const int rank = std::clamp(int(std::ceil(percentile * count)) - 1, 0, count - 1);
+    std::nth_element(sorted.begin(), sorted.begin() + rank, sorted.begin() + count);
+    return sorted[rank];
+}
+
 RenderJournal::RenderJournal()
+    : m_cpuLog(s_historySize)
+    , m_gpuLog(s_historySize)
+    , m_stageLogs{Log(s_historySize), Log(s_historySize), Log(s_historySize)}
 {
 }
 
 void RenderJournal::beginFrame()
 {
     m_timer.start();
+    m_currentStage = -1;
 }
 
-void RenderJournal::endFrame()
+void RenderJournal::beginStage(Stage stage)
 {
-    std::chrono::nanoseconds duration(m_timer.nsecsElapsed());
-    if (m_log.count() >= m_size) {
-        m_log.dequeue();
+    const std::chrono::nanoseconds timestamp(m_timer.nsecsElapsed());
+    finishStage(timestamp);
+    m_currentStage = int(stage);
+    m_stageStart = timestamp;
+}
+
+void RenderJournal::endStage()
+{
+    finishStage(std::chrono::nanoseconds(m_timer.nsecsElapsed()));
+}
+
+void RenderJournal::finishStage(std::chrono::nanoseconds timestamp)
+{
+    if (m_currentStage != -1) {
+        m_stageLogs[m_currentStage].add(timestamp - m_stageStart);
+        m_currentStage = -1;
     }
-    m_log.enqueue(duration);
+}
+
+void RenderJournal::endFrame()
+{
+    const std::chrono::nanoseconds duration(m_timer.nsecsElapsed());
+    finishStage(duration);
+    m_cpuLog.add(duration);
+}
+
+void RenderJournal::addGpuTime(std::chrono::nanoseconds duration)
+{
+    m_gpuLog.add(duration);
 }
 
 std::chrono::nanoseconds RenderJournal::minimum() const
 {
-    auto it = std::min_element(m_log.constBegin(), m_log.constEnd());
-    return it != m_log.constEnd() ? (*it) : std::chrono::nanoseconds::zero();
+    return m_cpuLog.minimum(m_window) + m_gpuLog.minimum(m_window);
 }
 
 std::chrono::nanoseconds RenderJournal::maximum() const
 {
-    auto it = std::max_element(m_log.constBegin(), m_log.constEnd());
-    return it != m_log.constEnd() ? (*it) : std::chrono::nanoseconds::zero();
+    return m_cpuLog.maximum(m_window) + m_gpuLog.maximum(m_window);
 }
 
 std::chrono::nanoseconds RenderJournal::average() const
 {
-    if (m_log.isEmpty()) {
-        return std::chrono::nanoseconds::zero();
-    }
+    return m_cpuLog.average(m_window) + m_gpuLog.average(m_window);
+}
 
-    std::chrono::nanoseconds result = std::chrono::nanoseconds::zero();
-    for (const std::chrono::nanoseconds &entry : m_log) {
-        result += entry;
-    }
+std::chrono::nanoseconds RenderJournal::percentile(qreal percentile) const
+{
+    return m_cpuLog.percentile(percentile) + m_gpuLog.percentile(percentile);
+}
 
-    return result / m_log.count();
+std::chrono::nanoseconds RenderJournal::stageAverage(Stage stage) const
+{
+    return m_stageLogs[int(stage)].average(s_historySize);
+}
+
+int RenderJournal::historySize()
+{
+    return s_historySize;
 }
 
 } // namespace KWin
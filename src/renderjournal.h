@@ -9,7 +9,9 @@
 #include "kwinglobals.h"
 
 #include <QElapsedTimer>
-#include <QQueue>
+#include <QVector>
+
+#include <array>
 
 namespace KWin
 {
@@ -17,10 +19,23 @@ namespace KWin
 /**
  * The RenderJournal class measures how long it takes to render frames and estimates how
  * long it will take to render the next frame.
+ *
+ * The render time of a frame consists of the time spent on the CPU, which is measured
+ * between beginFrame() and endFrame(), and the time spent on the GPU, which is reported
+ * asynchronously with addGpuTime() once the results of the timer queries are available.
  */
 class KWIN_EXPORT RenderJournal
 {
 public:
+    /**
+     * This enum type specifies the stages of a compositing cycle that are timed separately.
+     */
+    enum class Stage {
+        EffectsPrePaint, ///< Effects and windows prepare the frame
+        ScenePaint, ///< The scene and effects record the draw commands
+        BackendPresent, ///< The backend finishes and submits the frame
+    };
+
     RenderJournal();
 
     /**
@@ -28,11 +43,28 @@ public:
      */
     void beginFrame();
 
+    /**
+     * Marks the start of the given @a stage of the current frame. The previous stage,
+     * if any, is considered finished.
+     */
+    void beginStage(Stage stage);
+
+    /**
+     * Marks the end of the current stage. Stages that run after endFrame() have to be
+     * finished explicitly, endFrame() finishes the stage that is running at that time.
+     */
+    void endStage();
+
     /**
      * This function must be called after finishing rendering a frame.
      */
     void endFrame();
 
+    /**
+     * Records that the GPU spent @a duration executing the commands of a previous frame.
+     */
+    void addGpuTime(std::chrono::nanoseconds duration);
+
     /**
      * Returns the maximum estimated amount of time that it takes to render a single frame.
      */
@@ -48,10 +80,56 @@ public:
      */
     std::chrono::nanoseconds average() const;
 
+    /**
+     * Returns the estimated amount of time within which the given @a percentile of frames
+     * are rendered, e.g. 0.95 for the 95th percentile.
+     */
+    std::chrono::nanoseconds percentile(qreal percentile) const;
+
+    /**
+     * Returns the average amount of CPU time spent in the given @a stage.
+     */
+    std::chrono::nanoseconds stageAverage(Stage stage) const;
+
+    /**
+     * Returns the number of frames that the journal keeps.
+     */
+    static int historySize();
+
 private:
+    class Log
+    {
+    public:
+        explicit Log(int capacity);
+
+        void add(std::chrono::nanoseconds duration);
+        bool isEmpty() const;
+
+        std::chrono::nanoseconds minimum(int window) const;
+        std::chrono::nanoseconds maximum(int window) const;
+        std::chrono::nanoseconds average(int window) const;
+        std::chrono::nanoseconds percentile(qreal percentile) const;
+
+    private:
+        template<typename Function>
+        void forEachRecent(int window, Function function) const;
+
+        QVector<std::chrono::nanoseconds> m_samples;
+        int m_next = 0;
+        int m_count = 0;
+    };
+
+    void finishStage(std::chrono::nanoseconds timestamp);
+
     QElapsedTimer m_timer;
-    QQueue<std::chrono::nanoseconds> m_log;
-    int m_size = 15;
+    Log m_cpuLog;
+    Log m_gpuLog;
+    std::array<Log, 3> m_stageLogs;
+    std::chrono::nanoseconds m_stageStart = std::chrono::nanoseconds::zero();
+    int m_currentStage = -1;
+    // The minimum, maximum and average estimators only look at the most recent frames,
+    // the percentile estimator needs a longer history to be meaningful.
+    int m_window = 15;
 };
 
 } // namespace KWin
@@ -5,6 +5,7 @@
 */
 
 #include "renderloop.h"
+#include "ftrace.h"
 #include "options.h"
 #include "renderloop_p.h"
 #include "utils.h"
@@ -83,6 +84,11 @@ void RenderLoopPrivate::scheduleRepaint()
     case RenderTimeEstimatorAverage:
         renderTime = std::max(renderTime, renderJournal.average());
         break;
+    case RenderTimeEstimatorPercentile:
+        // Unlike the maximum, a single slow frame doesn't push the deadline of the
+        // following frames, but the estimate still covers almost all frames.
+        renderTime = std::max(renderTime, renderJournal.percentile(0.95));
+        break;
     }
 
     std::chrono::nanoseconds nextRenderTimestamp = nextPresentationTimestamp - renderTime - safetyMargin;
@@ -124,6 +130,8 @@ void RenderLoopPrivate::notifyFrameCompleted(std::chrono::nanoseconds timestamp)
     Q_ASSERT(pendingFrameCount > 0);
     pendingFrameCount--;
 
+    fTraceEvent("framePresented");
+
     if (lastPresentationTimestamp <= timestamp) {
         lastPresentationTimestamp = timestamp;
     } else {
@@ -147,6 +155,7 @@ void RenderLoopPrivate::dispatch()
     // the Compositor starts repainting.
     pendingRepaint = true;
 
+    fTraceEvent("frameRequested");
     Q_EMIT q->frameRequested(q);
 
     // The Compositor may decide to not repaint when the frameRequested() signal is
@@ -200,6 +209,30 @@ void RenderLoop::beginFrame()
 void RenderLoop::endFrame()
 {
     d->renderJournal.endFrame();
+
+    // The stage timings are only reported in the debug output, once per journal history.
+    if (++d->frameCount % RenderJournal::historySize() == 0) {
+        qCDebug(KWIN_CORE) << "Average frame stage time (effects pre-paint, scene paint, backend present):"
+                           << d->renderJournal.stageAverage(RenderJournal::Stage::EffectsPrePaint).count()
+                           << d->renderJournal.stageAverage(RenderJournal::Stage::ScenePaint).count()
+                           << d->renderJournal.stageAverage(RenderJournal::Stage::BackendPresent).count()
+                           << "ns";
+    }
+}
+
+void RenderLoop::beginFrameStage(RenderJournal::Stage stage)
+{
+    d->renderJournal.beginStage(stage);
+}
+
+void RenderLoop::endFrameStage()
+{
+    d->renderJournal.endStage();
+}
+
+void RenderLoop::addGpuRenderTime(std::chrono::nanoseconds duration)
+{
+    d->renderJournal.addGpuTime(duration);
 }
 
 int RenderLoop::refreshRate() const
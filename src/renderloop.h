@@ -7,6 +7,7 @@
 #pragma once
 
 #include "kwinglobals.h"
+#include "renderjournal.h"
 
 #include <QObject>
 
@@ -58,6 +59,24 @@ public:
      */
     void endFrame();
 
+    /**
+     * Marks the beginning of the given @a stage of the frame that is being rendered.
+     * The stages are timed separately for diagnostic purposes.
+     */
+    void beginFrameStage(RenderJournal::Stage stage);
+
+    /**
+     * Marks the end of the current stage. This is only needed for stages that run after
+     * endFrame(), which don't count towards the render time.
+     */
+    void endFrameStage();
+
+    /**
+     * Reports that the GPU spent @a duration rendering a previous frame. The render
+     * time is usually only known a few frames later, after the GPU has caught up.
+     */
+    void addGpuRenderTime(std::chrono::nanoseconds duration);
+
     /**
      * Returns the refresh rate at which the output is being updated, in millihertz.
      */
@@ -37,6 +37,7 @@ public:
     RenderJournal renderJournal;
     int refreshRate = 60000;
     int pendingFrameCount = 0;
+    int frameCount = 0;
     int inhibitCount = 0;
     bool pendingReschedule = false;
     bool pendingRepaint = false;
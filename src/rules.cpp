@@ -101,6 +101,14 @@ Rules::Rules(const QString& str, bool temporary)
     var = settings->var() func; \
     var##match = static_cast<StringMatch>(settings->var##match())
 
+#define COMPILE_MATCH_REGEXP(var, func) \
+    if (var##match == RegExpMatch) { \
+        var##regexp = QRegularExpression(func(var)); \
+        var##regexp.optimize(); \
+    } else { \
+        var##regexp = QRegularExpression(); \
+    }
+
 #define READ_SET_RULE(var) \
     var = settings->var(); \
     var##rule = static_cast<SetRule>(settings->var##rule())
@@ -116,6 +124,16 @@ Rules::Rules(const RuleSettings *settings)
     readFromSettings(settings);
 }
 
+void Rules::compileMatchRegExps()
+{
+    COMPILE_MATCH_REGEXP(wmclass, QString::fromUtf8);
+    COMPILE_MATCH_REGEXP(windowrole, QString::fromUtf8);
+    COMPILE_MATCH_REGEXP(title,);
+    COMPILE_MATCH_REGEXP(clientmachine, QString::fromUtf8);
+}
+
+#undef COMPILE_MATCH_REGEXP
+
 void Rules::readFromSettings(const RuleSettings *settings)
 {
     description = settings->description();
@@ -127,6 +145,7 @@ void Rules::readFromSettings(const RuleSettings *settings)
     READ_MATCH_STRING(windowrole, .toLower().toLatin1());
     READ_MATCH_STRING(title,);
     READ_MATCH_STRING(clientmachine, .toLower().toLatin1());
+    compileMatchRegExps();
     types = NET::WindowTypeMask(settings->types());
     READ_FORCE_RULE(placement,);
     READ_SET_RULE(position);
@@ -335,10 +354,9 @@ bool Rules::matchType(NET::WindowType match_type) const
 bool Rules::matchWMClass(const QByteArray& match_class, const QByteArray& match_name) const
 {
     if (wmclassmatch != UnimportantMatch) {
-        // TODO optimize?
         QByteArray cwmclass = wmclasscomplete
                               ? match_name + ' ' + match_class : match_class;
-        if (wmclassmatch == RegExpMatch && !QRegularExpression(QString::fromUtf8(wmclass)).match(QString::fromUtf8(cwmclass)).hasMatch())
+        if (wmclassmatch == RegExpMatch && !wmclassregexp.match(QString::fromUtf8(cwmclass)).hasMatch())
             return false;
         if (wmclassmatch == ExactMatch && wmclass != cwmclass)
             return false;
@@ -351,7 +369,7 @@ bool Rules::matchWMClass(const QByteArray& match_class, const QByteArray& match_
 bool Rules::matchRole(const QByteArray& match_role) const
 {
     if (windowrolematch != UnimportantMatch) {
-        if (windowrolematch == RegExpMatch && !QRegularExpression(QString::fromUtf8(windowrole)).match(QString::fromUtf8(match_role)).hasMatch())
+        if (windowrolematch == RegExpMatch && !windowroleregexp.match(QString::fromUtf8(match_role)).hasMatch())
             return false;
         if (windowrolematch == ExactMatch && windowrole != match_role)
             return false;
@@ -364,7 +382,7 @@ bool Rules::matchRole(const QByteArray& match_role) const
 bool Rules::matchTitle(const QString& match_title) const
 {
     if (titlematch != UnimportantMatch) {
-        if (titlematch == RegExpMatch && !QRegularExpression(title).match(match_title).hasMatch())
+        if (titlematch == RegExpMatch && !titleregexp.match(match_title).hasMatch())
             return false;
         if (titlematch == ExactMatch && title != match_title)
             return false;
@@ -382,7 +400,7 @@ bool Rules::matchClientMachine(const QByteArray& match_machine, bool local) cons
                 && matchClientMachine("localhost", true))
             return true;
         if (clientmachinematch == RegExpMatch
-                && !QRegularExpression(QString::fromUtf8(clientmachine)).match(QString::fromUtf8(match_machine)).hasMatch())
+                && !clientmachineregexp.match(QString::fromUtf8(match_machine)).hasMatch())
             return false;
         if (clientmachinematch == ExactMatch
                 && clientmachine != match_machine)
@@ -415,6 +433,14 @@ bool Rules::match(const AbstractClient* c) const
     return true;
 }
 
+QByteArray Rules::exactWMClass() const
+{
+    if (wmclassmatch != ExactMatch) {
+        return QByteArray();
+    }
+    return wmclass;
+}
+
 #define NOW_REMEMBER(_T_, _V_) ((selection & _T_) && (_V_##rule == (SetRule)Remember))
 
 bool Rules::update(AbstractClient* c, int selection)
@@ -969,29 +995,69 @@ void RuleBook::deleteAll()
 {
     qDeleteAll(m_rules);
     m_rules.clear();
+    m_matchIndexDirty = true;
+}
+
+void RuleBook::updateMatchIndex()
+{
+    if (!m_matchIndexDirty) {
+        return;
+    }
+    m_exactWMClassRules.clear();
+    m_genericRules.clear();
+    for (int i = 0; i < m_rules.count(); ++i) {
+        const QByteArray wmclass = m_rules.at(i)->exactWMClass();
+        if (wmclass.isEmpty()) {
+            m_genericRules.append(i);
+        } else {
+            m_exactWMClassRules[wmclass].append(i);
+        }
+    }
+    m_matchIndexDirty = false;
+}
+
+QVector<int> RuleBook::matchCandidates(const AbstractClient *c) const
+{
+    // A rule with an exact window class can only match if either the class or
+    // "name class" (see Rules::matchWMClass) is equal to it, so all other
+    // exact rules are skipped without evaluating them.
+    QVector<int> candidates = m_genericRules;
+    const auto addCandidates = [this, &candidates](const QByteArray &wmclass) {
+        const auto it = m_exactWMClassRules.constFind(wmclass);
+        if (it != m_exactWMClassRules.constEnd()) {
+            candidates += *it;
+        }
+    };
+    addCandidates(c->resourceClass());
+    addCandidates(c->resourceName() + ' ' + c->resourceClass());
+    // keep the priority order of the rules
+    std::sort(candidates.begin(), candidates.end());
+    return candidates;
 }
 
 WindowRules RuleBook::find(const AbstractClient* c, bool ignore_temporary)
 {
+    updateMatchIndex();
+    const QVector<int> candidates = matchCandidates(c);
     QVector< Rules* > ret;
-    for (QList< Rules* >::Iterator it = m_rules.begin();
-            it != m_rules.end();
-       ) {
-        if (ignore_temporary && (*it)->isTemporary()) {
-            ++it;
+    QVector<int> usedTemporary;
+    for (int index : candidates) {
+        Rules* rule = m_rules.at(index);
+        if (ignore_temporary && rule->isTemporary()) {
             continue;
         }
-        if ((*it)->match(c)) {
-            Rules* rule = *it;
+        if (rule->match(c)) {
             qCDebug(KWIN_CORE) << "Rule found:" << rule << ":" << c;
             if (rule->isTemporary())
-                it = m_rules.erase(it);
-            else
-                ++it;
+                usedTemporary.append(index);
             ret.append(rule);
-            continue;
         }
-        ++it;
+    }
+    if (!usedTemporary.isEmpty()) {
+        for (auto it = usedTemporary.crbegin(); it != usedTemporary.crend(); ++it) {
+            m_rules.removeAt(*it);
+        }
+        m_matchIndexDirty = true;
     }
     return WindowRules(ret);
 }
@@ -1029,6 +1095,7 @@ void RuleBook::load()
     RuleBookSettings book(m_config);
     book.load();
     m_rules = book.rules().toList();
+    m_matchIndexDirty = true;
 }
 
 void RuleBook::save()
@@ -1059,6 +1126,7 @@ void RuleBook::temporaryRulesMessage(const QString& message)
             was_temporary = true;
     Rules* rule = new Rules(message, true);
     m_rules.prepend(rule);   // highest priority first
+    m_matchIndexDirty = true;
     if (!was_temporary)
         QTimer::singleShot(60000, this, &RuleBook::cleanupTemporaryRules);
 }
@@ -1071,6 +1139,7 @@ void RuleBook::cleanupTemporaryRules()
        ) {
         if ((*it)->discardTemporary(false)) { // deletes (*it)
             it = m_rules.erase(it);
+            m_matchIndexDirty = true;
         } else {
             if ((*it)->isTemporary())
                 has_temporary = true;
@@ -1096,6 +1165,7 @@ void RuleBook::discardUsed(AbstractClient* c, bool withdrawn)
                 Rules* r = *it;
                 it = m_rules.erase(it);
                 delete r;
+                m_matchIndexDirty = true;
                 continue;
             }
         }
@@ -13,6 +13,7 @@
 
 #include <netwm_def.h>
 #include <QRect>
+#include <QRegularExpression>
 #include <QVector>
 
 #include "placement.h"
@@ -134,6 +135,11 @@ public:
 #ifndef KCMRULES
     bool discardUsed(bool withdrawn);
     bool match(const AbstractClient* c) const;
+    /**
+     * @returns the window class this rule requires to match exactly or an empty
+     * QByteArray if the rule matches the window class in some other way.
+     */
+    QByteArray exactWMClass() const;
     bool update(AbstractClient*, int selection);
     bool isTemporary() const;
     bool discardTemporary(bool force);   // removes if temporary and forced or too old
@@ -186,6 +192,7 @@ private:
 private:
 #endif
     void readFromSettings(const RuleSettings *settings);
+    void compileMatchRegExps();
     static ForceRule convertForceRule(int v);
     static QString getDecoColor(const QString &themeName);
 #ifndef KCMRULES
@@ -206,6 +213,11 @@ private:
     QByteArray clientmachine;
     StringMatch clientmachinematch;
     NET::WindowTypes types; // types for matching
+    // compiled once for RegExpMatch, so that matching doesn't have to parse the pattern
+    QRegularExpression wmclassregexp;
+    QRegularExpression windowroleregexp;
+    QRegularExpression titleregexp;
+    QRegularExpression clientmachineregexp;
     Placement::Policy placement;
     ForceRule placementrule;
     QPoint position;
@@ -308,9 +320,16 @@ private:
     void deleteAll();
     void initializeX11();
     void cleanupX11();
+    void updateMatchIndex();
+    QVector<int> matchCandidates(const AbstractClient *c) const;
     QTimer *m_updateTimer;
     bool m_updatesDisabled;
     QList<Rules*> m_rules;
+    // positions in m_rules of rules requiring an exact window class, keyed by that class
+    QHash<QByteArray, QVector<int>> m_exactWMClassRules;
+    // positions in m_rules of all other rules
+    QVector<int> m_genericRules;
+    bool m_matchIndexDirty = true;
     QScopedPointer<KXMessages> m_temporaryRulesMessages;
     KSharedConfig::Ptr m_config;
 
@@ -55,6 +55,7 @@
 #include "scene.h"
 #include "abstract_output.h"
 #include "internal_client.h"
+#include "occlusionculler.h"
 #include "platform.h"
 #include "shadowitem.h"
 #include "surfaceitem.h"
@@ -70,6 +71,7 @@
 #include "x11client.h"
 #include "deleted.h"
 #include "effects.h"
+#include "ftrace.h"
 #include "renderloop.h"
 #include "screens.h"
 #include "shadow.h"
@@ -196,6 +198,8 @@ void Scene::paintScreen(const QRegion &damage, const QRegion &repaint,
                         QRegion *updateRegion, QRegion *validRegion, RenderLoop *renderLoop,
                         const QMatrix4x4 &projection)
 {
+    fTraceScope("paintScreen");
+
     const QSize &screenSize = screens()->size();
     const QRegion displayRegion(0, 0, screenSize.width(), screenSize.height());
 
@@ -223,6 +227,7 @@ void Scene::paintScreen(const QRegion &damage, const QRegion &repaint,
     pdata.paint = region;
     pdata.screen = screen;
 
+    renderLoop->beginFrameStage(RenderJournal::Stage::EffectsPrePaint);
     effects->prePaintScreen(pdata, m_expectedPresentTimestamp);
     region = pdata.paint;
 
@@ -244,6 +249,7 @@ void Scene::paintScreen(const QRegion &damage, const QRegion &repaint,
     repaint_region = repaint;
 
     ScreenPaintData data(projection, screen);
+    renderLoop->beginFrameStage(RenderJournal::Stage::ScenePaint);
     effects->paintScreen(mask, region, data);
 
     Q_EMIT frameRendered();
@@ -267,6 +273,8 @@ void Scene::paintScreen(const QRegion &damage, const QRegion &repaint,
 // the function that'll be eventually called by paintScreen() above
 void Scene::finalPaintScreen(int mask, const QRegion &region, ScreenPaintData& data)
 {
+    fTraceScope("finalPaintScreen");
+
     m_paintScreenCount++;
     if (mask & (PAINT_SCREEN_TRANSFORMED | PAINT_SCREEN_WITH_TRANSFORMED_WINDOWS))
         paintGenericScreen(mask, data);
@@ -276,12 +284,14 @@ void Scene::finalPaintScreen(int mask, const QRegion &region, ScreenPaintData& d
 
 static void resetRepaintsHelper(Item *item, AbstractOutput *output)
 {
-    item->resetRepaints(output);
+    if (!item->hasPendingRepaints(output)) {
+        return;
+    }
 
-    const auto childItems = item->childItems();
-    for (Item *childItem : childItems) {
+    for (Item *childItem : item->childItems()) {
         resetRepaintsHelper(childItem, output);
     }
+    item->resetRepaints(output);
 }
 
 // The generic painting code that can handle even transformations.
@@ -328,13 +338,16 @@ void Scene::paintGenericScreen(int orig_mask, const ScreenPaintData &)
 
 static void accumulateRepaints(Item *item, AbstractOutput *output, QRegion *repaints)
 {
-    *repaints += item->repaints(output);
-    item->resetRepaints(output);
+    // Skip subtrees that have nothing to repaint, e.g. windows that didn't change.
+    if (!item->hasPendingRepaints(output)) {
+        return;
+    }
 
-    const auto childItems = item->childItems();
-    for (Item *childItem : childItems) {
+    *repaints += item->repaints(output);
+    for (Item *childItem : item->childItems()) {
         accumulateRepaints(childItem, output, repaints);
     }
+    item->resetRepaints(output);
 }
 
 // The optimized case without any transformations at all.
@@ -363,6 +376,8 @@ void Scene::paintSimpleScreen(int orig_mask, const QRegion &region)
         // Clip out the decoration for opaque windows; the decoration is drawn in the second pass
         opaqueFullscreen = false; // TODO: do we care about unmanged windows here (maybe input windows?)
         AbstractClient *client = dynamic_cast<AbstractClient *>(toplevel);
+        QRegion shape;
+        QRegion opaque;
         if (window->isOpaque()) {
             if (client) {
                 opaqueFullscreen = client->isFullScreen();
@@ -370,26 +385,23 @@ void Scene::paintSimpleScreen(int orig_mask, const QRegion &region)
 
             const SurfaceItem *surfaceItem = window->surfaceItem();
             if (surfaceItem) {
-                data.clip |= surfaceItem->mapToGlobal(surfaceItem->shape());
+                shape = surfaceItem->shape();
+                opaque = shape;
             }
         } else if (toplevel->hasAlpha() && toplevel->opacity() == 1.0) {
             const SurfaceItem *surfaceItem = window->surfaceItem();
             if (surfaceItem) {
-                const QRegion shape = surfaceItem->shape();
-                const QRegion opaque = surfaceItem->opaque();
-                data.clip = surfaceItem->mapToGlobal(shape & opaque);
+                shape = surfaceItem->shape();
+                opaque = surfaceItem->opaque();
 
                 if (opaque == shape) {
                     data.mask = orig_mask | PAINT_WINDOW_OPAQUE;
                 }
             }
-        } else {
-            data.clip = QRegion();
         }
 
-        if (client && !client->decorationHasAlpha() && toplevel->opacity() == 1.0) {
-            data.clip |= window->decorationShape().translated(window->pos());
-        }
+        const bool opaqueDecoration = client && !client->decorationHasAlpha() && toplevel->opacity() == 1.0;
+        data.clip = window->occlusionClip(shape, opaque, opaqueDecoration);
 
         // preparation step
         effects->prePaintWindow(effectWindow(window), data, m_expectedPresentTimestamp);
@@ -415,13 +427,20 @@ void Scene::paintSimpleScreen(int orig_mask, const QRegion &region)
         fullRepaint = (dirtyArea == displayRegion);
     }
 
-    QRegion allclips, upperTranslucentDamage;
+    QRegion upperTranslucentDamage;
     upperTranslucentDamage = repaint_region;
 
-    // This is the occlusion culling pass
+    // This is the occlusion culling pass. Once opaque windows cover the whole area that
+    // is going to be repainted, the windows below them need no more region arithmetic.
+    OcclusionCuller culler(fullRepaint ? displayRegion : dirtyArea);
     for (int i = phase2data.count() - 1; i >= 0; --i) {
         Phase2Data *data = &phase2data[i];
 
+        if (culler.isCovered()) {
+            data->region = QRegion();
+            continue;
+        }
+
         if (fullRepaint) {
             data->region = displayRegion;
         } else {
@@ -430,13 +449,13 @@ void Scene::paintSimpleScreen(int orig_mask, const QRegion &region)
 
         // subtract the parts which will possibly been drawn as part of
         // a higher opaque window
-        data->region -= allclips;
+        data->region = culler.visible(data->region);
 
         // Here we rely on WindowPrePaintData::setTranslucent() to remove
         // the clip if needed.
         if (!data->clip.isEmpty() && !(data->mask & PAINT_WINDOW_TRANSLUCENT)) {
             // clip away the opaque regions for all windows below this one
-            allclips |= data->clip;
+            culler.addOccluder(data->clip);
             // extend the translucent damage for windows below this by remaining (translucent) regions
             if (!fullRepaint) {
                 upperTranslucentDamage |= data->region - data->clip;
@@ -445,6 +464,7 @@ void Scene::paintSimpleScreen(int orig_mask, const QRegion &region)
             upperTranslucentDamage |= data->region;
         }
     }
+    const QRegion allclips = culler.occluded();
 
     QRegion paintedArea;
     // Fill any areas of the root window not covered by opaque windows
@@ -700,6 +720,27 @@ QRegion Scene::Window::decorationShape() const
     return QRegion(toplevel->rect()) - decorationInnerRect;
 }
 
+QRegion Scene::Window::occlusionClip(const QRegion &shape, const QRegion &opaque, bool opaqueDecoration) const
+{
+    const SurfaceItem *item = surfaceItem();
+    const QPoint surfacePosition = item ? item->rootPosition() : QPoint();
+    const QRegion decoration = opaqueDecoration ? decorationShape().translated(pos()) : QRegion();
+
+    OcclusionClipCache &cache = m_occlusionClipCache;
+    if (cache.surfacePosition != surfacePosition || cache.shape != shape
+            || cache.opaque != opaque || cache.decoration != decoration) {
+        cache.shape = shape;
+        cache.opaque = opaque;
+        cache.decoration = decoration;
+        cache.surfacePosition = surfacePosition;
+
+        QRegion clip = (shape & opaque).translated(surfacePosition);
+        clip |= decoration;
+        cache.clip = OcclusionCuller::simplified(clip);
+    }
+    return cache.clip;
+}
+
 bool Scene::Window::isVisible() const
 {
     if (toplevel->isDeleted())
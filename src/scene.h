@@ -309,6 +309,13 @@ public:
     // is the window fully opaque
     bool isOpaque() const;
     QRegion decorationShape() const;
+    /**
+     * Returns the part of the window that hides the windows below it, in global coordinates.
+     * @a shape and @a opaque describe the opaque part of the main surface, the decoration
+     * is included if @a opaqueDecoration is @c true. The result is simplified for occlusion
+     * culling and cached as long as none of the inputs changes.
+     */
+    QRegion occlusionClip(const QRegion &shape, const QRegion &opaque, bool opaqueDecoration) const;
     void updateToplevel(Deleted *deleted);
     void referencePreviousPixmap();
     void unreferencePreviousPixmap();
@@ -326,6 +333,16 @@ private:
 
     int disable_painting;
     QScopedPointer<WindowItem> m_windowItem;
+
+    struct OcclusionClipCache {
+        QRegion shape;
+        QRegion opaque;
+        QRegion decoration;
+        QPoint surfacePosition;
+        QRegion clip;
+    };
+    mutable OcclusionClipCache m_occlusionClipCache;
+
     Q_DISABLE_COPY(Window)
 };
 
@@ -0,0 +1,249 @@
+/*
+    KWin - the KDE window manager
+    This file is part of the KDE project.
+
+    SPDX-FileCopyrightText: 2006 Lubos Lunak <l.lunak@kde.org>
+    SPDX-FileCopyrightText: 2009, 2010, 2011 Martin Gräßlin <mgraesslin@kde.org>
+    SPDX-FileCopyrightText: 2019 Vlad Zahorodnii <vlad.zahorodnii@kde.org>
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#include "decorationatlas.h"
+
+#include <kwingltexture.h>
+#include <kwinglutils.h>
+
+namespace KWin
+{
+
+// The atlas is as wide as the widest decorations we expect and grows in height.
+static const int s_maxAtlasWidth = 4096;
+static const int s_initialAtlasHeight = 256;
+
+ShelfPacker::ShelfPacker(const QSize &size)
+    : m_size(size)
+{
+}
+
+QSize ShelfPacker::size() const
+{
+    return m_size;
+}
+
+void ShelfPacker::setHeight(int height)
+{
+    Q_ASSERT(m_shelves.isEmpty() || m_shelves.last().y + m_shelves.last().height <= height);
+    m_size.setHeight(height);
+}
+
+QRect ShelfPacker::allocate(const QSize &size)
+{
+    if (size.isEmpty() || size.width() > m_size.width()) {
+        return QRect();
+    }
+
+    // Find the shelf that wastes the least vertical space. Shelves that are much higher
+    // than the requested size are skipped so they stay available for larger items.
+    Shelf *bestShelf = nullptr;
+    int bestSpan = -1;
+    for (Shelf &shelf : m_shelves) {
+        if (shelf.height < size.height() || shelf.height > size.height() + size.height() / 2) {
+            continue;
+        }
+        if (bestShelf && bestShelf->height <= shelf.height) {
+            continue;
+        }
+        for (int i = 0; i < shelf.freeSpans.count(); ++i) {
+            if (shelf.freeSpans[i].width >= size.width()) {
+                bestShelf = &shelf;
+                bestSpan = i;
+                break;
+            }
+        }
+    }
+
+    if (bestShelf) {
+        Span &span = bestShelf->freeSpans[bestSpan];
+        const QRect rect(span.x, bestShelf->y, size.width(), size.height());
+        span.x += size.width();
+        span.width -= size.width();
+        if (!span.width) {
+            bestShelf->freeSpans.remove(bestSpan);
+        }
+        return rect;
+    }
+
+    const int y = m_shelves.isEmpty() ? 0 : m_shelves.last().y + m_shelves.last().height;
+    if (y + size.height() > m_size.height()) {
+        return QRect();
+    }
+
+    Shelf shelf;
+    shelf.y = y;
+    shelf.height = size.height();
+    if (size.width() < m_size.width()) {
+        shelf.freeSpans.append(Span{size.width(), m_size.width() - size.width()});
+    }
+    m_shelves.append(shelf);
+
+    return QRect(0, y, size.width(), size.height());
+}
+
+void ShelfPacker::release(const QRect &rect)
+{
+    auto shelf = std::find_if(m_shelves.begin(), m_shelves.end(), [&rect](const Shelf &shelf) {
+        return shelf.y == rect.y();
+    });
+    if (shelf == m_shelves.end()) {
+        return;
+    }
+
+    QVector<Span> &spans = shelf->freeSpans;
+    auto it = std::lower_bound(spans.begin(), spans.end(), rect.x(), [](const Span &span, int x) {
+        return span.x < x;
+    });
+    it = spans.insert(it, Span{rect.x(), rect.width()});
+
+    // Merge the released span with its neighbours.
+    if (it + 1 != spans.end() && it->x + it->width == (it + 1)->x) {
+        it->width += (it + 1)->width;
+        it = spans.erase(it + 1) - 1;
+    }
+    if (it != spans.begin() && (it - 1)->x + (it - 1)->width == it->x) {
+        (it - 1)->width += it->width;
+        spans.erase(it);
+    }
+
+    // Drop empty shelves at the end so their space can be used for shelves of any height.
+    while (!m_shelves.isEmpty()) {
+        const Shelf &last = m_shelves.last();
+        if (last.freeSpans.count() != 1 || last.freeSpans.first().width != m_size.width()) {
+            break;
+        }
+        m_shelves.removeLast();
+    }
+}
+
+DecorationAtlas::DecorationAtlas(QObject *parent)
+    : QObject(parent)
+{
+}
+
+DecorationAtlas::~DecorationAtlas()
+{
+    qDeleteAll(m_entries);
+}
+
+GLTexture *DecorationAtlas::texture() const
+{
+    return m_texture.data();
+}
+
+bool DecorationAtlas::ensureTexture(const QSize &size)
+{
+    if (!m_texture) {
+        glGetIntegerv(GL_MAX_TEXTURE_SIZE, &m_maxTextureSize);
+
+        const int width = std::min(m_maxTextureSize, s_maxAtlasWidth);
+        const int height = std::min(m_maxTextureSize, s_initialAtlasHeight);
+
+        m_texture.reset(new GLTexture(GL_RGBA8, width, height));
+        m_texture->setYInverted(true);
+        m_texture->setWrapMode(GL_CLAMP_TO_EDGE);
+        m_texture->clear();
+        m_packer = ShelfPacker(m_texture->size());
+    }
+    return size.width() <= m_texture->width() && size.height() <= m_maxTextureSize;
+}
+
+bool DecorationAtlas::grow()
+{
+    const int height = m_texture->height() * 2;
+    if (height > m_maxTextureSize || !GLRenderTarget::supported()) {
+        return false;
+    }
+
+    GLRenderTarget renderTarget(*m_texture);
+    if (!renderTarget.valid()) {
+        return false;
+    }
+
+    QScopedPointer<GLTexture> texture(new GLTexture(GL_RGBA8, m_texture->width(), height));
+    texture->setYInverted(true);
+    texture->setWrapMode(GL_CLAMP_TO_EDGE);
+    texture->clear();
+
+    // Copy the decorations to the new texture, their positions don't change.
+    GLRenderTarget::pushRenderTarget(&renderTarget);
+    texture->bind();
+    glCopyTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 0, 0, m_texture->width(), m_texture->height());
+    texture->unbind();
+    GLRenderTarget::popRenderTarget();
+
+    m_texture.reset(texture.take());
+    m_packer.setHeight(height);
+    return true;
+}
+
+DecorationAtlas::Entry *DecorationAtlas::allocate(const QSize &size)
+{
+    if (!ensureTexture(size)) {
+        return nullptr;
+    }
+
+    QRect rect = m_packer.allocate(size);
+    while (!rect.isValid()) {
+        if (!grow()) {
+            return nullptr;
+        }
+        rect = m_packer.allocate(size);
+    }
+
+    Entry *entry = new Entry;
+    entry->rect = rect;
+    m_entries.append(entry);
+    return entry;
+}
+
+DecorationAtlas::Entry *DecorationAtlas::acquire(quint64 key, const QSize &size)
+{
+    Entry *entry = m_publishedEntries.value(key);
+    if (!entry || entry->rect.size() != size) {
+        return nullptr;
+    }
+    entry->refCount++;
+    return entry;
+}
+
+void DecorationAtlas::publish(Entry *entry, quint64 key)
+{
+    unpublish(entry);
+    if (m_publishedEntries.contains(key)) {
+        return;
+    }
+    entry->key = key;
+    entry->published = true;
+    m_publishedEntries.insert(key, entry);
+}
+
+void DecorationAtlas::unpublish(Entry *entry)
+{
+    if (entry->published) {
+        m_publishedEntries.remove(entry->key);
+        entry->published = false;
+    }
+}
+
+void DecorationAtlas::release(Entry *entry)
+{
+    if (--entry->refCount) {
+        return;
+    }
+    unpublish(entry);
+    m_packer.release(entry->rect);
+    m_entries.removeOne(entry);
+    delete entry;
+}
+
+} // namespace KWin
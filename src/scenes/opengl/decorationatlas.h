@@ -0,0 +1,127 @@
+/*
+    KWin - the KDE window manager
+    This file is part of the KDE project.
+
+    SPDX-FileCopyrightText: 2006 Lubos Lunak <l.lunak@kde.org>
+    SPDX-FileCopyrightText: 2009, 2010, 2011 Martin Gräßlin <mgraesslin@kde.org>
+    SPDX-FileCopyrightText: 2019 Vlad Zahorodnii <vlad.zahorodnii@kde.org>
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#ifndef KWIN_DECORATIONATLAS_H
+#define KWIN_DECORATIONATLAS_H
+
+#include "kwinglobals.h"
+
+#include <QHash>
+#include <QObject>
+#include <QRect>
+#include <QScopedPointer>
+#include <QVector>
+
+namespace KWin
+{
+
+class GLTexture;
+
+/**
+ * The ShelfPacker class assigns rectangles in an area of fixed width. Rectangles are placed
+ * on horizontal shelves; a shelf is reused for rectangles that are only slightly lower than
+ * the shelf itself. Released space can be reused by later allocations.
+ */
+class KWIN_EXPORT ShelfPacker
+{
+public:
+    explicit ShelfPacker(const QSize &size = QSize());
+
+    QSize size() const;
+    /**
+     * Changes the height of the packed area. The width must not change, and the height
+     * must not become smaller than the space occupied by the shelves.
+     */
+    void setHeight(int height);
+
+    /**
+     * Returns the rectangle reserved for an item with the given @a size, or an invalid
+     * rectangle if there is not enough space left.
+     */
+    QRect allocate(const QSize &size);
+    void release(const QRect &rect);
+
+private:
+    struct Span {
+        int x;
+        int width;
+    };
+    struct Shelf {
+        int y;
+        int height;
+        QVector<Span> freeSpans;
+    };
+
+    QVector<Shelf> m_shelves;
+    QSize m_size;
+};
+
+/**
+ * The DecorationAtlas class manages one texture shared by the decorations of all windows.
+ *
+ * Each decoration occupies an entry in the atlas. Decorations with identical contents, for
+ * example inactive windows of the same size, can share one entry. Such shared entries are
+ * looked up by a key that the caller computes from the contents.
+ */
+class DecorationAtlas : public QObject
+{
+    Q_OBJECT
+
+public:
+    struct Entry {
+        QRect rect;
+        int refCount = 1;
+        quint64 key = 0;
+        bool published = false;
+    };
+
+    explicit DecorationAtlas(QObject *parent = nullptr);
+    ~DecorationAtlas() override;
+
+    GLTexture *texture() const;
+
+    /**
+     * Reserves space for a decoration with the given @a size in device pixels. The atlas
+     * texture is grown if needed. Returns @c nullptr if the decoration doesn't fit.
+     */
+    Entry *allocate(const QSize &size);
+    /**
+     * Returns a new reference to the published entry with the given @a key and @a size,
+     * or @c nullptr if no such entry exists.
+     */
+    Entry *acquire(quint64 key, const QSize &size);
+    /**
+     * Makes the @a entry available to acquire() under the given @a key.
+     */
+    void publish(Entry *entry, quint64 key);
+    /**
+     * Hides the @a entry from acquire(), e.g. because its contents are about to change.
+     */
+    void unpublish(Entry *entry);
+    /**
+     * Drops a reference to the @a entry. The space is reused once the last reference is gone.
+     */
+    void release(Entry *entry);
+
+private:
+    bool ensureTexture(const QSize &size);
+    bool grow();
+
+    QScopedPointer<GLTexture> m_texture;
+    ShelfPacker m_packer;
+    QHash<quint64, Entry *> m_publishedEntries;
+    QVector<Entry *> m_entries;
+    int m_maxTextureSize = 0;
+};
+
+} // namespace KWin
+
+#endif
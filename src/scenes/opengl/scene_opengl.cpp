@@ -24,6 +24,7 @@
 #include "abstract_client.h"
 #include "composite.h"
 #include "effects.h"
+#include "ftrace.h"
 #include "lanczosfilter.h"
 #include "main.h"
 #include "overlaywindow.h"
@@ -70,9 +71,84 @@ namespace KWin
  * SceneOpenGL
  ***********************************************/
 
+GLRenderTimeQuery::GLRenderTimeQuery(RenderLoop *renderLoop)
+    : m_renderLoop(renderLoop)
+{
+    for (Query &query : m_queries) {
+        glGenQueries(1, &query.begin);
+        glGenQueries(1, &query.end);
+    }
+}
+
+GLRenderTimeQuery::~GLRenderTimeQuery()
+{
+    for (Query &query : m_queries) {
+        glDeleteQueries(1, &query.begin);
+        glDeleteQueries(1, &query.end);
+    }
+}
+
+bool GLRenderTimeQuery::supported()
+{
+    // GLES only provides timer queries through GL_EXT_disjoint_timer_query, whose results
+    // have to be discarded whenever the GPU reports a disjoint operation.
+    if (GLPlatform::instance()->isGLES()) {
+        return false;
+    }
+    return hasGLVersion(3, 3) || hasGLExtension(QByteArrayLiteral("GL_ARB_timer_query"));
+}
+
+void GLRenderTimeQuery::begin()
+{
+    collect();
+
+    // If the GPU is lagging behind by more frames than there are queries, don't wait
+    // for it and leave this frame out.
+    Query &query = m_queries[m_next];
+    if (query.pending) {
+        m_current = nullptr;
+        return;
+    }
+    m_current = &query;
+    m_next = (m_next + 1) % m_queries.size();
+    glQueryCounter(query.begin, GL_TIMESTAMP);
+}
+
+void GLRenderTimeQuery::end()
+{
+    if (m_current) {
+        glQueryCounter(m_current->end, GL_TIMESTAMP);
+        m_current->pending = true;
+        m_current = nullptr;
+    }
+}
+
+void GLRenderTimeQuery::collect()
+{
+    for (Query &query : m_queries) {
+        if (!query.pending) {
+            continue;
+        }
+        GLint available = 0;
+        glGetQueryObjectiv(query.end, GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available) {
+            continue;
+        }
+        GLuint64 begin = 0;
+        GLuint64 end = 0;
+        glGetQueryObjectui64v(query.begin, GL_QUERY_RESULT, &begin);
+        glGetQueryObjectui64v(query.end, GL_QUERY_RESULT, &end);
+        query.pending = false;
+        if (end > begin) {
+            m_renderLoop->addGpuRenderTime(std::chrono::nanoseconds(end - begin));
+        }
+    }
+}
+
 SceneOpenGL::SceneOpenGL(OpenGLBackend *backend, QObject *parent)
     : Scene(parent)
     , m_backend(backend)
+    , m_decorationAtlas(new DecorationAtlas)
 {
     // We only support the OpenGL 2+ shader API, not GL_ARB_shader_objects
     if (!hasGLVersion(2, 0)) {
@@ -86,6 +162,16 @@ SceneOpenGL::SceneOpenGL(OpenGLBackend *backend, QObject *parent)
         glGenVertexArrays(1, &vao);
         glBindVertexArray(vao);
     }
+
+    m_renderTimeQueriesSupported = GLRenderTimeQuery::supported();
+
+    // Create the shaders used for painting windows upfront. They are cheap to load from the
+    // program cache and would otherwise be compiled while the first frames are painted.
+    ShaderManager *shaderManager = ShaderManager::instance();
+    shaderManager->shader(ShaderTrait::UniformColor);
+    shaderManager->shader(ShaderTrait::MapTexture);
+    shaderManager->shader(ShaderTrait::MapTexture | ShaderTrait::Modulate);
+    shaderManager->shader(ShaderTrait::MapTexture | ShaderTrait::Modulate | ShaderTrait::AdjustSaturation);
 }
 
 SceneOpenGL::~SceneOpenGL()
@@ -93,6 +179,8 @@ SceneOpenGL::~SceneOpenGL()
     if (init_ok) {
         makeOpenGLContextCurrent();
     }
+    qDeleteAll(m_renderTimeQueries);
+    m_decorationAtlas.reset();
     if (m_lanczosFilter) {
         delete m_lanczosFilter;
         m_lanczosFilter = nullptr;
@@ -109,6 +197,23 @@ SceneOpenGL *SceneOpenGL::createScene(OpenGLBackend *backend, QObject *parent)
     return nullptr;
 }
 
+GLRenderTimeQuery *SceneOpenGL::renderTimeQuery(RenderLoop *renderLoop)
+{
+    if (!m_renderTimeQueriesSupported) {
+        return nullptr;
+    }
+    GLRenderTimeQuery *&query = m_renderTimeQueries[renderLoop];
+    if (!query) {
+        query = new GLRenderTimeQuery(renderLoop);
+        connect(renderLoop, &QObject::destroyed, this, [this, renderLoop]() {
+            if (makeOpenGLContextCurrent()) {
+                delete m_renderTimeQueries.take(renderLoop);
+            }
+        });
+    }
+    return query;
+}
+
 bool SceneOpenGL::initFailed() const
 {
     return !init_ok;
@@ -308,6 +413,11 @@ void SceneOpenGL::paint(AbstractOutput *output, const QRegion &damage, const QLi
             repaint = m_backend->beginFrame(output);
             GLVertexBuffer::streamingBuffer()->beginFrame();
 
+            GLRenderTimeQuery *timeQuery = renderTimeQuery(renderLoop);
+            if (timeQuery) {
+                timeQuery->begin();
+            }
+
             GLVertexBuffer::setVirtualScreenGeometry(geo);
             GLRenderTarget::setVirtualScreenGeometry(geo);
             GLVertexBuffer::setVirtualScreenScale(scaling);
@@ -334,10 +444,19 @@ void SceneOpenGL::paint(AbstractOutput *output, const QRegion &damage, const QLi
                 }
             }
 
+            if (timeQuery) {
+                timeQuery->end();
+            }
+
             renderLoop->endFrame();
 
-            GLVertexBuffer::streamingBuffer()->endOfFrame();
-            m_backend->endFrame(output, valid, update);
+            {
+                fTraceScope("present");
+                renderLoop->beginFrameStage(RenderJournal::Stage::BackendPresent);
+                GLVertexBuffer::streamingBuffer()->endOfFrame();
+                m_backend->endFrame(output, valid, update);
+                renderLoop->endFrameStage();
+            }
         }
     }
 
@@ -542,7 +661,9 @@ void SceneOpenGL::paintSimpleScreen(int mask, const QRegion &region)
 {
     m_screenProjectionMatrix = m_projectionMatrix;
 
+    beginWindowBatch();
     Scene::paintSimpleScreen(mask, region);
+    endWindowBatch();
 }
 
 void SceneOpenGL::paintGenericScreen(int mask, const ScreenPaintData &data)
@@ -551,7 +672,52 @@ void SceneOpenGL::paintGenericScreen(int mask, const ScreenPaintData &data)
 
     m_screenProjectionMatrix = m_projectionMatrix * screenMatrix;
 
+    beginWindowBatch();
     Scene::paintGenericScreen(mask, data);
+    endWindowBatch();
+}
+
+void SceneOpenGL::beginWindowBatch()
+{
+    m_windowBatchActive = true;
+}
+
+void SceneOpenGL::endWindowBatch()
+{
+    ShaderManager *shaderManager = ShaderManager::instance();
+    if (m_batchShader && shaderManager->getBoundShader() == m_batchShader) {
+        shaderManager->popShader();
+    }
+    m_batchShader = nullptr;
+    m_windowBatchActive = false;
+}
+
+DecorationAtlas *SceneOpenGL::decorationAtlas() const
+{
+    return m_decorationAtlas.data();
+}
+
+GLShader *SceneOpenGL::bindWindowShader(ShaderTraits traits, bool *pop)
+{
+    ShaderManager *shaderManager = ShaderManager::instance();
+
+    // The batch shader can only be replaced if it is at the top of the shader stack,
+    // e.g. not if an effect has pushed its own shader and paints the window with it.
+    if (m_windowBatchActive && shaderManager->getBoundShader() == m_batchShader) {
+        GLShader *shader = shaderManager->shader(traits);
+        if (shader != m_batchShader) {
+            if (m_batchShader) {
+                shaderManager->popShader();
+            }
+            shaderManager->pushShader(shader);
+            m_batchShader = shader;
+        }
+        *pop = false;
+        return shader;
+    }
+
+    *pop = true;
+    return shaderManager->pushShader(traits);
 }
 
 void SceneOpenGL::doPaintBackground(const QVector< float >& vertices)
@@ -652,6 +818,8 @@ static GLTexture *bindSurfaceTexture(SurfaceItem *surfaceItem)
     return platformSurfaceTexture->texture();
 }
 
+static const int s_maxScissorRects = 4;
+
 static WindowQuadList clipQuads(const Item *item, const OpenGLWindow::RenderContext *context)
 {
     const WindowQuadList quads = item->quads();
@@ -721,7 +889,7 @@ void OpenGLWindow::createRenderNode(Item *item, RenderContext *context)
             auto renderer = static_cast<const SceneOpenGLDecorationRenderer *>(decorationItem->renderer());
             context->renderNodes.append(RenderNode{
                 .texture = renderer->texture(),
-                .quads = quads,
+                .quads = renderer->mapToTexture(quads),
                 .transformMatrix = context->transforms.top(),
                 .opacity = context->paintData.opacity(),
                 .hasAlpha = true,
@@ -759,6 +927,96 @@ void OpenGLWindow::createRenderNode(Item *item, RenderContext *context)
     context->transforms.pop();
 }
 
+bool OpenGLWindow::applyVertexCache(QVector<RenderNode> &renderNodes) const
+{
+    if (!m_vertexBuffer) {
+        return false;
+    }
+    int cacheIndex = 0;
+    for (const RenderNode &renderNode : qAsConst(renderNodes)) {
+        if (renderNode.quads.isEmpty() || !renderNode.texture) {
+            continue;
+        }
+        if (cacheIndex == m_vertexCache.count()) {
+            return false;
+        }
+        const CachedRenderNode &cachedNode = m_vertexCache[cacheIndex++];
+        if (!cachedNode.quads.isSharedWith(renderNode.quads) || cachedNode.texture != renderNode.texture
+                || cachedNode.textureMatrix != renderNode.texture->matrix(renderNode.coordinateType)) {
+            return false;
+        }
+    }
+    if (cacheIndex != m_vertexCache.count()) {
+        return false;
+    }
+
+    cacheIndex = 0;
+    for (RenderNode &renderNode : renderNodes) {
+        if (renderNode.quads.isEmpty() || !renderNode.texture) {
+            continue;
+        }
+        const CachedRenderNode &cachedNode = m_vertexCache[cacheIndex++];
+        renderNode.firstVertex = cachedNode.firstVertex;
+        renderNode.vertexCount = cachedNode.vertexCount;
+    }
+    return true;
+}
+
+void OpenGLWindow::updateVertexCache(QVector<RenderNode> &renderNodes)
+{
+    m_vertexCache.clear();
+
+    int quadCount = 0;
+    for (const RenderNode &node : qAsConst(renderNodes)) {
+        if (node.texture) {
+            quadCount += node.quads.count();
+        }
+    }
+    if (!quadCount) {
+        return;
+    }
+
+    const bool indexedQuads = GLVertexBuffer::supportsIndexedQuads();
+    const GLenum primitiveType = indexedQuads ? GL_QUADS : GL_TRIANGLES;
+    const int verticesPerQuad = indexedQuads ? 4 : 6;
+    const size_t size = verticesPerQuad * quadCount * sizeof(GLVertex2D);
+
+    const GLVertexAttrib attribs[] = {
+        { VA_Position, 2, GL_FLOAT, offsetof(GLVertex2D, position) },
+        { VA_TexCoord, 2, GL_FLOAT, offsetof(GLVertex2D, texcoord) },
+    };
+
+    if (!m_vertexBuffer) {
+        m_vertexBuffer.reset(new GLVertexBuffer(GLVertexBuffer::Dynamic));
+        m_vertexBuffer->setAttribLayout(attribs, 2, sizeof(GLVertex2D));
+    }
+
+    GLVertex2D *map = (GLVertex2D *) m_vertexBuffer->map(size);
+
+    for (int i = 0, v = 0; i < renderNodes.count(); i++) {
+        RenderNode &renderNode = renderNodes[i];
+        if (renderNode.quads.isEmpty() || !renderNode.texture)
+            continue;
+
+        renderNode.firstVertex = v;
+        renderNode.vertexCount = renderNode.quads.count() * verticesPerQuad;
+
+        const QMatrix4x4 matrix = renderNode.texture->matrix(renderNode.coordinateType);
+
+        renderNode.quads.makeInterleavedArrays(primitiveType, &map[v], matrix);
+        m_vertexCache.append(CachedRenderNode{
+            .quads = renderNode.quads,
+            .texture = renderNode.texture,
+            .textureMatrix = matrix,
+            .firstVertex = renderNode.firstVertex,
+            .vertexCount = renderNode.vertexCount,
+        });
+        v += renderNode.vertexCount;
+    }
+
+    m_vertexBuffer->unmap();
+}
+
 QMatrix4x4 OpenGLWindow::modelViewProjectionMatrix(int mask, const WindowPaintData &data) const
 {
     const QMatrix4x4 pMatrix = data.projectionMatrix();
@@ -814,10 +1072,16 @@ void OpenGLWindow::performPaint(int mask, const QRegion &region, const WindowPai
         return;
     }
 
+    // Clipping the quads on the CPU changes the vertices whenever the repaint region
+    // changes, so prefer the scissor test for small regions to keep the vertex cache valid.
+    // The scissor rects are in screen coordinates, which doesn't hold if an effect renders
+    // the window with its own projection.
+    const bool transformed = (mask & Scene::PAINT_WINDOW_TRANSFORMED) || (mask & Scene::PAINT_SCREEN_TRANSFORMED);
+    const bool scissorFriendly = data.projectionMatrix().isIdentity() && region.rectCount() <= s_maxScissorRects;
     RenderContext renderContext {
         .clip = region,
         .paintData = data,
-        .hardwareClipping = region != infiniteRegion() && ((mask & Scene::PAINT_WINDOW_TRANSFORMED) || (mask & Scene::PAINT_SCREEN_TRANSFORMED)),
+        .hardwareClipping = region != infiniteRegion() && (transformed || scissorFriendly),
     };
 
     renderContext.transforms.push(QMatrix4x4());
@@ -826,15 +1090,16 @@ void OpenGLWindow::performPaint(int mask, const QRegion &region, const WindowPai
 
     createRenderNode(windowItem(), &renderContext);
 
-    int quadCount = 0;
-    for (const RenderNode &node : qAsConst(renderContext.renderNodes)) {
-        quadCount += node.quads.count();
+    // Static windows keep their vertices on the GPU, only the uniforms are updated.
+    if (!applyVertexCache(renderContext.renderNodes)) {
+        updateVertexCache(renderContext.renderNodes);
     }
-    if (!quadCount) {
+    if (m_vertexCache.isEmpty()) {
         return;
     }
 
     GLShader *shader = data.shader;
+    bool popShader = false;
     if (!shader) {
         ShaderTraits traits = ShaderTrait::MapTexture;
 
@@ -844,45 +1109,17 @@ void OpenGLWindow::performPaint(int mask, const QRegion &region, const WindowPai
         if (data.saturation() != 1.0)
             traits |= ShaderTrait::AdjustSaturation;
 
-        shader = ShaderManager::instance()->pushShader(traits);
+        shader = m_scene->bindWindowShader(traits, &popShader);
     }
     shader->setUniform(GLShader::Saturation, data.saturation());
 
-    const bool indexedQuads = GLVertexBuffer::supportsIndexedQuads();
-    const GLenum primitiveType = indexedQuads ? GL_QUADS : GL_TRIANGLES;
-    const int verticesPerQuad = indexedQuads ? 4 : 6;
-    const size_t size = verticesPerQuad * quadCount * sizeof(GLVertex2D);
+    const GLenum primitiveType = GLVertexBuffer::supportsIndexedQuads() ? GL_QUADS : GL_TRIANGLES;
 
     if (renderContext.hardwareClipping) {
         glEnable(GL_SCISSOR_TEST);
     }
 
-    const GLVertexAttrib attribs[] = {
-        { VA_Position, 2, GL_FLOAT, offsetof(GLVertex2D, position) },
-        { VA_TexCoord, 2, GL_FLOAT, offsetof(GLVertex2D, texcoord) },
-    };
-
-    GLVertexBuffer *vbo = GLVertexBuffer::streamingBuffer();
-    vbo->reset();
-    vbo->setAttribLayout(attribs, 2, sizeof(GLVertex2D));
-
-    GLVertex2D *map = (GLVertex2D *) vbo->map(size);
-
-    for (int i = 0, v = 0; i < renderContext.renderNodes.count(); i++) {
-        RenderNode &renderNode = renderContext.renderNodes[i];
-        if (renderNode.quads.isEmpty() || !renderNode.texture)
-            continue;
-
-        renderNode.firstVertex = v;
-        renderNode.vertexCount = renderNode.quads.count() * verticesPerQuad;
-
-        const QMatrix4x4 matrix = renderNode.texture->matrix(renderNode.coordinateType);
-
-        renderNode.quads.makeInterleavedArrays(primitiveType, &map[v], matrix);
-        v += renderNode.quads.count() * verticesPerQuad;
-    }
-
-    vbo->unmap();
+    GLVertexBuffer *vbo = m_vertexBuffer.data();
     vbo->bindArrays();
 
     // Make sure the blend function is set up correctly in case we will be doing blending
@@ -918,7 +1155,7 @@ void OpenGLWindow::performPaint(int mask, const QRegion &region, const WindowPai
 
     setBlendEnabled(false);
 
-    if (!data.shader)
+    if (popShader)
         ShaderManager::instance()->popShader();
 
     if (renderContext.hardwareClipping) {
@@ -1537,6 +1774,9 @@ SceneOpenGLDecorationRenderer::SceneOpenGLDecorationRenderer(Decoration::Decorat
     : DecorationRenderer(client)
     , m_texture()
 {
+    if (auto scene = qobject_cast<SceneOpenGL *>(Compositor::self()->scene())) {
+        m_atlas = scene->decorationAtlas();
+    }
 }
 
 SceneOpenGLDecorationRenderer::~SceneOpenGLDecorationRenderer()
@@ -1544,31 +1784,53 @@ SceneOpenGLDecorationRenderer::~SceneOpenGLDecorationRenderer()
     if (Scene *scene = Compositor::self()->scene()) {
         scene->makeOpenGLContextCurrent();
     }
+    releaseTexture();
 }
 
-// Rotates the given source rect 90° counter-clockwise,
-// and flips it vertically
-static QImage rotate(const QImage &srcImage, const QRect &srcRect)
+GLTexture *SceneOpenGLDecorationRenderer::texture() const
 {
-    auto dpr = srcImage.devicePixelRatio();
-    QImage image(srcRect.height() * dpr, srcRect.width() * dpr, srcImage.format());
-    image.setDevicePixelRatio(dpr);
-    const QPoint srcPoint(srcRect.x() * dpr, srcRect.y() * dpr);
+    if (m_atlasEntry) {
+        return m_atlas ? m_atlas->texture() : nullptr;
+    }
+    return m_texture.data();
+}
 
-    const uint32_t *src = reinterpret_cast<const uint32_t *>(srcImage.bits());
-    uint32_t *dst = reinterpret_cast<uint32_t *>(image.bits());
+QPoint SceneOpenGLDecorationRenderer::textureOffset() const
+{
+    return m_atlasEntry ? m_atlasEntry->rect.topLeft() : QPoint();
+}
 
-    for (int x = 0; x < image.width(); x++) {
-        const uint32_t *s = src + (srcPoint.y() + x) * srcImage.width() + srcPoint.x();
-        uint32_t *d = dst + x;
+WindowQuadList SceneOpenGLDecorationRenderer::mapToTexture(const WindowQuadList &quads) const
+{
+    const QPoint offset = textureOffset();
+    if (offset.isNull()) {
+        return quads;
+    }
 
-        for (int y = 0; y < image.height(); y++) {
-            *d = s[y];
-            d += image.width();
+    // Keep returning the same list while the quads don't change, so the window's vertex
+    // cache can still be used.
+    if (!m_mappedQuadsSource.isSharedWith(quads) || m_mappedQuadsOffset != offset) {
+        m_mappedQuads.clear();
+        m_mappedQuads.reserve(quads.count());
+        for (WindowQuad quad : quads) {
+            for (int i = 0; i < 4; ++i) {
+                quad[i] = WindowVertex(quad[i].x(), quad[i].y(), quad[i].u() + offset.x(), quad[i].v() + offset.y());
+            }
+            m_mappedQuads.append(quad);
         }
+        m_mappedQuadsSource = quads;
+        m_mappedQuadsOffset = offset;
     }
+    return m_mappedQuads;
+}
 
-    return image;
+void SceneOpenGLDecorationRenderer::releaseTexture()
+{
+    if (m_atlasEntry && m_atlas) {
+        m_atlas->release(m_atlasEntry);
+    }
+    m_atlasEntry = nullptr;
+    m_texture.reset();
 }
 
 static void clamp_row(int left, int width, int right, const uint32_t *src, uint32_t *dest)
@@ -1621,6 +1883,83 @@ static void clamp(QImage &image, const QRect &viewport)
     }
 }
 
+static int align(int value, int align)
+{
+    return (value + align - 1) & ~(align - 1);
+}
+
+void SceneOpenGLDecorationRenderer::rasterize(Part &part)
+{
+    // We pad each part in the decoration atlas in order to avoid texture bleeding.
+    const int padding = 1;
+
+    const QRect &geo = part.geometry;
+    QRect rect = geo;
+
+    // We allow partial decoration updates and it might just so happen that the dirty region
+    // is completely contained inside the decoration part, i.e. the dirty region doesn't touch
+    // any of the decoration's edges. In that case, we should **not** pad the dirty region.
+    if (rect.left() == part.partRect.left()) {
+        rect.setLeft(rect.left() - padding);
+    }
+    if (rect.top() == part.partRect.top()) {
+        rect.setTop(rect.top() - padding);
+    }
+    if (rect.right() == part.partRect.right()) {
+        rect.setRight(rect.right() + padding);
+    }
+    if (rect.bottom() == part.partRect.bottom()) {
+        rect.setBottom(rect.bottom() + padding);
+    }
+
+    QRect viewport = geo.translated(-rect.x(), -rect.y());
+    QPoint dirtyOffset = geo.topLeft() - part.partRect.topLeft();
+    QSize imageSize = rect.size();
+    QTransform transform = QTransform::fromTranslate(-rect.x(), -rect.y());
+    if (part.rotated) {
+        // Side parts are stored rotated by 90° counter-clockwise and flipped vertically,
+        // paint them that way right away rather than rotating the image afterwards.
+        viewport = viewport.transposed();
+        dirtyOffset = dirtyOffset.transposed();
+        imageSize.transpose();
+        transform = QTransform(0, 1, 1, 0, -rect.y(), -rect.x());
+    }
+
+    const qreal devicePixelRatio = client()->client()->screenScale();
+
+    QImage image(imageSize * devicePixelRatio, QImage::Format_ARGB32_Premultiplied);
+    image.setDevicePixelRatio(devicePixelRatio);
+    image.fill(Qt::transparent);
+
+    QPainter painter(&image);
+    painter.setRenderHint(QPainter::Antialiasing);
+    painter.setTransform(transform);
+    painter.setClipRect(geo);
+    renderToPainter(&painter, geo);
+    painter.end();
+
+    const QRect viewportScaled(viewport.topLeft() * devicePixelRatio, viewport.size() * devicePixelRatio);
+    const bool isIntegerScaling = qFuzzyCompare(devicePixelRatio, std::ceil(devicePixelRatio));
+    clamp(image, isIntegerScaling ? viewportScaled : viewportScaled.marginsRemoved({1, 1, 1, 1}));
+
+    part.image = image;
+    part.offset = (part.position + dirtyOffset - viewport.topLeft()) * devicePixelRatio;
+}
+
+quint64 SceneOpenGLDecorationRenderer::contentsKey(const QVector<Part> &parts) const
+{
+    // Two independently seeded hashes make collisions between different decorations unlikely.
+    uint low = qHash(m_textureSize.width(), 1);
+    uint high = qHash(m_textureSize.height(), 2);
+    for (const Part &part : parts) {
+        low = qHashBits(part.image.constBits(), part.image.sizeInBytes(), low);
+        high = qHashBits(part.image.constBits(), part.image.sizeInBytes(), high ^ 0x9e3779b9);
+        low = qHash(part.offset.y(), qHash(part.offset.x(), low));
+        high = qHash(part.offset.y(), qHash(part.offset.x(), high));
+    }
+    return (quint64(high) << 32) | low;
+}
+
 void SceneOpenGLDecorationRenderer::render(const QRegion &region)
 {
     if (areImageSizesDirty()) {
@@ -1628,85 +1967,81 @@ void SceneOpenGLDecorationRenderer::render(const QRegion &region)
         resetImageSizesDirty();
     }
 
-    if (!m_texture) {
+    if (m_textureSize.isEmpty()) {
         // for invalid sizes we get no texture, see BUG 361551
         return;
     }
 
+    // A decoration that shares its atlas entry with other windows has to be painted
+    // completely before it can get an entry of its own.
+    const bool fullRepaint = (!m_atlasEntry && !m_texture) || (m_atlasEntry && m_atlasEntry->refCount > 1);
+
     QRect left, top, right, bottom;
     client()->client()->layoutDecorationRects(left, top, right, bottom);
 
-    // We pad each part in the decoration atlas in order to avoid texture bleeding.
     const int padding = 1;
+    const QPoint topPosition(padding, padding);
+    const QPoint bottomPosition(padding, topPosition.y() + top.height() + 2 * padding);
+    const QPoint leftPosition(padding, bottomPosition.y() + bottom.height() + 2 * padding);
+    const QPoint rightPosition(padding, leftPosition.y() + left.width() + 2 * padding);
 
-    auto renderPart = [=](const QRect &geo, const QRect &partRect, const QPoint &position, bool rotated = false) {
-        if (!geo.isValid()) {
-            return;
-        }
-
-        QRect rect = geo;
-
-        // We allow partial decoration updates and it might just so happen that the dirty region
-        // is completely contained inside the decoration part, i.e. the dirty region doesn't touch
-        // any of the decoration's edges. In that case, we should **not** pad the dirty region.
-        if (rect.left() == partRect.left()) {
-            rect.setLeft(rect.left() - padding);
-        }
-        if (rect.top() == partRect.top()) {
-            rect.setTop(rect.top() - padding);
-        }
-        if (rect.right() == partRect.right()) {
-            rect.setRight(rect.right() + padding);
-        }
-        if (rect.bottom() == partRect.bottom()) {
-            rect.setBottom(rect.bottom() + padding);
-        }
+    const QRect geometry = fullRepaint ? client()->client()->rect() : region.boundingRect();
 
-        QRect viewport = geo.translated(-rect.x(), -rect.y());
-        const qreal devicePixelRatio = client()->client()->screenScale();
-
-        QImage image(rect.size() * devicePixelRatio, QImage::Format_ARGB32_Premultiplied);
-        image.setDevicePixelRatio(devicePixelRatio);
-        image.fill(Qt::transparent);
-
-        QPainter painter(&image);
-        painter.setRenderHint(QPainter::Antialiasing);
-        painter.setViewport(QRect(viewport.topLeft(), viewport.size() * devicePixelRatio));
-        painter.setWindow(QRect(geo.topLeft(), geo.size() * qPainterEffectiveDevicePixelRatio(&painter)));
-        painter.setClipRect(geo);
-        renderToPainter(&painter, geo);
-        painter.end();
-
-        const QRect viewportScaled(viewport.topLeft() * devicePixelRatio, viewport.size() * devicePixelRatio);
-        const bool isIntegerScaling = qFuzzyCompare(devicePixelRatio, std::ceil(devicePixelRatio));
-        clamp(image, isIntegerScaling ? viewportScaled : viewportScaled.marginsRemoved({1, 1, 1, 1}));
-
-        if (rotated) {
-            // TODO: get this done directly when rendering to the image
-            image = rotate(image, QRect(QPoint(), rect.size()));
-            viewport = QRect(viewport.y(), viewport.x(), viewport.height(), viewport.width());
+    QVector<Part> parts;
+    parts.reserve(4);
+    auto addPart = [&](const QRect &partRect, const QPoint &position, bool rotated) {
+        const QRect geo = partRect.intersected(geometry);
+        if (geo.isValid()) {
+            parts.append(Part{geo, partRect, position, rotated, QImage(), QPoint()});
         }
-
-        const QPoint dirtyOffset = geo.topLeft() - partRect.topLeft();
-        m_texture->update(image, (position + dirtyOffset - viewport.topLeft()) * image.devicePixelRatio());
     };
+    addPart(left, leftPosition, true);
+    addPart(top, topPosition, false);
+    addPart(right, rightPosition, true);
+    addPart(bottom, bottomPosition, false);
 
-    const QRect geometry = region.boundingRect();
+    for (Part &part : parts) {
+        rasterize(part);
+    }
 
-    const QPoint topPosition(padding, padding);
-    const QPoint bottomPosition(padding, topPosition.y() + top.height() + 2 * padding);
-    const QPoint leftPosition(padding, bottomPosition.y() + bottom.height() + 2 * padding);
-    const QPoint rightPosition(padding, leftPosition.y() + left.width() + 2 * padding);
+    if (fullRepaint) {
+        releaseTexture();
 
-    renderPart(left.intersected(geometry), left, leftPosition, true);
-    renderPart(top.intersected(geometry), top, topPosition);
-    renderPart(right.intersected(geometry), right, rightPosition, true);
-    renderPart(bottom.intersected(geometry), bottom, bottomPosition);
-}
+        if (m_atlas) {
+            const quint64 key = contentsKey(parts);
+            m_atlasEntry = m_atlas->acquire(key, m_textureSize);
+            if (m_atlasEntry) {
+                // Another window shows exactly the same decoration.
+                return;
+            }
+            m_atlasEntry = m_atlas->allocate(m_textureSize);
+            if (m_atlasEntry) {
+                for (const Part &part : qAsConst(parts)) {
+                    m_atlas->texture()->update(part.image, m_atlasEntry->rect.topLeft() + part.offset);
+                }
+                m_atlas->publish(m_atlasEntry, key);
+                return;
+            }
+        }
 
-static int align(int value, int align)
-{
-    return (value + align - 1) & ~(align - 1);
+        // The decoration doesn't fit in the atlas, give it a texture of its own.
+        m_texture.reset(new GLTexture(GL_RGBA8, align(m_textureSize.width(), 128), m_textureSize.height()));
+        m_texture->setYInverted(true);
+        m_texture->setWrapMode(GL_CLAMP_TO_EDGE);
+        m_texture->clear();
+    } else if (m_atlasEntry) {
+        // The contents no longer match the key the entry has been published with.
+        m_atlas->unpublish(m_atlasEntry);
+    }
+
+    GLTexture *target = texture();
+    if (!target) {
+        return;
+    }
+    const QPoint origin = textureOffset();
+    for (const Part &part : qAsConst(parts)) {
+        target->update(part.image, origin + part.offset);
+    }
 }
 
 void SceneOpenGLDecorationRenderer::resizeTexture()
@@ -1725,20 +2060,13 @@ void SceneOpenGLDecorationRenderer::resizeTexture()
     size.rwidth() += 2 * padding;
     size.rheight() += 4 * 2 * padding;
 
-    size.rwidth() = align(size.width(), 128);
-
     size *= client()->client()->screenScale();
-    if (m_texture && m_texture->size() == size)
+    if (m_textureSize == size) {
         return;
-
-    if (!size.isEmpty()) {
-        m_texture.reset(new GLTexture(GL_RGBA8, size.width(), size.height()));
-        m_texture->setYInverted(true);
-        m_texture->setWrapMode(GL_CLAMP_TO_EDGE);
-        m_texture->clear();
-    } else {
-        m_texture.reset();
     }
+
+    m_textureSize = size;
+    releaseTexture();
 }
 
 } // namespace
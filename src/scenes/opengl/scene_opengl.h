@@ -13,17 +13,53 @@
 
 #include "openglbackend.h"
 
+#include "decorationatlas.h"
 #include "decorationitem.h"
 #include "scene.h"
 #include "shadow.h"
 
 #include "kwinglutils.h"
 
+#include <array>
+
+#include <QPointer>
+
 namespace KWin
 {
 class LanczosFilter;
 class OpenGLBackend;
 
+/**
+ * The GLRenderTimeQuery class measures how long the GPU takes to execute the commands
+ * of a frame. The results are collected without stalling the pipeline, i.e. only once
+ * the GPU has caught up, and reported to the RenderLoop of the output.
+ */
+class GLRenderTimeQuery
+{
+public:
+    explicit GLRenderTimeQuery(RenderLoop *renderLoop);
+    ~GLRenderTimeQuery();
+
+    static bool supported();
+
+    void begin();
+    void end();
+    void collect();
+
+private:
+    struct Query
+    {
+        GLuint begin = 0;
+        GLuint end = 0;
+        bool pending = false;
+    };
+
+    RenderLoop *m_renderLoop;
+    std::array<Query, 4> m_queries;
+    Query *m_current = nullptr;
+    int m_next = 0;
+};
+
 class KWIN_EXPORT SceneOpenGL
     : public Scene
 {
@@ -59,6 +95,19 @@ public:
     static SceneOpenGL *createScene(OpenGLBackend *backend, QObject *parent);
     static bool supported(OpenGLBackend *backend);
 
+    /**
+     * Binds the shader with the given @a traits for painting a window. While the windows
+     * of a screen pass are painted, the shader stays bound until a window needs a shader
+     * with different traits. If @a pop is set to @c true, the caller must pop the shader
+     * after painting the window.
+     */
+    GLShader *bindWindowShader(ShaderTraits traits, bool *pop);
+
+    /**
+     * Returns the texture atlas shared by the decorations of all windows.
+     */
+    DecorationAtlas *decorationAtlas() const;
+
 protected:
     void paintBackground(const QRegion &region) override;
     void aboutToStartPainting(AbstractOutput *output, const QRegion &damage) override;
@@ -78,16 +127,24 @@ private:
     void updateProjectionMatrix(const QRect &geometry);
     void performPaintWindow(EffectWindowImpl* w, int mask, const QRegion &region, WindowPaintData& data);
     void handleGraphicsReset(GLenum status);
+    GLRenderTimeQuery *renderTimeQuery(RenderLoop *renderLoop);
+    void beginWindowBatch();
+    void endWindowBatch();
 
     bool init_ok = true;
     bool m_resetOccurred = false;
     OpenGLBackend *m_backend;
     LanczosFilter *m_lanczosFilter = nullptr;
+    QScopedPointer<DecorationAtlas> m_decorationAtlas;
     QScopedPointer<GLTexture> m_cursorTexture;
     bool m_cursorTextureDirty = false;
     QMatrix4x4 m_projectionMatrix;
     QMatrix4x4 m_screenProjectionMatrix;
     GLuint vao = 0;
+    QHash<RenderLoop *, GLRenderTimeQuery *> m_renderTimeQueries;
+    bool m_renderTimeQueriesSupported = false;
+    GLShader *m_batchShader = nullptr;
+    bool m_windowBatchActive = false;
 };
 
 class OpenGLWindow final : public Scene::Window
@@ -126,8 +183,26 @@ private:
     QVector4D modulate(float opacity, float brightness) const;
     void setBlendEnabled(bool enabled);
     void createRenderNode(Item *item, RenderContext *context);
+    bool applyVertexCache(QVector<RenderNode> &renderNodes) const;
+    void updateVertexCache(QVector<RenderNode> &renderNodes);
+
+    /**
+     * The vertices of a render node as they have been uploaded to the vertex buffer. The
+     * quads are implicitly shared with the Item they come from, so they can be compared
+     * cheaply to tell whether the item has rebuilt its quads.
+     */
+    struct CachedRenderNode
+    {
+        WindowQuadList quads;
+        GLTexture *texture = nullptr;
+        QMatrix4x4 textureMatrix;
+        int firstVertex = 0;
+        int vertexCount = 0;
+    };
 
     SceneOpenGL *m_scene;
+    QScopedPointer<GLVertexBuffer> m_vertexBuffer;
+    QVector<CachedRenderNode> m_vertexCache;
     bool m_blendingEnabled = false;
 };
 
@@ -207,16 +282,39 @@ public:
 
     void render(const QRegion &region) override;
 
-    GLTexture *texture() {
-        return m_texture.data();
-    }
-    GLTexture *texture() const {
-        return m_texture.data();
-    }
+    GLTexture *texture() const;
+    /**
+     * Returns the position of the decoration in texture(), in device pixels.
+     */
+    QPoint textureOffset() const;
+    /**
+     * Translates the texture coordinates of the decoration @a quads to the position of the
+     * decoration in texture().
+     */
+    WindowQuadList mapToTexture(const WindowQuadList &quads) const;
 
 private:
+    struct Part {
+        QRect geometry;
+        QRect partRect;
+        QPoint position;
+        bool rotated;
+        QImage image;
+        QPoint offset;
+    };
+
     void resizeTexture();
+    void releaseTexture();
+    void rasterize(Part &part);
+    quint64 contentsKey(const QVector<Part> &parts) const;
+
     QScopedPointer<GLTexture> m_texture;
+    QPointer<DecorationAtlas> m_atlas;
+    DecorationAtlas::Entry *m_atlasEntry = nullptr;
+    QSize m_textureSize;
+    mutable WindowQuadList m_mappedQuadsSource;
+    mutable WindowQuadList m_mappedQuads;
+    mutable QPoint m_mappedQuadsOffset;
 };
 
 } // namespace
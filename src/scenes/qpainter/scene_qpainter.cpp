@@ -15,6 +15,7 @@
 #include "decorations/decoratedclient.h"
 #include "deleted.h"
 #include "effects.h"
+#include "ftrace.h"
 #include "main.h"
 #include "renderloop.h"
 #include "screens.h"
@@ -27,7 +28,9 @@
 #include <kwineffectquickview.h>
 // Qt
 #include <QDebug>
+#include <QPaintEngine>
 #include <QPainter>
+#include <QtConcurrentMap>
 #include <KDecoration2/Decoration>
 
 #include <cmath>
@@ -35,6 +38,69 @@
 namespace KWin
 {
 
+// Areas smaller than this many pixels are not worth distributing across worker threads
+static const int s_minTiledArea = 256 * 256;
+static const int s_tileHeight = 64;
+
+/**
+ * Splits @p rect of the @p image into horizontal tiles and calls @p function for every tile
+ * on the global thread pool. Each tile is painted through its own QImage sharing the pixels
+ * of @p image, so the painters don't interfere with each other. The painter passed to the
+ * function uses the device coordinates of @p image.
+ */
+template <typename Function>
+static void paintTiled(QImage *image, const QRect &rect, Function function)
+{
+    const QRect area = rect & image->rect();
+    if (area.isEmpty()) {
+        return;
+    }
+
+    QVector<QRect> tiles;
+    const int tileHeight = qint64(area.width()) * area.height() < s_minTiledArea ? area.height() : s_tileHeight;
+    for (int y = area.top(); y <= area.bottom(); y += tileHeight) {
+        tiles.append(QRect(area.x(), y, area.width(), qMin(tileHeight, area.bottom() - y + 1)));
+    }
+
+    uchar *bits = image->bits();
+    const int bytesPerLine = image->bytesPerLine();
+    const int bytesPerPixel = image->depth() / 8;
+    const QImage::Format format = image->format();
+
+    auto paintTile = [&](const QRect &tile) {
+        QImage view(bits + tile.y() * bytesPerLine + tile.x() * bytesPerPixel,
+                    tile.width(), tile.height(), bytesPerLine, format);
+        QPainter painter(&view);
+        painter.translate(-tile.topLeft());
+        function(&painter);
+    };
+
+    if (tiles.count() == 1) {
+        paintTile(tiles.constFirst());
+    } else {
+        QtConcurrent::blockingMap(tiles, paintTile);
+    }
+}
+
+/**
+ * Returns the image the @p painter draws on if its transform is a plain translation, which
+ * is returned in @p offset, otherwise @c nullptr.
+ */
+static QImage *tileableDevice(QPainter *painter, QPoint *offset)
+{
+    if (painter->device()->devType() != QInternal::Image || painter->paintEngine()->type() != QPaintEngine::Raster) {
+        return nullptr;
+    }
+    const QTransform transform = painter->combinedTransform();
+    if (transform.type() > QTransform::TxTranslate
+            || !qFuzzyCompare(transform.dx(), std::round(transform.dx()))
+            || !qFuzzyCompare(transform.dy(), std::round(transform.dy()))) {
+        return nullptr;
+    }
+    *offset = QPoint(std::round(transform.dx()), std::round(transform.dy()));
+    return static_cast<QImage *>(painter->device());
+}
+
 //****************************************
 // SceneQPainter
 //****************************************
@@ -91,7 +157,11 @@ void SceneQPainter::paint(AbstractOutput *output, const QRegion &damage, const Q
 
         m_painter->end();
         renderLoop->endFrame();
+
+        fTraceScope("present");
+        renderLoop->beginFrameStage(RenderJournal::Stage::BackendPresent);
         m_backend->endFrame(output, validRegion, updateRegion);
+        renderLoop->endFrameStage();
     }
 
     // do cleanup
@@ -100,6 +170,17 @@ void SceneQPainter::paint(AbstractOutput *output, const QRegion &damage, const Q
 
 void SceneQPainter::paintBackground(const QRegion &region)
 {
+    QPoint offset;
+    if (QImage *device = tileableDevice(m_painter.data(), &offset)) {
+        const QRegion deviceRegion = region.translated(offset);
+        paintTiled(device, deviceRegion.boundingRect(), [&deviceRegion](QPainter *painter) {
+            for (const QRect &rect : deviceRegion) {
+                painter->fillRect(rect, Qt::black);
+            }
+        });
+        return;
+    }
+
     for (const QRect &rect : region) {
         m_painter->fillRect(rect, Qt::black);
     }
@@ -153,6 +234,43 @@ QImage *SceneQPainter::qpainterRenderBuffer(AbstractOutput *output) const
     return m_backend->bufferForScreen(output);
 }
 
+QImage *SceneQPainter::scratchImage(const QSize &size)
+{
+    if (m_scratchImage.width() < size.width() || m_scratchImage.height() < size.height()) {
+        m_scratchImage = QImage(size.expandedTo(m_scratchImage.size()), QImage::Format_ARGB32_Premultiplied);
+    }
+    return &m_scratchImage;
+}
+
+void SceneQPainter::blendImage(QPainter *painter, const QPoint &position, const QImage &source,
+                               const QRect &sourceRect, qreal opacity)
+{
+    QPoint offset;
+    if (QImage *device = tileableDevice(painter, &offset)) {
+        const QPoint devicePosition = position + offset;
+        QRect deviceRect(devicePosition, sourceRect.size());
+        QRegion deviceClip;
+        if (painter->hasClipping()) {
+            deviceClip = painter->clipRegion().translated(offset);
+            deviceRect &= deviceClip.boundingRect();
+        }
+        // The raster engine blends with a constant opacity using its SIMD code paths
+        paintTiled(device, deviceRect, [&](QPainter *tilePainter) {
+            if (!deviceClip.isEmpty()) {
+                tilePainter->setClipRegion(deviceClip);
+            }
+            tilePainter->setOpacity(opacity);
+            tilePainter->drawImage(devicePosition, source, sourceRect);
+        });
+        return;
+    }
+
+    painter->save();
+    painter->setOpacity(opacity);
+    painter->drawImage(position, source, sourceRect);
+    painter->restore();
+}
+
 //****************************************
 // SceneQPainter::Window
 //****************************************
@@ -189,29 +307,33 @@ void SceneQPainter::Window::performPaint(int mask, const QRegion &_region, const
     }
 
     const bool opaque = qFuzzyCompare(1.0, data.opacity());
-    QImage tempImage;
+    QRect tempRect;
+    QImage *tempImage = nullptr;
     QPainter tempPainter;
     if (!opaque) {
-        // need a temp render target which we later on blit to the screen
-        tempImage = QImage(boundingRect.size(), QImage::Format_ARGB32_Premultiplied);
-        tempImage.fill(Qt::transparent);
-        tempPainter.begin(&tempImage);
-        tempPainter.save();
-        tempPainter.translate(-boundingRect.topLeft());
+        // need a temp render target which we later on blit to the screen, only the
+        // damaged part of the window is needed unless the window is transformed
+        tempRect = boundingRect;
+        if (!(mask & (PAINT_WINDOW_TRANSFORMED | PAINT_SCREEN_TRANSFORMED))) {
+            tempRect &= region.boundingRect();
+        }
+        tempImage = m_scene->scratchImage(tempRect.size());
+        tempPainter.begin(tempImage);
+        tempPainter.setCompositionMode(QPainter::CompositionMode_Source);
+        tempPainter.fillRect(QRect(QPoint(0, 0), tempRect.size()), Qt::transparent);
+        tempPainter.setCompositionMode(QPainter::CompositionMode_SourceOver);
+        tempPainter.setClipRect(QRect(QPoint(0, 0), tempRect.size()));
+        tempPainter.translate(-tempRect.topLeft());
         painter = &tempPainter;
     }
 
     renderItem(painter, windowItem());
 
     if (!opaque) {
-        tempPainter.restore();
-        tempPainter.setCompositionMode(QPainter::CompositionMode_DestinationIn);
-        QColor translucent(Qt::transparent);
-        translucent.setAlphaF(data.opacity());
-        tempPainter.fillRect(QRect(QPoint(0, 0), boundingRect.size()), translucent);
         tempPainter.end();
         painter = scenePainter;
-        painter->drawImage(boundingRect.topLeft(), tempImage);
+        m_scene->blendImage(painter, tempRect.topLeft(), *tempImage, QRect(QPoint(0, 0), tempRect.size()),
+                            data.opacity());
     }
 
     painter->restore();
@@ -268,14 +390,14 @@ void SceneQPainter::Window::renderSurfaceItem(QPainter *painter, SurfaceItem *su
     }
     surfaceItem->resetDamage();
 
+    const QImage image = platformSurfaceTexture->image();
+    const QMatrix4x4 matrix = surfaceItem->surfaceToBufferMatrix();
     const QRegion shape = surfaceItem->shape();
     for (const QRectF rect : shape) {
-        const QMatrix4x4 matrix = surfaceItem->surfaceToBufferMatrix();
         const QPointF bufferTopLeft = matrix.map(rect.topLeft());
         const QPointF bufferBottomRight = matrix.map(rect.bottomRight());
 
-        painter->drawImage(rect, platformSurfaceTexture->image(),
-                           QRectF(bufferTopLeft, bufferBottomRight));
+        painter->drawImage(rect, image, QRectF(bufferTopLeft, bufferBottomRight));
     }
 }
 
@@ -46,6 +46,17 @@ public:
 
     static SceneQPainter *createScene(QPainterBackend *backend, QObject *parent);
 
+    /**
+     * Returns a scratch image that is at least as big as @p size. Its contents are undefined.
+     */
+    QImage *scratchImage(const QSize &size);
+    /**
+     * Draws the @p sourceRect of the @p source image at @p position with the given @p opacity
+     * using the @p painter. Big areas are split into tiles that are blended in parallel.
+     */
+    void blendImage(QPainter *painter, const QPoint &position, const QImage &source,
+                    const QRect &sourceRect, qreal opacity);
+
 protected:
     void paintBackground(const QRegion &region) override;
     Scene::Window *createWindow(Toplevel *toplevel) override;
@@ -56,6 +67,7 @@ private:
     explicit SceneQPainter(QPainterBackend *backend, QObject *parent = nullptr);
     QPainterBackend *m_backend;
     QScopedPointer<QPainter> m_painter;
+    QImage m_scratchImage;
     class Window;
 };
 
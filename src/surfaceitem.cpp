@@ -53,7 +53,7 @@ void SurfaceItem::addDamage(const QRegion &region)
     m_damage += region;
     scheduleRepaint(region);
 
-    Q_EMIT m_window->damaged(m_window, region);
+    Q_EMIT m_window->damaged(m_window, mapToGlobal(region));
 }
 
 void SurfaceItem::resetDamage()
@@ -203,6 +203,7 @@ bool SurfacePixmap::isDiscarded() const
 void SurfacePixmap::markAsDiscarded()
 {
     m_isDiscarded = true;
+    Q_EMIT discarded();
 }
 
 } // namespace KWin
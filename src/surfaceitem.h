@@ -90,6 +90,13 @@ public:
 
     virtual bool isValid() const = 0;
 
+Q_SIGNALS:
+    /**
+     * This signal is emitted when the pixmap has been discarded and is kept only
+     * for the previous contents of the surface, e.g. for a closing animation.
+     */
+    void discarded();
+
 protected:
     QSize m_size;
     QRect m_contentsRect;
@@ -361,6 +361,7 @@ void Toplevel::setReadyForPainting()
     if (!ready_for_painting) {
         ready_for_painting = true;
         if (Compositor::compositing()) {
+            Compositor::self()->invalidateWindowsToRender();
             addRepaintFull();
             Q_EMIT windowShown(this);
         }
@@ -693,6 +693,10 @@ void Workspace::addClient(X11Client *c)
     }
     m_x11Clients.append(c);
     m_allClients.append(c);
+    addToWindowIndex(c->window(), c, Predicate::WindowMatch);
+    addToWindowIndex(c->wrapperId(), c, Predicate::WrapperIdMatch);
+    addToWindowIndex(c->frameId(), c, Predicate::FrameIdMatch);
+    addToWindowIndex(c->inputId(), c, Predicate::InputIdMatch);
     addToStack(c);
     markXStackingOrderAsDirty();
     updateClientArea(); // This cannot be in manage(), because the client got added only now
@@ -714,9 +718,48 @@ void Workspace::addClient(X11Client *c)
 void Workspace::addUnmanaged(Unmanaged* c)
 {
     m_unmanaged.append(c);
+    const xcb_window_t w = c->window();
+    if (!m_x11WindowIndex.contains(w)) {
+        // a managed client always takes precedence, matches the lookup order in workspaceEvent
+        m_x11WindowIndex[w].unmanaged = c;
+    }
     markXStackingOrderAsDirty();
 }
 
+void Workspace::addToWindowIndex(xcb_window_t w, X11Client *client, Predicate role)
+{
+    if (w == XCB_WINDOW_NONE) {
+        return;
+    }
+    X11WindowIndexEntry &entry = m_x11WindowIndex[w];
+    entry.client = client;
+    entry.unmanaged = nullptr;
+    entry.role = role;
+}
+
+void Workspace::removeFromWindowIndex(xcb_window_t w, const Toplevel *toplevel)
+{
+    auto it = m_x11WindowIndex.find(w);
+    if (it == m_x11WindowIndex.end()) {
+        return;
+    }
+    if (it->client == toplevel || it->unmanaged == toplevel) {
+        m_x11WindowIndex.erase(it);
+    }
+}
+
+void Workspace::updateInputWindowIndex(X11Client *client, xcb_window_t oldInputId)
+{
+    if (oldInputId == client->inputId()) {
+        return;
+    }
+    removeFromWindowIndex(oldInputId, client);
+    // Only clients that went through addClient() are indexed.
+    if (m_x11WindowIndex.value(client->window()).client == client) {
+        addToWindowIndex(client->inputId(), client, Predicate::InputIdMatch);
+    }
+}
+
 /**
  * Destroys the client \a c
  */
@@ -731,6 +774,10 @@ void Workspace::removeX11Client(X11Client *c)
     Q_ASSERT(m_x11Clients.contains(c));
     // TODO: if marked client is removed, notify the marked list
     m_x11Clients.removeAll(c);
+    removeFromWindowIndex(c->window(), c);
+    removeFromWindowIndex(c->wrapperId(), c);
+    removeFromWindowIndex(c->frameId(), c);
+    removeFromWindowIndex(c->inputId(), c);
     Group* group = findGroup(c->window());
     if (group != nullptr)
         group->lostLeader();
@@ -741,6 +788,7 @@ void Workspace::removeUnmanaged(Unmanaged* c)
 {
     Q_ASSERT(m_unmanaged.contains(c));
     m_unmanaged.removeAll(c);
+    removeFromWindowIndex(c->window(), c);
     Q_EMIT unmanagedRemoved(c);
     markXStackingOrderAsDirty();
 }
@@ -1791,32 +1839,20 @@ Unmanaged *Workspace::findUnmanaged(std::function<bool (const Unmanaged*)> func)
 
 Unmanaged *Workspace::findUnmanaged(xcb_window_t w) const
 {
-    return findUnmanaged([w](const Unmanaged *u) {
-        return u->window() == w;
-    });
+    const auto it = m_x11WindowIndex.constFind(w);
+    if (it == m_x11WindowIndex.constEnd()) {
+        return nullptr;
+    }
+    return it->unmanaged;
 }
 
 X11Client *Workspace::findClient(Predicate predicate, xcb_window_t w) const
 {
-    switch (predicate) {
-    case Predicate::WindowMatch:
-        return findClient([w](const X11Client *c) {
-            return c->window() == w;
-        });
-    case Predicate::WrapperIdMatch:
-        return findClient([w](const X11Client *c) {
-            return c->wrapperId() == w;
-        });
-    case Predicate::FrameIdMatch:
-        return findClient([w](const X11Client *c) {
-            return c->frameId() == w;
-        });
-    case Predicate::InputIdMatch:
-        return findClient([w](const X11Client *c) {
-            return c->inputId() == w;
-        });
+    const auto it = m_x11WindowIndex.constFind(w);
+    if (it == m_x11WindowIndex.constEnd() || !it->client || it->role != predicate) {
+        return nullptr;
     }
-    return nullptr;
+    return it->client;
 }
 
 Toplevel *Workspace::findToplevel(std::function<bool (const Toplevel*)> func) const
@@ -1883,6 +1919,7 @@ void Workspace::markXStackingOrderAsDirty()
     if (kwinApp()->x11Connection() && !kwinApp()->isClosingX11Connection()) {
         m_xStackingQueryTree.reset(new Xcb::Tree(kwinApp()->x11RootWindow()));
     }
+    Q_EMIT xStackingOrderChanged();
 }
 
 void Workspace::setWasUserInteraction()
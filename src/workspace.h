@@ -331,6 +331,11 @@ public:
     bool showingDesktop() const;
 
     void removeX11Client(X11Client *);   // Only called from X11Client::destroyClient() or X11Client::releaseWindow()
+    /**
+     * Updates the window id index after the decoration input window of @p client has been
+     * changed from @p oldInputId to the current X11Client::inputId().
+     */
+    void updateInputWindowIndex(X11Client *client, xcb_window_t oldInputId);
     void setActiveClient(AbstractClient*);
     Group* findGroup(xcb_window_t leader) const;
     void addGroup(Group* group);
@@ -524,6 +529,11 @@ Q_SIGNALS:
      * or lowered
      */
     void stackingOrderChanged();
+    /**
+     * This signal is emitted whenever the stacking order returned by xStackingOrder()
+     * has been invalidated.
+     */
+    void xStackingOrderChanged();
 
     /**
      * This signal is emitted whenever an internal client is created.
@@ -568,6 +578,9 @@ private:
     Unmanaged* createUnmanaged(xcb_window_t w);
     void addUnmanaged(Unmanaged* c);
 
+    void addToWindowIndex(xcb_window_t w, X11Client *client, Predicate role);
+    void removeFromWindowIndex(xcb_window_t w, const Toplevel *toplevel);
+
     void addShellClient(AbstractClient *client);
     void removeShellClient(AbstractClient *client);
 
@@ -620,6 +633,19 @@ private:
     QList<Deleted *> deleted;
     QList<InternalClient *> m_internalClients;
 
+    /**
+     * Maps every X11 window id owned by a managed X11Client (client, wrapper, frame and
+     * decoration input window) or an Unmanaged to its owner, so that X events can be
+     * dispatched without scanning the client lists.
+     */
+    struct X11WindowIndexEntry
+    {
+        X11Client *client = nullptr;
+        Unmanaged *unmanaged = nullptr;
+        Predicate role;
+    };
+    QHash<xcb_window_t, X11WindowIndexEntry> m_x11WindowIndex;
+
     QList<Toplevel *> unconstrained_stacking_order; // Topmost last
     QList<Toplevel *> stacking_order; // Topmost last
     QVector<xcb_window_t> manual_overlays; //Topmost last
@@ -1054,7 +1054,9 @@ void X11Client::updateInputWindow()
     }
 
     if (region.isEmpty()) {
+        const xcb_window_t oldInputId = m_decoInputExtent;
         m_decoInputExtent.reset();
+        workspace()->updateInputWindowIndex(this, oldInputId);
         return;
     }
 
@@ -1077,6 +1079,7 @@ void X11Client::updateInputWindow()
             XCB_EVENT_MASK_POINTER_MOTION
         };
         m_decoInputExtent.create(bounds, XCB_WINDOW_CLASS_INPUT_ONLY, mask, values);
+        workspace()->updateInputWindowIndex(this, XCB_WINDOW_NONE);
         if (mapping_state == Mapped)
             m_decoInputExtent.map();
     } else {
@@ -1162,7 +1165,9 @@ void X11Client::destroyDecoration()
             Q_EMIT geometryShapeChanged(this, oldgeom);
         }
     }
+    const xcb_window_t oldInputId = m_decoInputExtent;
     m_decoInputExtent.reset();
+    workspace()->updateInputWindowIndex(this, oldInputId);
 }
 
 void X11Client::maybeCreateX11DecorationRenderer()